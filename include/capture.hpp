@@ -0,0 +1,249 @@
+// this file describes frame captures
+// a capture records every draw a frame issued (which pipeline, which mesh, instance
+// transforms, raster state, scissor) plus a blob of constants the program writes
+// itself, like the camera and lights its shaders read. meshes are recorded by name,
+// the replaying program loads the same assets and registers them under the same
+// names. replaying re-executes the draws without a window
+
+#pragma once
+
+#include "util.hpp"
+#include "pipeline.hpp"
+
+namespace demo {
+
+struct GCaptureDraw {
+	std::uint32_t pass = 0; // pipeline, as numbered by attach
+	std::uint32_t mesh = 0; // index into the capture's mesh names
+	GRasterState state;
+	GRect scissor;
+
+	// empty if the mesh was drawn with the model matrix the shader held
+	std::vector<mat4x4> instances;
+};
+
+class GCapture {
+public:
+	// meshes must be registered before they are drawn into a capture or looked up
+	// during a replay
+	void add_mesh(const std::string& name, const void* mesh) {
+		mesh_names[mesh] = name;
+		named_meshes[name] = mesh;
+	}
+
+	// record every draw of the pipeline as the given pass
+	template <class Context>
+	void attach(GPipeline<Context>& p, std::uint32_t pass) {
+		p.on_draw = [this, &p, pass](const void* mesh, const std::vector<mat4x4>* instances) {
+			GCaptureDraw d;
+			d.pass = pass;
+			d.mesh = mesh_index(mesh);
+			d.state = p.state;
+			d.scissor = p.scissor;
+			if(instances)
+				d.instances = *instances;
+			draws.push_back(d);
+		};
+	}
+
+	template <class Context>
+	void detach(GPipeline<Context>& p) {
+		p.on_draw = nullptr;
+	}
+
+	// start a new frame, keeps the registered meshes
+	void reset() {
+		draws.clear();
+		names.clear();
+		constants.clear();
+		read_pos = 0;
+	}
+
+	// mesh of a draw in a loaded capture
+	const void* mesh(const GCaptureDraw& d) const {
+		auto it = named_meshes.find(names[d.mesh]);
+		if(it == named_meshes.end())
+			throw std::runtime_error("capture uses unknown mesh " + names[d.mesh]);
+		return it->second;
+	}
+
+	// program constants, read back in the order they were written
+	template <typename T>
+	void put(const T& v) {
+		const char* p = (const char*)&v;
+		constants.insert(constants.end(), p, p + sizeof(T));
+	}
+
+	template <typename T>
+	void put(const std::vector<T>& v) {
+		put((std::uint64_t)v.size());
+		const char* p = (const char*)v.data();
+		constants.insert(constants.end(), p, p + v.size() * sizeof(T));
+	}
+
+	template <typename T>
+	void get(T& v) {
+		read(&v, sizeof(T));
+	}
+
+	template <typename T>
+	void get(std::vector<T>& v) {
+		std::uint64_t size;
+		get(size);
+		v.resize(size);
+		read(v.data(), size * sizeof(T));
+	}
+
+	void save(const std::string& filename) const {
+		std::ofstream f(filename, std::ios::binary);
+		if(!f)
+			throw std::runtime_error("could not open capture file " + filename);
+
+		write(f, magic);
+		write(f, version);
+		write(f, window_width);
+		write(f, window_height);
+		write(f, width);
+		write(f, height);
+
+		write(f, (std::uint32_t)names.size());
+		for(const std::string& n : names) {
+			write(f, (std::uint32_t)n.size());
+			f.write(n.data(), n.size());
+		}
+
+		write(f, (std::uint64_t)constants.size());
+		f.write(constants.data(), constants.size());
+
+		write(f, (std::uint64_t)draws.size());
+		for(const GCaptureDraw& d : draws) {
+			write(f, d.pass);
+			write(f, d.mesh);
+			write(f, (std::uint8_t)d.state.depth_only);
+			write(f, (std::uint8_t)d.state.depth_write);
+			write(f, (std::uint8_t)d.state.depth_func);
+			write(f, d.scissor);
+			write(f, (std::uint32_t)d.instances.size());
+			f.write((const char*)d.instances.data(), d.instances.size() * sizeof(mat4x4));
+		}
+
+		if(!f)
+			throw std::runtime_error("could not write capture file " + filename);
+	}
+
+	void load(const std::string& filename) {
+		std::ifstream f(filename, std::ios::binary);
+		if(!f)
+			throw std::runtime_error("could not open capture file " + filename);
+
+		reset();
+
+		std::uint32_t m, v;
+		read(f, m);
+		read(f, v);
+		if(m != magic || v != version)
+			throw std::runtime_error("not a capture file or wrong version: " + filename);
+
+		read(f, window_width);
+		read(f, window_height);
+		read(f, width);
+		read(f, height);
+
+		std::uint32_t name_count;
+		read(f, name_count);
+		names.resize(name_count);
+		for(std::string& n : names) {
+			std::uint32_t size;
+			read(f, size);
+			n.resize(size);
+			f.read(&n[0], size);
+		}
+
+		std::uint64_t constant_size;
+		read(f, constant_size);
+		constants.resize(constant_size);
+		f.read(constants.data(), constant_size);
+
+		std::uint64_t draw_count;
+		read(f, draw_count);
+		draws.resize(draw_count);
+		for(GCaptureDraw& d : draws) {
+			std::uint8_t depth_only, depth_write, depth_func;
+			std::uint32_t instance_count;
+
+			read(f, d.pass);
+			read(f, d.mesh);
+			read(f, depth_only);
+			read(f, depth_write);
+			read(f, depth_func);
+			read(f, d.scissor);
+			read(f, instance_count);
+
+			d.state.depth_only = depth_only;
+			d.state.depth_write = depth_write;
+			d.state.depth_func = (GDepthFunc)depth_func;
+			d.instances.resize(instance_count);
+			f.read((char*)d.instances.data(), instance_count * sizeof(mat4x4));
+
+			if(d.mesh >= names.size())
+				throw std::runtime_error("corrupt capture file " + filename);
+		}
+
+		if(!f)
+			throw std::runtime_error("truncated capture file " + filename);
+	}
+
+	// window and render target size of the captured frame
+	int window_width = 0;
+	int window_height = 0;
+	int width = 0;
+	int height = 0;
+
+	std::vector<GCaptureDraw> draws;
+
+private:
+	static constexpr std::uint32_t magic = 0x50414344; // "DCAP"
+	static constexpr std::uint32_t version = 1;
+
+	std::uint32_t mesh_index(const void* mesh) {
+		auto it = mesh_names.find(mesh);
+		if(it == mesh_names.end())
+			throw std::runtime_error("mesh drawn into a capture was not registered");
+
+		auto n = std::find(names.begin(), names.end(), it->second);
+		if(n != names.end())
+			return n - names.begin();
+
+		names.push_back(it->second);
+		return names.size() - 1;
+	}
+
+	void read(void* p, std::size_t size) {
+		if(read_pos + size > constants.size())
+			throw std::runtime_error("capture constants are shorter than expected");
+
+		std::memcpy(p, constants.data() + read_pos, size);
+		read_pos += size;
+	}
+
+	template <typename T>
+	static void write(std::ofstream& f, const T& v) {
+		f.write((const char*)&v, sizeof(T));
+	}
+
+	template <typename T>
+	static void read(std::ifstream& f, T& v) {
+		f.read((char*)&v, sizeof(T));
+	}
+
+	std::map<const void*, std::string> mesh_names;
+	std::map<std::string, const void*> named_meshes;
+
+	// names of the meshes this frame used
+	std::vector<std::string> names;
+
+	std::vector<char> constants;
+	std::size_t read_pos = 0;
+};
+
+}
@@ -0,0 +1,309 @@
+// this file describes block compressed textures
+// texels are stored in 4x4 blocks in the BC1 (8 bytes per block, RGB and 1 bit alpha)
+// or BC3 (16 bytes per block, BC1 color plus interpolated alpha) layouts. blocks are
+// encoded when the texture is created and decoded by the sampler, which keeps the
+// last few decoded blocks around because neighbouring samples usually hit the same
+// block
+
+#pragma once
+
+#include "util.hpp"
+#include "texture.hpp"
+
+namespace demo {
+
+static inline std::uint16_t pack_565(int r, int g, int b) {
+	return (std::uint16_t)(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+static inline GRgba unpack_565(std::uint16_t c) {
+	int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	return GRgba{ (std::uint8_t)(r << 3 | r >> 2), (std::uint8_t)(g << 2 | g >> 4), (std::uint8_t)(b << 3 | b >> 2), 255 };
+}
+
+// two 565 endpoints and 2 bit indices. with c0 > c1 the palette is c0, c1 and two
+// colors between them, otherwise c0, c1, their midpoint and transparent black
+struct GBC1 {
+	struct block_type {
+		std::uint16_t c0, c1;
+		std::uint32_t indices;
+	};
+
+	static constexpr bool has_alpha = false;
+
+	static block_type encode(const GRgba* texels) {
+		bool transparent = false;
+		for(int i = 0; i < 16; i++)
+			transparent |= texels[i].a < 128;
+
+		return encode_color(texels, !transparent, transparent);
+	}
+
+	static void decode(const block_type& b, GRgba* out) {
+		decode_color(b, out, b.c0 > b.c1);
+	}
+
+	// endpoints from the bounding box of the colors, inset by 1/16 of its size so
+	// outliers do not stretch the palette. four_color forces the 4 color palette
+	// (BC3 color blocks always use it)
+	static block_type encode_color(const GRgba* texels, bool four_color, bool punch_through) {
+		int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+
+		for(int i = 0; i < 16; i++) {
+			if(punch_through && texels[i].a < 128)
+				continue;
+
+			for(int c = 0; c < 3; c++) {
+				lo[c] = std::min<int>(lo[c], (&texels[i].r)[c]);
+				hi[c] = std::max<int>(hi[c], (&texels[i].r)[c]);
+			}
+		}
+
+		for(int c = 0; c < 3; c++) {
+			// every texel is transparent
+			if(lo[c] > hi[c]) {
+				lo[c] = hi[c] = 0;
+				continue;
+			}
+
+			int inset = (hi[c] - lo[c]) >> 4;
+			lo[c] += inset;
+			hi[c] -= inset;
+		}
+
+		block_type b;
+		b.c0 = pack_565(hi[0], hi[1], hi[2]);
+		b.c1 = pack_565(lo[0], lo[1], lo[2]);
+
+		if(four_color ? b.c0 < b.c1 : b.c0 > b.c1)
+			std::swap(b.c0, b.c1);
+
+		GRgba palette[4];
+		palette_of(b, palette, four_color);
+
+		// nearest palette entry per texel, never the transparent one for opaque texels
+		b.indices = 0;
+		for(int i = 0; i < 16; i++) {
+			int best = 0, best_d = INT_MAX;
+
+			if(punch_through && texels[i].a < 128) {
+				best = 3;
+			} else {
+				for(int p = 0; p < (four_color ? 4 : 3); p++) {
+					int dr = palette[p].r - texels[i].r, dg = palette[p].g - texels[i].g, db = palette[p].b - texels[i].b;
+					int d = dr * dr + dg * dg + db * db;
+
+					if(d < best_d) {
+						best_d = d;
+						best = p;
+					}
+				}
+			}
+
+			b.indices |= (std::uint32_t)best << (i * 2);
+		}
+
+		return b;
+	}
+
+	static void decode_color(const block_type& b, GRgba* out, bool four_color) {
+		GRgba palette[4];
+		palette_of(b, palette, four_color);
+
+		for(int i = 0; i < 16; i++)
+			out[i] = palette[(b.indices >> (i * 2)) & 3];
+	}
+
+	static void palette_of(const block_type& b, GRgba* p, bool four_color) {
+		p[0] = unpack_565(b.c0);
+		p[1] = unpack_565(b.c1);
+
+		for(int c = 0; c < 3; c++) {
+			int a = (&p[0].r)[c], z = (&p[1].r)[c];
+
+			if(four_color) {
+				(&p[2].r)[c] = (std::uint8_t)((2 * a + z) / 3);
+				(&p[3].r)[c] = (std::uint8_t)((a + 2 * z) / 3);
+			} else {
+				(&p[2].r)[c] = (std::uint8_t)((a + z) / 2);
+				(&p[3].r)[c] = 0;
+			}
+		}
+
+		p[2].a = 255;
+		p[3].a = four_color ? 255 : 0;
+	}
+};
+
+// BC1 color in 4 color mode plus two 8 bit alpha endpoints and 3 bit indices.
+// with a0 > a1 the alpha palette has 6 values between the endpoints, otherwise 4
+// plus 0 and 255
+struct GBC3 {
+	struct block_type {
+		std::uint8_t a0, a1;
+		std::uint8_t alpha_indices[6];
+		GBC1::block_type color;
+	};
+
+	static constexpr bool has_alpha = true;
+
+	static block_type encode(const GRgba* texels) {
+		block_type b;
+		b.color = GBC1::encode_color(texels, true, false);
+
+		int lo = 255, hi = 0;
+		for(int i = 0; i < 16; i++) {
+			lo = std::min<int>(lo, texels[i].a);
+			hi = std::max<int>(hi, texels[i].a);
+		}
+
+		b.a0 = hi;
+		b.a1 = lo;
+
+		std::uint8_t palette[8];
+		alpha_palette(b, palette);
+
+		std::uint64_t bits = 0;
+		for(int i = 0; i < 16; i++) {
+			int best = 0, best_d = INT_MAX;
+
+			for(int p = 0; p < 8; p++) {
+				int d = std::abs(palette[p] - texels[i].a);
+				if(d < best_d) {
+					best_d = d;
+					best = p;
+				}
+			}
+
+			bits |= (std::uint64_t)best << (i * 3);
+		}
+
+		for(int i = 0; i < 6; i++)
+			b.alpha_indices[i] = (std::uint8_t)(bits >> (i * 8));
+
+		return b;
+	}
+
+	static void decode(const block_type& b, GRgba* out) {
+		GBC1::decode_color(b.color, out, true);
+
+		std::uint8_t palette[8];
+		alpha_palette(b, palette);
+
+		std::uint64_t bits = 0;
+		for(int i = 0; i < 6; i++)
+			bits |= (std::uint64_t)b.alpha_indices[i] << (i * 8);
+
+		for(int i = 0; i < 16; i++)
+			out[i].a = palette[(bits >> (i * 3)) & 7];
+	}
+
+	static void alpha_palette(const block_type& b, std::uint8_t* p) {
+		p[0] = b.a0;
+		p[1] = b.a1;
+
+		if(b.a0 > b.a1) {
+			for(int i = 1; i < 7; i++)
+				p[i + 1] = (std::uint8_t)(((7 - i) * b.a0 + i * b.a1) / 7);
+		} else {
+			for(int i = 1; i < 5; i++)
+				p[i + 1] = (std::uint8_t)(((5 - i) * b.a0 + i * b.a1) / 5);
+			p[6] = 0;
+			p[7] = 255;
+		}
+	}
+};
+
+template <class Codec>
+class GCompressedTexture {
+public:
+	typedef typename Codec::block_type block_type;
+
+	GCompressedTexture() { }
+
+	// encodes the image, edge blocks repeat the last row and column
+	GCompressedTexture(const GImage& image) :
+		width(image.width),
+		height(image.height),
+		blocks_x((image.width + 3) / 4),
+		blocks_y((image.height + 3) / 4) {
+		blocks.reserve(blocks_x * blocks_y);
+
+		for(int by = 0; by < blocks_y; by++) {
+			for(int bx = 0; bx < blocks_x; bx++) {
+				GRgba texels[16];
+
+				for(int i = 0; i < 16; i++) {
+					int x = std::min(bx * 4 + (i & 3), width - 1),
+						y = std::min(by * 4 + (i >> 2), height - 1);
+					texels[i] = image.texel(x, y);
+				}
+
+				blocks.push_back(Codec::encode(texels));
+			}
+		}
+	}
+
+	void decode_block(int bx, int by, GRgba* out) const {
+		Codec::decode(blocks[by * blocks_x + bx], out);
+	}
+
+	// decodes a whole block for one texel, use a GCompressedSampler instead
+	GRgba texel(int x, int y) const {
+		GRgba out[16];
+		decode_block(x >> 2, y >> 2, out);
+		return out[(y & 3) * 4 + (x & 3)];
+	}
+
+	std::size_t size_in_bytes() const {
+		return blocks.size() * sizeof(block_type);
+	}
+
+	int width = 0;
+	int height = 0;
+	int blocks_x = 0;
+	int blocks_y = 0;
+	std::vector<block_type> blocks;
+};
+
+// reads texels through a small direct mapped cache of decoded blocks. slots are
+// picked by the low bits of the block coordinates, so a 4x4 neighbourhood of
+// blocks never evicts itself. one sampler per thread
+template <class Codec>
+class GCompressedSampler {
+public:
+	GCompressedSampler(const GCompressedTexture<Codec>& t) :
+		texture(t),
+		width(t.width),
+		height(t.height) {
+		std::fill(tags, tags + slots, -1);
+	}
+
+	GRgba texel(int x, int y) {
+		int bx = x >> 2, by = y >> 2;
+		int slot = (by & 3) << 2 | (bx & 3);
+		int tag = by * texture.blocks_x + bx;
+
+		if(tags[slot] != tag) {
+			texture.decode_block(bx, by, cache[slot]);
+			tags[slot] = tag;
+			misses++;
+		}
+
+		return cache[slot][(y & 3) * 4 + (x & 3)];
+	}
+
+	const GCompressedTexture<Codec>& texture;
+	int width;
+	int height;
+
+	std::size_t misses = 0;
+
+private:
+	static constexpr int slots = 16;
+
+	int tags[slots];
+	GRgba cache[slots][16];
+};
+
+}
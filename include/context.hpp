@@ -8,6 +8,7 @@
 
 #include "util.hpp"
 #include "window.hpp"
+#include "fastmath.hpp"
 
 namespace demo {
 
@@ -22,6 +23,13 @@ public:
 	virtual Output operator()(const Input&) = 0;
 	virtual void update() = 0;
 
+	// per-instance constants, set by the pipeline before each instance is shaded
+	virtual void set_model(const mat4x4&) { }
+
+	// object space -> clip space transform of the current instance, used by the
+	// pipeline to cull whole instances. the default frustum never rejects anything
+	virtual mat4x4 clip_matrix() { return mat4x4(0); }
+
 	GWindow& window;
 };
 
@@ -58,7 +66,35 @@ public:
 	void update() { }
 };
 
-template <class VertexShader, class GeometryShader, class FragmentShader>
+// passes triangles of any vertex type through unchanged
+template <class V>
+class GPassthroughGeometryShader : public GShader<GTriangle<V>, GTriangle<V>> {
+public:
+	GPassthroughGeometryShader(GWindow& win) : GShader<GTriangle<V>, GTriangle<V>>(win) { }
+
+	GTriangle<V> operator()(const GTriangle<V>& tri) {
+		return tri;
+	}
+
+	void update() { }
+};
+
+// for contexts that only ever rasterize depth
+template <class V>
+class GNullFragmentShader : public GShader<V, GRgba> {
+public:
+	GNullFragmentShader(GWindow& win) : GShader<V, GRgba>(win) { }
+
+	GRgba operator()(const V&) {
+		return GRgba{ 0, 0, 0, 255 };
+	}
+
+	void update() { }
+};
+
+// Math is what the pipeline's own divides use for this context, GExactMath or
+// GFastMath like the shaders
+template <class VertexShader, class GeometryShader, class FragmentShader, class Math = DEMO_SHADER_MATH>
 class GContext {
 public:
 	GContext(GWindow& w) :
@@ -72,6 +108,7 @@ public:
 	typedef typename VertexShader::OutputType VOutputType;
 	typedef typename GeometryShader::OutputType GOutputType;
 	typedef typename FragmentShader::OutputType FOutputType;
+	typedef Math MathType;
 
 	VertexShader vertex_shader;
 	GeometryShader geometry_shader;
@@ -0,0 +1,141 @@
+// this file describes change tracking between frames
+// every frame the scene describes the state all pixels depend on (camera, lights,
+// settings, target size) and the state of each object together with the screen
+// rectangle it covers. if nothing changed the last frame is reused, if only some
+// objects changed just the rectangles they covered last frame and cover now are
+// cleared and redrawn
+
+#pragma once
+
+#include "util.hpp"
+
+namespace demo {
+
+// raw bytes of the values a frame or an object depends on, compared between frames.
+// only add values without padding (floats, vectors, matrices, integers)
+class GStateKey {
+public:
+	template <typename T>
+	GStateKey& add(const T& v) {
+		const char* p = (const char*)&v;
+		bytes.insert(bytes.end(), p, p + sizeof(T));
+		return *this;
+	}
+
+	template <typename T>
+	GStateKey& add(const std::vector<T>& v) {
+		add(v.size());
+		const char* p = (const char*)v.data();
+		bytes.insert(bytes.end(), p, p + v.size() * sizeof(T));
+		return *this;
+	}
+
+	bool operator==(const GStateKey& k) const { return bytes == k.bytes; }
+	bool operator!=(const GStateKey& k) const { return bytes != k.bytes; }
+
+private:
+	std::vector<char> bytes;
+};
+
+struct GDamageObject {
+	GStateKey key;
+	GRect rect;
+};
+
+enum class GRedraw {
+	none,
+	partial,
+	full
+};
+
+class GDamageTracker {
+public:
+	// compare against the last frame. objects are matched by position, a different
+	// number of objects redraws everything
+	GRedraw update(int width, int height, const GStateKey& global, const std::vector<GDamageObject>& objects) {
+		GRedraw redraw = GRedraw::none;
+		dirty.clear();
+
+		if(invalid || width != last_width || height != last_height ||
+			global != last_global || objects.size() != last_objects.size()) {
+			redraw = GRedraw::full;
+		} else {
+			for(std::size_t i = 0; i < objects.size(); i++) {
+				if(objects[i].key == last_objects[i].key)
+					continue;
+
+				add_dirty(last_objects[i].rect);
+				add_dirty(objects[i].rect);
+			}
+
+			if(!dirty.empty())
+				redraw = dirty_area() > full_fraction * width * height ? GRedraw::full : GRedraw::partial;
+		}
+
+		if(redraw == GRedraw::full)
+			dirty.assign(1, GRect{ 0, 0, width - 1, height - 1 });
+
+		last_width = width;
+		last_height = height;
+		last_global = global;
+		last_objects = objects;
+		invalid = false;
+
+		switch(redraw) {
+		case GRedraw::none: frames_reused++; break;
+		case GRedraw::partial: frames_partial++; break;
+		case GRedraw::full: frames_full++; break;
+		}
+
+		return redraw;
+	}
+
+	// the next update redraws everything
+	void invalidate() {
+		invalid = true;
+	}
+
+	int dirty_area() const {
+		int area = 0;
+		for(const GRect& r : dirty)
+			area += r.area();
+		return area;
+	}
+
+	// rectangles to redraw, they do not overlap
+	std::vector<GRect> dirty;
+
+	// redraw everything when more than this fraction of the target is dirty
+	float full_fraction = 0.5f;
+
+	std::size_t frames_reused = 0;
+	std::size_t frames_partial = 0;
+	std::size_t frames_full = 0;
+
+private:
+	// merge with every rectangle it overlaps, until none overlap
+	void add_dirty(GRect r) {
+		if(r.empty())
+			return;
+
+		for(std::size_t i = 0; i < dirty.size(); ) {
+			if(dirty[i].overlaps(r)) {
+				r = r.merge(dirty[i]);
+				dirty.erase(dirty.begin() + i);
+				i = 0;
+			} else {
+				i++;
+			}
+		}
+
+		dirty.push_back(r);
+	}
+
+	bool invalid = true;
+	int last_width = 0;
+	int last_height = 0;
+	GStateKey last_global;
+	std::vector<GDamageObject> last_objects;
+};
+
+}
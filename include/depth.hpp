@@ -0,0 +1,214 @@
+// this file describes the depth buffer and its storage formats
+// the depth buffer is stored in square tiles so that a tile covers the same block of
+// pixels the rasterizer walks over. every tile carries a generation tag, clearing the
+// buffer only bumps the current generation and stale tiles are filled on first touch
+
+#pragma once
+
+#include "util.hpp"
+
+namespace demo {
+
+// a depth format turns the interpolated depth of a fragment into a stored value.
+// z is the post projection depth in [0, 1], inv_w is 1/w of the fragment.
+// closer(a, b) is true if a is in front of b
+
+// view space distance as a float, the original format
+struct GDepthLinearF32 {
+	typedef float value_type;
+
+	static value_type clear_value() { return INFINITY; }
+	static value_type encode(float /*z*/, float inv_w) { return 1 / inv_w; }
+	static bool closer(value_type a, value_type b) { return a < b; }
+};
+
+// 1/w as a float. this is reversed z with an infinite far plane, the float exponent
+// spends its precision far away from the camera where 1/w is small
+struct GDepthReversedF32 {
+	typedef float value_type;
+
+	static value_type clear_value() { return 0; }
+	static value_type encode(float /*z*/, float inv_w) { return inv_w; }
+	static bool closer(value_type a, value_type b) { return a > b; }
+};
+
+// fixed point z, half the bandwidth of the float formats
+struct GDepthUnorm16 {
+	typedef std::uint16_t value_type;
+
+	static value_type clear_value() { return 0xffff; }
+	static value_type encode(float z, float /*inv_w*/) {
+		return (value_type)(clamp(z, 0.0f, 1.0f) * 65535.0f + 0.5f);
+	}
+	static bool closer(value_type a, value_type b) { return a < b; }
+};
+
+// fixed point z in the low 24 bits of a 32 bit word
+struct GDepthUnorm24 {
+	typedef std::uint32_t value_type;
+
+	static value_type clear_value() { return 0xffffff; }
+	static value_type encode(float z, float /*inv_w*/) {
+		return (value_type)(clamp(z, 0.0f, 1.0f) * 16777215.0f + 0.5f);
+	}
+	static bool closer(value_type a, value_type b) { return a < b; }
+};
+
+// depth comparison used by the rasterizer. equal is for shading after a depth
+// prepass, where only the fragment that won the prepass may pass
+enum class GDepthFunc {
+	less,
+	less_equal,
+	equal,
+	always
+};
+
+template <class Format>
+class GDepthBuffer {
+public:
+	typedef Format FormatType;
+	typedef typename Format::value_type value_type;
+
+	static constexpr int tile_size = 8;
+	static constexpr int tile_pixels = tile_size * tile_size;
+
+	GDepthBuffer() { }
+	GDepthBuffer(int w, int h) { resize(w, h); }
+
+	void resize(int w, int h) {
+		width = w;
+		height = h;
+		tiles_x = (w + tile_size - 1) / tile_size;
+		tiles_y = (h + tile_size - 1) / tile_size;
+
+		data.assign(tiles_x * tiles_y * tile_pixels, Format::clear_value());
+		tile_generation.assign(tiles_x * tiles_y, 0);
+		generation = 1;
+	}
+
+	// O(1), tiles are cleared lazily when they are next touched
+	void clear() {
+		if(++generation == 0) {
+			// tags wrapped around, every tag could look current
+			std::fill(tile_generation.begin(), tile_generation.end(), 0);
+			generation = 1;
+		}
+	}
+
+	// clear part of the buffer. tiles completely inside the rectangle are cleared
+	// lazily, the others pixel by pixel
+	void clear(const GRect& r) {
+		GRect rect = r.intersect(GRect{ 0, 0, width - 1, height - 1 });
+		if(rect.empty())
+			return;
+
+		for(int ty = rect.y0 / tile_size; ty <= rect.y1 / tile_size; ty++) {
+			for(int tx = rect.x0 / tile_size; tx <= rect.x1 / tile_size; tx++) {
+				GRect t{ tx * tile_size, ty * tile_size, tx * tile_size + tile_size - 1, ty * tile_size + tile_size - 1 };
+				GRect c = t.intersect(rect);
+
+				if(c.area() == tile_pixels) {
+					tile_generation[ty * tiles_x + tx] = 0;
+					continue;
+				}
+
+				value_type* p = tile(tx, ty);
+				for(int y = c.y0; y <= c.y1; y++)
+					for(int x = c.x0; x <= c.x1; x++)
+						p[tile_offset(x, y)] = Format::clear_value();
+			}
+		}
+	}
+
+	// pointer to the tile's pixels, row major inside the tile.
+	// clears the tile if it was not written since the last clear
+	value_type* tile(int tx, int ty) {
+		int t = ty * tiles_x + tx;
+		value_type* p = &data[t * tile_pixels];
+
+		if(tile_generation[t] != generation) {
+			std::fill(p, p + tile_pixels, Format::clear_value());
+			tile_generation[t] = generation;
+		}
+
+		return p;
+	}
+
+	static int tile_offset(int x, int y) {
+		return (y % tile_size) * tile_size + (x % tile_size);
+	}
+
+	// depth test against a stored value, writes the new value if it passes
+	static bool test_set(value_type& stored, float z, float inv_w) {
+		value_type d = Format::encode(z, inv_w);
+
+		if(Format::closer(d, stored)) {
+			stored = d;
+			return true;
+		}
+
+		return false;
+	}
+
+	// depth test with an explicit comparison, writes only if asked to
+	static bool test(value_type& stored, float z, float inv_w, GDepthFunc func, bool write) {
+		value_type d = Format::encode(z, inv_w);
+		bool pass = compare(d, stored, func);
+
+		if(pass && write)
+			stored = d;
+
+		return pass;
+	}
+
+	// whether an encoded depth passes against a stored one
+	static bool compare(value_type d, value_type stored, GDepthFunc func) {
+		switch(func) {
+		case GDepthFunc::less: return Format::closer(d, stored);
+		case GDepthFunc::less_equal: return !Format::closer(stored, d);
+		case GDepthFunc::equal: return d == stored;
+		default: return true;
+		}
+	}
+
+	bool test_set(int x, int y, float z, float inv_w) {
+		if(x < 0 || y < 0 || x >= width || y >= height)
+			return false;
+
+		value_type* t = tile(x / tile_size, y / tile_size);
+		return test_set(t[tile_offset(x, y)], z, inv_w);
+	}
+
+	// read without touching the tile
+	value_type get(int x, int y) const {
+		int t = (y / tile_size) * tiles_x + (x / tile_size);
+
+		if(tile_generation[t] != generation)
+			return Format::clear_value();
+
+		return data[t * tile_pixels + tile_offset(x, y)];
+	}
+
+	std::size_t size_in_bytes() const {
+		return data.size() * sizeof(value_type);
+	}
+
+	int width = 0;
+	int height = 0;
+	int tiles_x = 0;
+	int tiles_y = 0;
+
+private:
+	std::vector<value_type> data;
+	std::vector<std::uint32_t> tile_generation;
+	std::uint32_t generation = 1;
+};
+
+// depth format used by windows, pick another one with -DDEMO_DEPTH_FORMAT=...
+#ifndef DEMO_DEPTH_FORMAT
+#define DEMO_DEPTH_FORMAT GDepthLinearF32
+#endif
+
+typedef GDepthBuffer<DEMO_DEPTH_FORMAT> GWindowDepthBuffer;
+
+}
@@ -0,0 +1,155 @@
+// this file describes approximate math for shaders
+// reciprocals and inverse square roots start from an estimate and are refined
+// with newton steps. log2 and exp2 split a float into exponent and mantissa and
+// approximate the mantissa part with a polynomial, pow is built from the two.
+// they do not branch, so loops over them vectorize. specular highlights can
+// also be looked up in a table per shininess. shaders pick GExactMath or
+// GFastMath at compile time, both have the same functions
+
+#pragma once
+
+#include "util.hpp"
+#include "simd.hpp"
+
+namespace demo {
+
+static inline std::uint32_t float_bits(float f) {
+	std::uint32_t b;
+	std::memcpy(&b, &f, sizeof(b));
+	return b;
+}
+
+static inline float bits_float(std::uint32_t b) {
+	float f;
+	std::memcpy(&f, &b, sizeof(f));
+	return f;
+}
+
+// 1 / x for finite nonzero x, relative error below 3e-7. the estimate is the
+// hardware's where there is one, otherwise the exponent negated by integer
+// subtraction, which is within 12% of the result. each newton step squares the
+// error. shaders call these one value at a time, the f32x4 rcp and rsqrt do four
+static inline float fast_rcp(float x) {
+#ifdef DEMO_SIMD_SSE
+	float r = _mm_cvtss_f32(_mm_rcp_ss(_mm_set_ss(x)));
+#else
+	float r = bits_float(0x7ef311c3 - float_bits(x));
+	r = r * (2 - x * r);
+	r = r * (2 - x * r);
+#endif
+	return r * (2 - x * r);
+}
+
+// 1 / sqrt(x) for finite x above 0, relative error below 5e-6
+static inline float fast_rsqrt(float x) {
+#ifdef DEMO_SIMD_SSE
+	float r = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+#else
+	float r = bits_float(0x5f375a86 - (float_bits(x) >> 1));
+	r = r * (1.5f - 0.5f * x * r * r);
+#endif
+	return r * (1.5f - 0.5f * x * r * r);
+}
+
+// log2 of finite x above 0, absolute error below 1e-5
+static inline float fast_log2(float x) {
+	std::uint32_t b = float_bits(x);
+	float e = (float)((int)(b >> 23) - 127);
+	float m = bits_float((b & 0x007fffff) | 0x3f800000); // [1, 2)
+
+	// log2(m) = p(m) * (m - 1)
+	float p = -3.4436006e-2f;
+	p = p * m + 3.1821337e-1f;
+	p = p * m - 1.2315303f;
+	p = p * m + 2.5988452f;
+	p = p * m - 3.3241990f;
+	p = p * m + 3.1157899f;
+
+	return e + p * (m - 1);
+}
+
+// 2^x, relative error below 1e-6. x is clamped to the normal float range
+static inline float fast_exp2(float x) {
+	x = std::min(std::max(x, -126.0f), 127.99f);
+
+	// truncating a positive number floors it, without a call to floor
+	int i = (int)(x + 127) - 127;
+	float f = x - i; // [0, 1)
+
+	float p = 1.8775767e-3f;
+	p = p * f + 8.9893397e-3f;
+	p = p * f + 5.5826318e-2f;
+	p = p * f + 2.4015361e-1f;
+	p = p * f + 6.9315308e-1f;
+	p = p * f + 9.9999994e-1f;
+
+	return bits_float((std::uint32_t)(i + 127) << 23) * p;
+}
+
+// x^y for x >= 0 as 2^(y * log2(x)). the log's error is scaled by y, so the
+// relative error is below 7e-6 * |y| + 1e-6. x = 0 gives a denormal-sized value
+// for y > 0
+static inline float fast_pow(float x, float y) {
+	return fast_exp2(y * fast_log2(std::max(x, 1e-38f)));
+}
+
+// pow(x, shininess) for x in [0, 1], interpolated between evenly spaced entries.
+// the error is largest where the curve bends the most, near 1, and stays below
+// shininess^2 / (8 * (size - 1)^2)
+class GSpecularTable {
+public:
+	GSpecularTable(float s = 1, int size = 1024) :
+		shininess(s),
+		scale((float)(size - 1)),
+		table(size + 1) {
+		for(int i = 0; i < size; i++)
+			table[i] = std::pow(i / scale, shininess);
+
+		// lets x = 1 interpolate without a bounds check
+		table[size] = table[size - 1];
+	}
+
+	float operator()(float x) const {
+		float f = std::min(std::max(x, 0.0f), 1.0f) * scale;
+		int i = (int)f;
+		return table[i] + (table[i + 1] - table[i]) * (f - i);
+	}
+
+	float shininess;
+
+private:
+	float scale;
+	std::vector<float> table;
+};
+
+// glm and the standard library, what the approximations are measured against
+struct GExactMath {
+	static float rcp(float x) { return 1 / x; }
+	static float rsqrt(float x) { return 1 / std::sqrt(x); }
+	static float pow(float x, float y) { return std::pow(x, y); }
+
+	static vec3 normalize(const vec3& v) { return glm::normalize(v); }
+
+	static float specular(const GSpecularTable& table, float n_dot_h) {
+		return std::pow(n_dot_h, table.shininess);
+	}
+};
+
+struct GFastMath {
+	static float rcp(float x) { return fast_rcp(x); }
+	static float rsqrt(float x) { return fast_rsqrt(x); }
+	static float pow(float x, float y) { return fast_pow(x, y); }
+
+	static vec3 normalize(const vec3& v) { return v * fast_rsqrt(dot(v, v)); }
+
+	static float specular(const GSpecularTable& table, float n_dot_h) {
+		return table(n_dot_h);
+	}
+};
+
+}
+
+// math used by the demo's shaders, pick another one with -DDEMO_SHADER_MATH=...
+#ifndef DEMO_SHADER_MATH
+#define DEMO_SHADER_MATH GFastMath
+#endif
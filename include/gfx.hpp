@@ -2,8 +2,30 @@
 
 #include "util.hpp"
 #include "window.hpp"
+#include "depth.hpp"
 #include "context.hpp"
 #include "pipeline.hpp"
 #include "scene.hpp"
 #include "texture.hpp"
-#include "obj.hpp"
\ No newline at end of file
+#include "obj.hpp"
+#include "lod.hpp"
+#include "simd.hpp"
+#include "target.hpp"
+#include "shadow.hpp"
+#include "lights.hpp"
+#include "damage.hpp"
+#include "simulation.hpp"
+#include "packed.hpp"
+#include "optimize.hpp"
+#include "capture.hpp"
+#include "compressed.hpp"
+#include "stream.hpp"
+#include "split.hpp"
+#include "server.hpp"
+#include "occlusion.hpp"
+#include "parallel.hpp"
+#include "skin.hpp"
+#include "post.hpp"
+#include "msaa.hpp"
+#include "fastmath.hpp"
+#include "rate.hpp"
\ No newline at end of file
@@ -0,0 +1,147 @@
+// this file describes point lights and the screen space light grid
+// every frame the lights are binned into screen tiles by the screen rectangle their
+// sphere of influence covers. shaders look up the tile a vertex or fragment lands in
+// and only evaluate the lights listed there
+
+#pragma once
+
+#include "util.hpp"
+
+namespace demo {
+
+struct GPointLight {
+	vec3 pos;
+	float radius;
+	vec3 color;
+};
+
+class GLightGrid {
+public:
+	static constexpr int tile_size = 32;
+
+	// bin world space lights for a view. with tiled = false every light goes into a
+	// single tile, which is the brute force baseline
+	void build(const std::vector<GPointLight>& lights, const mat4x4& view, const mat4x4& projection,
+		int w, int h, float near, bool tiled = true) {
+		width = w;
+		height = h;
+		tiles_x = tiled ? (w + tile_size - 1) / tile_size : 1;
+		tiles_y = tiled ? (h + tile_size - 1) / tile_size : 1;
+
+		view_lights.clear();
+		rects.clear();
+
+		for(const GPointLight& l : lights) {
+			GPointLight v = l;
+			v.pos = view * vec4(l.pos, 1);
+
+			// completely behind the near plane, the view looks down -z
+			if(v.pos.z - v.radius > -near)
+				continue;
+
+			int rect[4] = { 0, 0, tiles_x - 1, tiles_y - 1 };
+
+			if(tiled && !tile_rect(v, projection, near, rect))
+				continue;
+
+			view_lights.push_back(v);
+			rects.insert(rects.end(), rect, rect + 4);
+		}
+
+		// two passes, count then fill, so every tile's list is contiguous
+		offsets.assign(tiles_x * tiles_y + 1, 0);
+
+		for_each_tile([&](int tile, std::uint32_t) { offsets[tile + 1]++; });
+
+		for(std::size_t i = 1; i < offsets.size(); i++)
+			offsets[i] += offsets[i - 1];
+
+		indices.resize(offsets.back());
+		fill.assign(offsets.begin(), offsets.end() - 1);
+
+		for_each_tile([&](int tile, std::uint32_t light) { indices[fill[tile]++] = light; });
+	}
+
+	// indices into view_lights of the lights touching the tile that contains the
+	// screen position, positions off screen use the nearest tile
+	std::pair<const std::uint32_t*, const std::uint32_t*> lights_at(float x, float y) const {
+		int tx = 0, ty = 0;
+
+		if(tiles_x > 1 || tiles_y > 1) {
+			tx = clamp((int)x / tile_size, 0, tiles_x - 1);
+			ty = clamp((int)y / tile_size, 0, tiles_y - 1);
+		}
+
+		int tile = ty * tiles_x + tx;
+		return { indices.data() + offsets[tile], indices.data() + offsets[tile + 1] };
+	}
+
+	// average number of lights per tile
+	float average_lights() const {
+		return (float)indices.size() / std::max(1, tiles_x * tiles_y);
+	}
+
+	// lights that survived culling, in view space
+	std::vector<GPointLight> view_lights;
+
+	int width = 0;
+	int height = 0;
+	int tiles_x = 0;
+	int tiles_y = 0;
+
+private:
+	template <typename F>
+	void for_each_tile(F f) {
+		for(std::size_t i = 0; i < view_lights.size(); i++) {
+			const int* r = &rects[i * 4];
+
+			for(int ty = r[1]; ty <= r[3]; ty++)
+				for(int tx = r[0]; tx <= r[2]; tx++)
+					f(ty * tiles_x + tx, (std::uint32_t)i);
+		}
+	}
+
+	// tile range covered by the projected bounding box of the light's sphere.
+	// false if it misses the screen
+	bool tile_rect(const GPointLight& l, const mat4x4& projection, float near, int* rect) const {
+		vec2 lo(INFINITY), hi(-INFINITY);
+
+		for(int i = 0; i < 8; i++) {
+			vec3 corner = l.pos + vec3(
+				(i & 1) ? l.radius : -l.radius,
+				(i & 2) ? l.radius : -l.radius,
+				(i & 4) ? l.radius : -l.radius);
+
+			// the box crosses the near plane, assume it covers the whole screen
+			if(corner.z > -near)
+				return true;
+
+			vec4 clip = projection * vec4(corner, 1);
+			vec2 ndc = vec2(clip) / clip.w;
+
+			lo = glm::min(lo, ndc);
+			hi = glm::max(hi, ndc);
+		}
+
+		if(lo.x > 1 || lo.y > 1 || hi.x < -1 || hi.y < -1)
+			return false;
+
+		// ndc y points up, screen y points down
+		float x0 = (lo.x + 1) * 0.5f * width, x1 = (hi.x + 1) * 0.5f * width,
+			y0 = (-hi.y + 1) * 0.5f * height, y1 = (-lo.y + 1) * 0.5f * height;
+
+		rect[0] = clamp((int)x0 / tile_size, 0, tiles_x - 1);
+		rect[1] = clamp((int)y0 / tile_size, 0, tiles_y - 1);
+		rect[2] = clamp((int)x1 / tile_size, 0, tiles_x - 1);
+		rect[3] = clamp((int)y1 / tile_size, 0, tiles_y - 1);
+
+		return true;
+	}
+
+	std::vector<int> rects;
+	std::vector<std::uint32_t> offsets;
+	std::vector<std::uint32_t> fill;
+	std::vector<std::uint32_t> indices;
+};
+
+}
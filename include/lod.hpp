@@ -0,0 +1,497 @@
+// this file describes mesh simplification and level of detail chains
+// meshes are simplified with quadric error metric edge collapses (garland/heckbert).
+// a lod chain holds progressively coarser meshes and picks one from the projected
+// screen size of the mesh
+
+#pragma once
+
+#include "util.hpp"
+#include "optimize.hpp"
+
+namespace demo {
+
+// GQuadric and GSimplifier are adapted from Fast-Quadric-Mesh-Simplification
+// (https://github.com/sp4cerat/Fast-Quadric-Mesh-Simplification), under its license:
+//
+// MIT License
+//
+// Copyright (c) 2014 Sven Forstmann
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// symmetric 4x4 matrix, stored as the upper triangle
+//  0 1 2 3
+//    4 5 6
+//      7 8
+//        9
+struct GQuadric {
+	double m[10] = { 0 };
+
+	GQuadric() { }
+
+	// quadric of the plane ax + by + cz + d = 0
+	GQuadric(double a, double b, double c, double d) {
+		m[0] = a * a; m[1] = a * b; m[2] = a * c; m[3] = a * d;
+		m[4] = b * b; m[5] = b * c; m[6] = b * d;
+		m[7] = c * c; m[8] = c * d;
+		m[9] = d * d;
+	}
+
+	GQuadric operator+(const GQuadric& q) const {
+		GQuadric r;
+		for(int i = 0; i < 10; i++)
+			r.m[i] = m[i] + q.m[i];
+		return r;
+	}
+
+	GQuadric& operator+=(const GQuadric& q) {
+		for(int i = 0; i < 10; i++)
+			m[i] += q.m[i];
+		return *this;
+	}
+
+	double det(int a11, int a12, int a13,
+		int a21, int a22, int a23,
+		int a31, int a32, int a33) const {
+		return m[a11] * m[a22] * m[a33] + m[a13] * m[a21] * m[a32] + m[a12] * m[a23] * m[a31]
+			- m[a13] * m[a22] * m[a31] - m[a11] * m[a23] * m[a32] - m[a12] * m[a21] * m[a33];
+	}
+
+	// squared distance sum of point to all accumulated planes
+	double error(const vec3& p) const {
+		double x = p.x, y = p.y, z = p.z;
+		return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x
+			+ m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y
+			+ m[7] * z * z + 2 * m[8] * z + m[9];
+	}
+};
+
+// simplifies a mesh down to roughly target_triangles
+// vertices are welded by position first so that attribute seams do not turn into
+// borders. the attributes of a collapsed vertex are lerped along the collapsed edge
+template <typename T>
+class GSimplifier {
+public:
+	GSimplifier(const GMesh<T>& mesh) {
+		std::map<std::tuple<float, float, float>, int> welded;
+		std::vector<int> remap(mesh.vertices.size());
+
+		for(std::size_t i = 0; i < mesh.vertices.size(); i++) {
+			const T& v = mesh.vertices[i];
+			auto key = std::make_tuple(v.pos.x, v.pos.y, v.pos.z);
+			auto it = welded.find(key);
+
+			if(it == welded.end()) {
+				it = welded.emplace(key, (int)vertices.size()).first;
+
+				Vertex sv;
+				sv.p = vec3(v.pos);
+				sv.attr = v;
+				vertices.push_back(sv);
+			}
+
+			remap[i] = it->second;
+		}
+
+		for(std::size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+			Triangle t;
+			for(int j = 0; j < 3; j++)
+				t.v[j] = remap[mesh.indices[i + j]];
+
+			// welding can produce degenerate triangles
+			if(t.v[0] == t.v[1] || t.v[1] == t.v[2] || t.v[2] == t.v[0])
+				continue;
+
+			triangles.push_back(t);
+		}
+	}
+
+	GMesh<T> simplify(std::size_t target_triangles, double aggressiveness = 7) {
+		std::size_t deleted_triangles = 0;
+		std::size_t triangle_count = triangles.size();
+		std::vector<int> deleted0, deleted1;
+
+		for(int iteration = 0; iteration < 100; iteration++) {
+			if(triangle_count - deleted_triangles <= target_triangles)
+				break;
+
+			// compact and rebuild references every few passes
+			if(iteration % 5 == 0)
+				update_mesh(iteration);
+
+			for(auto& t : triangles)
+				t.dirty = false;
+
+			// edges with an error below the threshold are collapsed. the threshold
+			// grows every pass so cheap collapses happen first
+			double threshold = 0.000000001 * std::pow(double(iteration + 3), aggressiveness);
+
+			for(std::size_t i = 0; i < triangles.size(); i++) {
+				Triangle& t = triangles[i];
+
+				if(t.err[3] > threshold || t.deleted || t.dirty)
+					continue;
+
+				for(int j = 0; j < 3; j++) {
+					if(t.err[j] >= threshold)
+						continue;
+
+					int i0 = t.v[j], i1 = t.v[(j + 1) % 3];
+					Vertex &v0 = vertices[i0], &v1 = vertices[i1];
+
+					if(v0.border != v1.border)
+						continue;
+
+					vec3 p;
+					calculate_error(i0, i1, p);
+
+					deleted0.assign(v0.tcount, 0);
+					deleted1.assign(v1.tcount, 0);
+
+					// do not collapse if a neighbouring triangle would flip
+					if(flipped(p, i1, v0, deleted0) || flipped(p, i0, v1, deleted1))
+						continue;
+
+					// move v0 to the collapse point, v1 becomes unreferenced
+					vec3 e = v1.p - v0.p;
+					float len2 = dot(e, e);
+					float alpha = len2 > 0 ? clamp(dot(p - v0.p, e) / len2, 0.0f, 1.0f) : 0.0f;
+
+					v0.attr.lerp(v0.attr, v1.attr, alpha);
+					v0.p = p;
+					v0.q = v1.q + v0.q;
+
+					int tstart = refs.size();
+
+					update_triangles(i0, v0, deleted0, deleted_triangles);
+					update_triangles(i0, v1, deleted1, deleted_triangles);
+
+					int tcount = refs.size() - tstart;
+
+					if(tcount <= v0.tcount) {
+						// reuse the old reference slots
+						if(tcount)
+							std::copy(refs.begin() + tstart, refs.begin() + tstart + tcount, refs.begin() + v0.tstart);
+					} else {
+						v0.tstart = tstart;
+					}
+
+					v0.tcount = tcount;
+					break;
+				}
+
+				if(triangle_count - deleted_triangles <= target_triangles)
+					break;
+			}
+		}
+
+		return compact_mesh();
+	}
+
+private:
+	struct Triangle {
+		int v[3];
+		double err[4];
+		bool deleted = false, dirty = false;
+		vec3 n;
+	};
+
+	struct Vertex {
+		vec3 p;
+		T attr;
+		int tstart = 0, tcount = 0;
+		GQuadric q;
+		bool border = false;
+	};
+
+	struct Ref {
+		int tid, tvertex;
+	};
+
+	// error of collapsing the edge v1-v2, writes the optimal point to p
+	double calculate_error(int id_v1, int id_v2, vec3& p) {
+		GQuadric q = vertices[id_v1].q + vertices[id_v2].q;
+		bool border = vertices[id_v1].border && vertices[id_v2].border;
+		double det = q.det(0, 1, 2, 1, 4, 5, 2, 5, 7);
+
+		if(det != 0 && !border) {
+			p.x = -1 / det * q.det(1, 2, 3, 4, 5, 6, 5, 7, 8);
+			p.y = 1 / det * q.det(0, 2, 3, 1, 5, 6, 2, 7, 8);
+			p.z = -1 / det * q.det(0, 1, 3, 1, 4, 6, 2, 5, 8);
+			return q.error(p);
+		}
+
+		// singular quadric, pick the best of both ends and the midpoint
+		vec3 p1 = vertices[id_v1].p, p2 = vertices[id_v2].p, p3 = (p1 + p2) * 0.5f;
+		double e1 = q.error(p1), e2 = q.error(p2), e3 = q.error(p3);
+		double e = std::min(e1, std::min(e2, e3));
+
+		if(e == e1) p = p1;
+		else if(e == e2) p = p2;
+		else p = p3;
+
+		return e;
+	}
+
+	// true if moving the vertex to p flips one of its triangles
+	bool flipped(const vec3& p, int i1, const Vertex& v0, std::vector<int>& deleted) {
+		for(int k = 0; k < v0.tcount; k++) {
+			const Ref& r = refs[v0.tstart + k];
+			const Triangle& t = triangles[r.tid];
+
+			if(t.deleted)
+				continue;
+
+			int id1 = t.v[(r.tvertex + 1) % 3], id2 = t.v[(r.tvertex + 2) % 3];
+
+			// triangle shares the collapsed edge and will be removed
+			if(id1 == i1 || id2 == i1) {
+				deleted[k] = 1;
+				continue;
+			}
+
+			vec3 d1 = normalize(vertices[id1].p - p), d2 = normalize(vertices[id2].p - p);
+
+			if(std::fabs(dot(d1, d2)) > 0.999f)
+				return true;
+
+			vec3 n = normalize(cross(d1, d2));
+			deleted[k] = 0;
+
+			if(dot(n, t.n) < 0.2f)
+				return true;
+		}
+
+		return false;
+	}
+
+	void update_triangles(int i0, const Vertex& v, const std::vector<int>& deleted, std::size_t& deleted_triangles) {
+		for(int k = 0; k < v.tcount; k++) {
+			Ref r = refs[v.tstart + k];
+			Triangle& t = triangles[r.tid];
+
+			if(t.deleted)
+				continue;
+
+			if(deleted[k]) {
+				t.deleted = true;
+				deleted_triangles++;
+				continue;
+			}
+
+			vec3 p;
+			t.v[r.tvertex] = i0;
+			t.dirty = true;
+			t.err[0] = calculate_error(t.v[0], t.v[1], p);
+			t.err[1] = calculate_error(t.v[1], t.v[2], p);
+			t.err[2] = calculate_error(t.v[2], t.v[0], p);
+			t.err[3] = std::min(t.err[0], std::min(t.err[1], t.err[2]));
+
+			refs.push_back(r);
+		}
+	}
+
+	void update_mesh(int iteration) {
+		if(iteration > 0) {
+			triangles.erase(std::remove_if(triangles.begin(), triangles.end(),
+				[](const Triangle& t) { return t.deleted; }), triangles.end());
+		}
+
+		// vertex -> triangle references
+		for(auto& v : vertices) {
+			v.tstart = 0;
+			v.tcount = 0;
+		}
+
+		for(const auto& t : triangles)
+			for(int j = 0; j < 3; j++)
+				vertices[t.v[j]].tcount++;
+
+		int tstart = 0;
+		for(auto& v : vertices) {
+			v.tstart = tstart;
+			tstart += v.tcount;
+			v.tcount = 0;
+		}
+
+		refs.resize(triangles.size() * 3);
+		for(std::size_t i = 0; i < triangles.size(); i++) {
+			const Triangle& t = triangles[i];
+			for(int j = 0; j < 3; j++) {
+				Vertex& v = vertices[t.v[j]];
+				refs[v.tstart + v.tcount] = Ref{ (int)i, j };
+				v.tcount++;
+			}
+		}
+
+		if(iteration != 0)
+			return;
+
+		// border vertices have an edge that is used by only one triangle
+		std::vector<int> vcount, vids;
+
+		for(auto& v : vertices)
+			v.border = false;
+
+		for(auto& v : vertices) {
+			vcount.clear();
+			vids.clear();
+
+			for(int j = 0; j < v.tcount; j++) {
+				const Triangle& t = triangles[refs[v.tstart + j].tid];
+
+				for(int k = 0; k < 3; k++) {
+					int ofs = 0, id = t.v[k];
+					while(ofs < (int)vcount.size() && vids[ofs] != id)
+						ofs++;
+
+					if(ofs == (int)vcount.size()) {
+						vcount.push_back(1);
+						vids.push_back(id);
+					} else {
+						vcount[ofs]++;
+					}
+				}
+			}
+
+			for(std::size_t j = 0; j < vcount.size(); j++) {
+				if(vcount[j] == 1)
+					vertices[vids[j]].border = true;
+			}
+		}
+
+		// initial quadrics and edge errors
+		for(auto& t : triangles) {
+			vec3 p0 = vertices[t.v[0]].p, p1 = vertices[t.v[1]].p, p2 = vertices[t.v[2]].p;
+			vec3 n = cross(p1 - p0, p2 - p0);
+			float len = length(n);
+			n = len > 0 ? n / len : vec3(0);
+			t.n = n;
+
+			for(int j = 0; j < 3; j++)
+				vertices[t.v[j]].q += GQuadric(n.x, n.y, n.z, -dot(n, p0));
+		}
+
+		for(auto& t : triangles) {
+			vec3 p;
+			for(int j = 0; j < 3; j++)
+				t.err[j] = calculate_error(t.v[j], t.v[(j + 1) % 3], p);
+			t.err[3] = std::min(t.err[0], std::min(t.err[1], t.err[2]));
+		}
+	}
+
+	GMesh<T> compact_mesh() {
+		std::vector<int> remap(vertices.size(), -1);
+		std::vector<T> out_vertices;
+		std::vector<std::size_t> out_indices;
+
+		for(const auto& t : triangles) {
+			if(t.deleted)
+				continue;
+
+			for(int j = 0; j < 3; j++) {
+				int id = t.v[j];
+
+				if(remap[id] == -1) {
+					remap[id] = out_vertices.size();
+
+					T v = vertices[id].attr;
+					v.pos = vec4(vertices[id].p, 1);
+					out_vertices.push_back(v);
+				}
+
+				out_indices.push_back(remap[id]);
+			}
+		}
+
+		return GMesh<T>(out_vertices, out_indices);
+	}
+
+	std::vector<Triangle> triangles;
+	std::vector<Vertex> vertices;
+	std::vector<Ref> refs;
+};
+
+// progressively coarser versions of a mesh, levels[0] is the full mesh
+template <typename T>
+struct GLodChain {
+	GLodChain() { }
+
+	// each level keeps `ratio` of the triangles of the previous one
+	GLodChain(const GMesh<T>& mesh, int level_count, float ratio = 0.5f) {
+		levels.push_back(mesh);
+
+		std::size_t triangles = mesh.indices.size() / 3;
+
+		for(int i = 1; i < level_count; i++) {
+			triangles = triangles * ratio;
+
+			// not worth simplifying further
+			if(triangles < 64)
+				break;
+
+			// simplify the previous level, it is smaller and already close
+			GSimplifier<T> simplifier(levels.back());
+			levels.push_back(simplifier.simplify(triangles));
+			optimize_mesh(levels.back());
+		}
+	}
+
+	std::size_t triangle_count(std::size_t level) const {
+		return levels[level].indices.size() / 3;
+	}
+
+	// finest level that stays under the triangle budget for the covered area
+	std::size_t pick(float budget) const {
+		for(std::size_t i = 0; i < levels.size(); i++) {
+			if(triangle_count(i) <= budget)
+				return i;
+		}
+
+		return levels.size() - 1;
+	}
+
+	// choose a level from the projected radius of the mesh in pixels.
+	// switching away from the current level needs the budget to change by
+	// more than `hysteresis`, so meshes near a threshold do not flicker
+	std::size_t select(float screen_radius, std::size_t current) const {
+		float area = M_PI * screen_radius * screen_radius;
+		float budget = area / pixels_per_triangle;
+		std::size_t level = pick(budget);
+
+		if(current >= levels.size())
+			return level;
+
+		if(level < current && pick(budget * (1 - hysteresis)) >= current)
+			return current;
+
+		if(level > current && pick(budget * (1 + hysteresis)) <= current)
+			return current;
+
+		return level;
+	}
+
+	std::vector<GMesh<T>> levels;
+
+	// target screen area of a single triangle
+	float pixels_per_triangle = 4.0f;
+	float hysteresis = 0.25f;
+};
+
+}
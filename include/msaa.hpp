@@ -0,0 +1,173 @@
+// this file describes the sample storage of multisampled render targets
+// a pixel has 4 samples on a rotated grid. pixels whose samples all belong to one
+// fragment, which is every pixel inside a triangle, stay in the target's ordinary
+// color and depth buffers. only pixels on an edge get a record: up to 4 fragment
+// colors, a 2 bit fragment index per sample and a depth per sample. records are
+// resolved into the color buffer whenever they change, so there is no resolve
+// pass and memory grows with the length of the edges, not with the pixel count
+
+#pragma once
+
+#include "util.hpp"
+#include "depth.hpp"
+
+namespace demo {
+
+// sample positions relative to the pixel center
+static constexpr int msaa_samples = 4;
+static constexpr float msaa_offsets[msaa_samples][2] = {
+	{ -0.125f, -0.375f }, { 0.375f, -0.125f }, { -0.375f, 0.125f }, { 0.125f, 0.375f }
+};
+
+// how far samples reach past the pixel center
+static constexpr float msaa_reach = 0.375f;
+
+template <class Format>
+class GSampleStore {
+public:
+	typedef typename Format::value_type value_type;
+
+	struct GEdgePixel {
+		std::uint32_t fragments[msaa_samples]; // ARGB8888
+		value_type depth[msaa_samples];
+		std::uint8_t fmask; // fragment of sample s in bits 2s and 2s + 1
+		int pixel; // y * width + x, -1 while the record is free
+
+		int fragment(int s) const {
+			return (fmask >> (s * 2)) & 3;
+		}
+	};
+
+	void resize(int w, int h) {
+		width = w;
+		index.assign(w * h, -1);
+		records.clear();
+		free_records.clear();
+	}
+
+	// only touches the pixels that have a record
+	void clear() {
+		for(const GEdgePixel& e : records) {
+			if(e.pixel >= 0)
+				index[e.pixel] = -1;
+		}
+
+		records.clear();
+		free_records.clear();
+	}
+
+	void clear(const GRect& r) {
+		for(GEdgePixel& e : records) {
+			if(e.pixel >= 0 && r.contains(e.pixel % width, e.pixel / width))
+				release(e.pixel);
+		}
+	}
+
+	// the pixel's record, null if all its samples are one fragment
+	GEdgePixel* find(int pixel) {
+		int i = index[pixel];
+		return i < 0 ? nullptr : &records[i];
+	}
+
+	// a record whose samples all hold the pixel's current color and depth
+	GEdgePixel& split(int pixel, std::uint32_t color, value_type depth) {
+		int i;
+
+		if(free_records.empty()) {
+			i = records.size();
+			records.emplace_back();
+		} else {
+			i = free_records.back();
+			free_records.pop_back();
+		}
+
+		GEdgePixel& e = records[i];
+		for(int s = 0; s < msaa_samples; s++) {
+			e.fragments[s] = color;
+			e.depth[s] = depth;
+		}
+
+		e.fmask = 0;
+		e.pixel = pixel;
+		index[pixel] = i;
+
+		return e;
+	}
+
+	// back to a single fragment
+	void release(int pixel) {
+		int i = index[pixel];
+		if(i < 0)
+			return;
+
+		records[i].pixel = -1;
+		index[pixel] = -1;
+		free_records.push_back(i);
+	}
+
+	// samples in mask take the color, and their depth too if write is set.
+	// fragments no sample refers to anymore are reused
+	static void add_fragment(GEdgePixel& e, int mask, std::uint32_t color, const value_type* depth, bool write) {
+		int used = 0;
+		for(int s = 0; s < msaa_samples; s++) {
+			if(!(mask & (1 << s)))
+				used |= 1 << e.fragment(s);
+		}
+
+		// at most 3 samples are left outside the mask, so a slot is always free
+		int slot = 0;
+		while(used & (1 << slot))
+			slot++;
+
+		e.fragments[slot] = color;
+
+		for(int s = 0; s < msaa_samples; s++) {
+			if(!(mask & (1 << s)))
+				continue;
+
+			e.fmask = (e.fmask & ~(3 << (s * 2))) | (slot << (s * 2));
+			if(write)
+				e.depth[s] = depth[s];
+		}
+	}
+
+	// average of the samples' colors
+	static std::uint32_t resolve(const GEdgePixel& e) {
+		std::uint32_t rb = 0, ag = 0;
+
+		for(int s = 0; s < msaa_samples; s++) {
+			std::uint32_t c = e.fragments[e.fragment(s)];
+			rb += c & 0x00ff00ff;
+			ag += (c >> 8) & 0x00ff00ff;
+		}
+
+		return ((rb >> 2) & 0x00ff00ff) | (((ag >> 2) & 0x00ff00ff) << 8);
+	}
+
+	// the farthest sample, what the pixel's depth buffer entry keeps for depth only
+	// draws like occlusion queries, so they never see an edge as more solid than it is
+	static value_type farthest(const GEdgePixel& e) {
+		value_type d = e.depth[0];
+		for(int s = 1; s < msaa_samples; s++) {
+			if(Format::closer(d, e.depth[s]))
+				d = e.depth[s];
+		}
+		return d;
+	}
+
+	std::size_t edge_count() const {
+		return records.size() - free_records.size();
+	}
+
+	std::size_t size_in_bytes() const {
+		return index.size() * sizeof(int) + records.size() * sizeof(GEdgePixel);
+	}
+
+private:
+	int width = 0;
+	std::vector<int> index; // record per pixel, -1 for none
+	std::vector<GEdgePixel> records;
+	std::vector<int> free_records;
+};
+
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "util.hpp"
+#include "lod.hpp"
+#include "packed.hpp"
 
 namespace demo {
 
@@ -13,22 +15,10 @@ struct GObjVertex : public IVertex {
 	GObjVertex() { }
 	GObjVertex(vec4 p, vec2 u, vec3 n, vec3 c) : pos(p), uv(u), normal(n), color(c) { }
 
-	void berp(vec3 bary, GObjVertex v0, GObjVertex v1, GObjVertex v2, float d) {
-        pos.x = b_interpolate(bary, vec3(v0.pos.x, v1.pos.x, v2.pos.x)) * d;
-        pos.y = b_interpolate(bary, vec3(v0.pos.y, v1.pos.y, v2.pos.y)) * d;
-        pos.z = b_interpolate(bary, vec3(v0.pos.z, v1.pos.z, v2.pos.z)) * d;
-
-		uv.x = b_interpolate(bary, vec3(v0.uv.x, v1.uv.x, v2.uv.x)) * d;
-		uv.y = b_interpolate(bary, vec3(v0.uv.y, v1.uv.y, v2.uv.y)) * d;
-
-		normal.x = b_interpolate(bary, vec3(v0.normal.x, v1.normal.x, v2.normal.x)) * d;
-		normal.y = b_interpolate(bary, vec3(v0.normal.y, v1.normal.y, v2.normal.y)) * d;
-		normal.z = b_interpolate(bary, vec3(v0.normal.z, v1.normal.z, v2.normal.z)) * d;
-
-        color.x = b_interpolate(bary, vec3(v0.color.x, v1.color.x, v2.color.x)) * d;
-		color.y = b_interpolate(bary, vec3(v0.color.y, v1.color.y, v2.color.y)) * d;
-		color.z = b_interpolate(bary, vec3(v0.color.z, v1.color.z, v2.color.z)) * d;
-	}
+	// uv, normal and color
+	static constexpr int varying_count = 8;
+	float* varyings() { return &uv.x; }
+	const float* varyings() const { return &uv.x; }
 
 	void lerp(GObjVertex a, GObjVertex b, float alpha) {
 		pos = l_interpolate(a.pos, b.pos, alpha);
@@ -60,6 +50,62 @@ struct GObjVertex : public IVertex {
 	}
 };
 
+static_assert(offsetof(GObjVertex, color) + sizeof(vec3) - offsetof(GObjVertex, uv) ==
+	GObjVertex::varying_count * sizeof(float), "GObjVertex varyings must be contiguous");
+
+// storage formats of GObjVertex for GPackedMesh
+
+// the float vertex as it is, 48 bytes
+struct GObjFormatFloat {
+	typedef GObjVertex vertex_type;
+	typedef GObjVertex packed_type;
+
+	static packed_type encode(const GObjVertex& v, const GPositionQuantizer&) { return v; }
+	static GObjVertex decode(const packed_type& p, const GPositionQuantizer&) { return p; }
+};
+
+// 16 bit positions, 16 bit octahedral normal, half float uv, 8 bit color. 18 bytes
+// NormalType is std::int16_t, or std::int8_t for 16 byte vertices with coarser normals
+template <typename NormalType>
+struct GObjFormatPacked {
+	typedef GObjVertex vertex_type;
+
+	struct packed_type {
+		std::uint16_t pos[3];
+		NormalType normal[2];
+		std::uint16_t uv[2];
+		std::uint8_t color[3];
+	};
+
+	static packed_type encode(const GObjVertex& v, const GPositionQuantizer& q) {
+		packed_type p;
+		q.encode(vec3(v.pos), p.pos);
+
+		vec2 n = oct_encode(length(v.normal) > 0 ? normalize(v.normal) : vec3(0, 0, 1));
+		p.normal[0] = pack_snorm<NormalType>(n.x);
+		p.normal[1] = pack_snorm<NormalType>(n.y);
+
+		p.uv[0] = packHalf1x16(v.uv.x);
+		p.uv[1] = packHalf1x16(v.uv.y);
+
+		for(int i = 0; i < 3; i++)
+			p.color[i] = (std::uint8_t)(clamp(v.color[i], 0.0f, 1.0f) * 255 + 0.5f);
+
+		return p;
+	}
+
+	static GObjVertex decode(const packed_type& p, const GPositionQuantizer& q) {
+		return GObjVertex(
+			vec4(q.decode(p.pos), 1),
+			vec2(unpackHalf1x16(p.uv[0]), unpackHalf1x16(p.uv[1])),
+			oct_decode(vec2(unpack_snorm(p.normal[0]), unpack_snorm(p.normal[1]))),
+			vec3(p.color[0], p.color[1], p.color[2]) * (1 / 255.0f));
+	}
+};
+
+typedef GObjFormatPacked<std::int16_t> GObjFormatPacked16;
+typedef GObjFormatPacked<std::int8_t> GObjFormatPacked8;
+
 class GObj {
 public:
     GObj(std::string filename) {
@@ -118,10 +164,14 @@ public:
 
                 if(vec.size() < 3) continue;
 
+                std::vector<std::size_t> face;
+
                 for(auto v : vec) {
                     std::vector<std::string> data = split_string(v, '/');
 
-                    GObjVertex vertex(vec4(0), vec2(0), vec3(0), vec3(0));
+                    // position/uv/normal indices, -1 if not present
+                    int p_idx = -1, t_idx = -1, n_idx = -1;
+                    bool valid = false;
 
                     switch(data.size()) {
                     case 0:
@@ -133,27 +183,26 @@ public:
 
                         if(idx-- == -1) idx = positions.size() - 1;
                         
-                        vertex.pos = positions.at(idx);
+                        p_idx = idx;
+                        valid = true;
                         break;
                     }
 
                     case 2: { // vertex/uv
-                        int p_idx = std::atoi(data.at(0).c_str()),
-                            t_idx = std::atoi(data.at(1).c_str());
+                        p_idx = std::atoi(data.at(0).c_str());
+                        t_idx = std::atoi(data.at(1).c_str());
                         if(p_idx > positions.size() ||
                             t_idx > uvs.size()) break;
 
                         if(p_idx-- == -1) p_idx = positions.size() - 1;
                         if(t_idx-- == -1) t_idx = uvs.size() - 1;
                         
-                        vertex.pos = positions.at(p_idx);
-                        vertex.uv = uvs.at(t_idx);
-
+                        valid = true;
                         break;
                     }
 
                     case 3: { // vertex/uv/normal OR vertex//normal
-                        int p_idx = std::atoi(data.at(0).c_str());
+                        p_idx = std::atoi(data.at(0).c_str());
                     
                         if(p_idx-- == -1) p_idx = positions.size() - 1;
                         if(p_idx > positions.size()) {
@@ -162,19 +211,16 @@ public:
                         }
 
                         if(data.at(1).empty()) { // no uv
-                            int n_idx = std::atoi(data.at(2).c_str());
+                            n_idx = std::atoi(data.at(2).c_str());
 
                             if(n_idx-- == -1) n_idx = normals.size() - 1;
                             if(n_idx > normals.size()) {
                                 std::cout << "skip n_idx";
                                 break;
                             }
-                            
-                            vertex.pos = positions.at(p_idx);
-                            vertex.normal = normals.at(n_idx);
                         } else { // vertex/uv/normal
-                            int t_idx = std::atoi(data.at(1).c_str()),
-                                n_idx = std::atoi(data.at(2).c_str());
+                            t_idx = std::atoi(data.at(1).c_str());
+                            n_idx = std::atoi(data.at(2).c_str());
 
                             if(t_idx-- == -1) t_idx = uvs.size() - 1;
                             if(n_idx-- == -1) n_idx = normals.size() - 1;
@@ -183,33 +229,80 @@ public:
                                 std::cout << "skip t_idx n_idx";
                                 break;
                             }
-                            
-                            vertex.pos = positions.at(p_idx);
-                            vertex.uv = uvs.at(t_idx);
-                            vertex.normal = normals.at(n_idx);
                         }
 
+                        valid = true;
                         break;
                     }
                     }
-                    
-                    vertices.push_back(vertex);
-                    indices.push_back(vertices.size()-1);
+
+                    if(!valid) continue;
+
+                    face.push_back(get_vertex(p_idx, t_idx, n_idx));
+                }
+
+                // triangle fan
+                for(std::size_t i = 1; i + 1 < face.size(); i++) {
+                    indices.push_back(face[0]);
+                    indices.push_back(face[i]);
+                    indices.push_back(face[i + 1]);
                 }
             }
         }
 
-        std::cout << "loaded object. " << vertices.size() << " vertices.\n";
+        std::cout << "loaded object. " << vertices.size() << " vertices, "
+            << indices.size() / 3 << " triangles.\n";
+
+        vertex_cache.clear();
+    }
+
+    // reordered for the vertex cache and overdraw unless optimized is false
+    GMesh<GObjVertex> get_triangle_list(bool optimized = true) {
+        GMesh<GObjVertex> mesh(vertices, indices);
+
+        if(optimized)
+            optimize_mesh(mesh);
+
+        return mesh;
     }
 
-    GMesh<GObjVertex> get_triangle_list() {
-        return GMesh<GObjVertex>(vertices, indices);
+    // full mesh followed by simplified levels
+    GLodChain<GObjVertex> get_lod_chain(int level_count, float ratio = 0.5f) {
+        GLodChain<GObjVertex> chain(get_triangle_list(), level_count, ratio);
+
+        std::cout << "built " << chain.levels.size() << " levels of detail:";
+        for(std::size_t i = 0; i < chain.levels.size(); i++)
+            std::cout << " " << chain.triangle_count(i);
+        std::cout << " triangles.\n";
+
+        return chain;
     }
 
     std::vector<GObjVertex> vertices;
     std::vector<std::size_t> indices;
 
 private:
+    // face corners with the same position/uv/normal share a vertex
+    std::size_t get_vertex(int p_idx, int t_idx, int n_idx) {
+        auto key = std::make_tuple(p_idx, t_idx, n_idx);
+        auto it = vertex_cache.find(key);
+
+        if(it != vertex_cache.end())
+            return it->second;
+
+        GObjVertex vertex(vec4(0), vec2(0), vec3(0), vec3(0));
+
+        vertex.pos = positions.at(p_idx);
+        if(t_idx >= 0) vertex.uv = uvs.at(t_idx);
+        if(n_idx >= 0) vertex.normal = normals.at(n_idx);
+
+        vertices.push_back(vertex);
+        vertex_cache.emplace(key, vertices.size() - 1);
+
+        return vertices.size() - 1;
+    }
+
+    std::map<std::tuple<int, int, int>, std::size_t> vertex_cache;
     std::vector<vec4> positions;
     std::vector<vec2> uvs;
     std::vector<vec3> normals;
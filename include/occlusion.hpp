@@ -0,0 +1,83 @@
+// this file describes temporal occlusion culling
+// objects that were visible last frame are drawn first, with an occlusion query
+// each. the ones that were hidden are then tested with their bounding box
+// against the depth those draws left behind and drawn in the same frame if any of
+// the box shows, so an object coming into view never misses a frame. an object
+// whose draw passed no samples is tested by its box from the next frame on
+
+#pragma once
+
+#include "util.hpp"
+#include "pipeline.hpp"
+
+namespace demo {
+
+struct GOcclusionStats {
+	std::size_t drawn = 0;
+	std::size_t skipped = 0;
+	std::size_t revealed = 0; // hidden last frame, drawn after their box test
+
+	void reset() {
+		*this = GOcclusionStats{};
+	}
+};
+
+class GOcclusionCuller {
+public:
+	// test(i) returns the samples of object i's bounding box (GPipeline::query_bounds)
+	// and draw(i) draws the object. both run with p's state
+	template <class Context, class Test, class Draw>
+	void draw(GPipeline<Context>& p, std::size_t count, Test test, Draw draw) {
+		visible.resize(count, true);
+		drawn.assign(count, false);
+
+		GOcclusionQuery q;
+
+		for(std::size_t i = 0; i < count; i++) {
+			if(!visible[i])
+				continue;
+
+			p.begin_query(q);
+			draw(i);
+			p.end_query();
+
+			drawn[i] = true;
+			visible[i] = q.samples > 0;
+			stats.drawn++;
+		}
+
+		for(std::size_t i = 0; i < count; i++) {
+			if(drawn[i])
+				continue;
+
+			if(test(i) == 0) {
+				stats.skipped++;
+				continue;
+			}
+
+			p.begin_query(q);
+			draw(i);
+			p.end_query();
+
+			drawn[i] = true;
+			visible[i] = q.samples > 0;
+			stats.drawn++;
+			stats.revealed++;
+		}
+	}
+
+	// the next frame draws everything first
+	void reset() {
+		visible.clear();
+	}
+
+	// objects the last draw call drew, for passes that must agree with it
+	std::vector<bool> drawn;
+
+	GOcclusionStats stats;
+
+private:
+	std::vector<bool> visible;
+};
+
+}
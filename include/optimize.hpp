@@ -0,0 +1,277 @@
+// this file describes load time mesh reordering
+// triangles are reordered for the post transform vertex cache with tipsify (Sander,
+// Nehab and Barczak 2007), then clusters of them are sorted so the outward facing
+// ones draw first and occlude the rest, and vertices are renumbered in the order
+// the triangles first use them so fetches walk memory forward
+
+#pragma once
+
+#include "util.hpp"
+
+namespace demo {
+
+// average cache misses per triangle with a FIFO cache, 0.5 is the best a regular
+// grid can do and 3 means no reuse at all
+static inline float vertex_cache_acmr(const std::vector<size_t>& indices, std::size_t vertex_count, int cache_size = 16) {
+	std::vector<std::size_t> stamp(vertex_count, 0);
+	std::size_t misses = 0;
+
+	// a vertex stays in the cache until cache_size more misses came after it
+	for(std::size_t v : indices) {
+		if(!stamp[v] || misses - stamp[v] >= (std::size_t)cache_size) {
+			misses++;
+			stamp[v] = misses;
+		}
+	}
+
+	return indices.empty() ? 0 : (float)misses / (indices.size() / 3);
+}
+
+// tipsify. returns the new index list, cluster_starts gets the first triangle of
+// every run that started at a vertex with no cached neighbours
+static inline std::vector<size_t> optimize_vertex_cache(const std::vector<size_t>& indices,
+	std::size_t vertex_count, int cache_size, std::vector<std::size_t>& cluster_starts) {
+	const std::size_t triangle_count = indices.size() / 3;
+
+	// triangles around each vertex
+	std::vector<std::size_t> offsets(vertex_count + 1, 0), adjacency(indices.size());
+	std::vector<int> live(vertex_count, 0);
+
+	for(std::size_t v : indices)
+		live[v]++;
+
+	for(std::size_t v = 0; v < vertex_count; v++)
+		offsets[v + 1] = offsets[v] + live[v];
+
+	{
+		std::vector<std::size_t> fill(offsets.begin(), offsets.end() - 1);
+		for(std::size_t i = 0; i < indices.size(); i++)
+			adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	std::vector<int> cache_time(vertex_count, 0);
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<std::size_t> dead_end, candidates;
+
+	std::vector<size_t> out;
+	out.reserve(indices.size());
+	cluster_starts.clear();
+
+	int time = cache_size + 1;
+	std::size_t cursor = 0;
+
+	// next fanning vertex that still has triangles: the dead end stack first, then
+	// the input order
+	auto skip_dead_end = [&]() -> std::ptrdiff_t {
+		while(!dead_end.empty()) {
+			std::size_t d = dead_end.back();
+			dead_end.pop_back();
+
+			if(live[d] > 0)
+				return d;
+		}
+
+		while(cursor < vertex_count) {
+			if(live[cursor] > 0)
+				return cursor;
+			cursor++;
+		}
+
+		return -1;
+	};
+
+	std::ptrdiff_t f = skip_dead_end();
+	bool from_candidates = false;
+
+	while(f >= 0) {
+		// fanning restarts somewhere the cache knows nothing about
+		if(!from_candidates)
+			cluster_starts.push_back(out.size() / 3);
+
+		candidates.clear();
+
+		for(std::size_t a = offsets[f]; a < offsets[f + 1]; a++) {
+			std::size_t t = adjacency[a];
+			if(emitted[t])
+				continue;
+
+			for(int k = 0; k < 3; k++) {
+				std::size_t v = indices[t * 3 + k];
+				out.push_back(v);
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+
+				if(time - cache_time[v] > cache_size)
+					cache_time[v] = time++;
+			}
+
+			emitted[t] = true;
+		}
+
+		// the candidate that will still be in the cache after its remaining
+		// triangles are emitted, and has been in it longest
+		std::ptrdiff_t next = -1;
+		int best = -1;
+
+		for(std::size_t v : candidates) {
+			if(live[v] <= 0)
+				continue;
+
+			int priority = 0;
+			if(time - cache_time[v] + 2 * live[v] <= cache_size)
+				priority = time - cache_time[v];
+
+			if(priority > best) {
+				best = priority;
+				next = v;
+			}
+		}
+
+		from_candidates = next >= 0;
+
+		if(next < 0)
+			next = skip_dead_end();
+
+		f = next;
+	}
+
+	return out;
+}
+
+// sort clusters front to back by how much they face away from the mesh center.
+// clusters from optimize_vertex_cache are split further where a new one would not
+// raise the ACMR above `threshold` times the original
+template <typename T>
+static void optimize_overdraw(GMesh<T>& mesh, std::vector<std::size_t> cluster_starts,
+	int cache_size = 16, float threshold = 1.05f) {
+	const std::size_t triangle_count = mesh.indices.size() / 3;
+	if(triangle_count == 0)
+		return;
+
+	const float limit = vertex_cache_acmr(mesh.indices, mesh.vertices.size(), cache_size) * threshold;
+
+	// soft boundaries at triangles that miss the cache with all three vertices
+	{
+		std::vector<std::size_t> starts;
+		std::vector<std::size_t> stamp(mesh.vertices.size(), 0);
+		std::size_t misses = 0, cluster_misses = 0, cluster_first = 0;
+
+		cluster_starts.push_back(triangle_count);
+
+		for(std::size_t c = 0; c + 1 < cluster_starts.size(); c++) {
+			for(std::size_t t = cluster_starts[c]; t < cluster_starts[c + 1]; t++) {
+				int tri_misses = 0;
+
+				for(int k = 0; k < 3; k++) {
+					std::size_t v = mesh.indices[t * 3 + k];
+					if(!stamp[v] || misses - stamp[v] >= (std::size_t)cache_size) {
+						misses++;
+						tri_misses++;
+						stamp[v] = misses;
+					}
+				}
+
+				bool hard = t == cluster_starts[c];
+				bool soft = tri_misses == 3 && t > cluster_first &&
+					(float)cluster_misses / (t - cluster_first) <= limit;
+
+				if(hard || soft) {
+					starts.push_back(t);
+					cluster_first = t;
+					cluster_misses = 0;
+				}
+
+				cluster_misses += tri_misses;
+			}
+		}
+
+		starts.push_back(triangle_count);
+		cluster_starts.swap(starts);
+	}
+
+	vec3 mesh_center(0);
+	for(const T& v : mesh.vertices)
+		mesh_center += vec3(v.pos);
+	mesh_center /= (float)mesh.vertices.size();
+
+	// occlusion potential: clusters far out along their own normal tend to hide
+	// the rest of the mesh
+	std::vector<std::pair<float, std::size_t>> order;
+
+	for(std::size_t c = 0; c + 1 < cluster_starts.size(); c++) {
+		vec3 center(0), normal(0);
+		float area = 0;
+
+		for(std::size_t t = cluster_starts[c]; t < cluster_starts[c + 1]; t++) {
+			vec3 a(mesh.vertices[mesh.indices[t * 3]].pos),
+				b(mesh.vertices[mesh.indices[t * 3 + 1]].pos),
+				d(mesh.vertices[mesh.indices[t * 3 + 2]].pos);
+
+			vec3 n = cross(b - a, d - a);
+			float w = length(n) * 0.5f;
+
+			center += (a + b + d) / 3.0f * w;
+			normal += n;
+			area += w;
+		}
+
+		if(area > 0)
+			center /= area;
+
+		float len = length(normal);
+		float potential = len > 0 ? dot(center - mesh_center, normal / len) : 0;
+
+		order.push_back({ -potential, c });
+	}
+
+	std::stable_sort(order.begin(), order.end());
+
+	std::vector<size_t> out;
+	out.reserve(mesh.indices.size());
+
+	for(const auto& o : order) {
+		std::size_t c = o.second;
+		out.insert(out.end(),
+			mesh.indices.begin() + cluster_starts[c] * 3,
+			mesh.indices.begin() + cluster_starts[c + 1] * 3);
+	}
+
+	mesh.indices.swap(out);
+}
+
+// renumber vertices in first use order, unused ones go last
+template <typename T>
+static void optimize_vertex_fetch(GMesh<T>& mesh) {
+	const std::size_t none = (std::size_t)-1;
+	std::vector<std::size_t> remap(mesh.vertices.size(), none);
+	std::vector<T> vertices;
+	vertices.reserve(mesh.vertices.size());
+
+	for(size_t& i : mesh.indices) {
+		if(remap[i] == none) {
+			remap[i] = vertices.size();
+			vertices.push_back(mesh.vertices[i]);
+		}
+
+		i = remap[i];
+	}
+
+	for(std::size_t v = 0; v < mesh.vertices.size(); v++) {
+		if(remap[v] == none)
+			vertices.push_back(mesh.vertices[v]);
+	}
+
+	mesh.vertices.swap(vertices);
+}
+
+// all three passes, in the order they depend on each other
+template <typename T>
+static void optimize_mesh(GMesh<T>& mesh, int cache_size = 16) {
+	std::vector<std::size_t> clusters;
+	mesh.indices = optimize_vertex_cache(mesh.indices, mesh.vertices.size(), cache_size, clusters);
+	optimize_overdraw(mesh, clusters, cache_size);
+	optimize_vertex_fetch(mesh);
+}
+
+}
@@ -0,0 +1,150 @@
+// this file describes quantized vertex and index storage
+// a packed mesh keeps its vertices in a smaller format and the pipeline decodes them
+// when it fetches them for the vertex shader. positions are stored relative to the
+// mesh's bounding box, normals as octahedral coordinates. indices are 16 bit when
+// the mesh has few enough vertices and 32 bit otherwise
+
+#pragma once
+
+#include "util.hpp"
+
+namespace demo {
+
+// maps positions inside a bounding box to 16 bit unsigned integers per axis
+struct GPositionQuantizer {
+	vec3 origin;
+	vec3 step; // size of one unit
+
+	GPositionQuantizer() { }
+	GPositionQuantizer(const GBounds& b) :
+		origin(b.min),
+		step(glm::max(b.max - b.min, vec3(1e-6f)) / 65535.0f) { }
+
+	void encode(vec3 p, std::uint16_t* q) const {
+		for(int i = 0; i < 3; i++)
+			q[i] = (std::uint16_t)clamp((p[i] - origin[i]) / step[i] + 0.5f, 0.0f, 65535.0f);
+	}
+
+	vec3 decode(const std::uint16_t* q) const {
+		return origin + vec3(q[0], q[1], q[2]) * step;
+	}
+
+	// largest distance between a position and its decoded value
+	float error() const {
+		return length(step) * 0.5f;
+	}
+};
+
+// unit vector to a point in [-1, 1]^2: project onto the octahedron |x|+|y|+|z| = 1
+// and fold the lower half over the upper one
+static inline vec2 oct_encode(vec3 n) {
+	n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	vec2 e(n.x, n.y);
+
+	if(n.z < 0) {
+		e = vec2(
+			(1 - std::abs(n.y)) * (n.x >= 0 ? 1 : -1),
+			(1 - std::abs(n.x)) * (n.y >= 0 ? 1 : -1));
+	}
+
+	return e;
+}
+
+static inline vec3 oct_decode(vec2 e) {
+	vec3 n(e.x, e.y, 1 - std::abs(e.x) - std::abs(e.y));
+	float t = std::max(-n.z, 0.0f);
+
+	n.x += n.x >= 0 ? -t : t;
+	n.y += n.y >= 0 ? -t : t;
+
+	return normalize(n);
+}
+
+// signed normalized integers, [-1, 1] to the full range of the type
+template <typename I>
+static inline I pack_snorm(float v) {
+	const float m = std::numeric_limits<I>::max();
+	return (I)std::round(clamp(v, -1.0f, 1.0f) * m);
+}
+
+template <typename I>
+static inline float unpack_snorm(I v) {
+	const float m = std::numeric_limits<I>::max();
+	return std::max(v / m, -1.0f);
+}
+
+// 16 or 32 bit indices, picked by the vertex count
+class GIndexBuffer {
+public:
+	GIndexBuffer() { }
+
+	GIndexBuffer(const std::vector<size_t>& is, std::size_t vertex_count) :
+		wide(vertex_count > 65536) {
+		if(wide)
+			wide_indices.assign(is.begin(), is.end());
+		else
+			narrow_indices.assign(is.begin(), is.end());
+	}
+
+	std::size_t size() const {
+		return wide ? wide_indices.size() : narrow_indices.size();
+	}
+
+	std::size_t size_in_bytes() const {
+		return wide ? wide_indices.size() * sizeof(std::uint32_t) : narrow_indices.size() * sizeof(std::uint16_t);
+	}
+
+	// calls f with the index vector, whichever width it has
+	template <typename F>
+	void visit(F f) const {
+		if(wide)
+			f(wide_indices);
+		else
+			f(narrow_indices);
+	}
+
+	bool wide = false;
+	std::vector<std::uint16_t> narrow_indices;
+	std::vector<std::uint32_t> wide_indices;
+};
+
+// a mesh stored in Format. a format is a struct with
+//   vertex_type, the vertex the shaders see
+//   packed_type, what is stored per vertex
+//   static packed_type encode(const vertex_type&, const GPositionQuantizer&)
+//   static vertex_type decode(const packed_type&, const GPositionQuantizer&)
+template <class Format>
+class GPackedMesh {
+public:
+	typedef typename Format::vertex_type vertex_type;
+	typedef typename Format::packed_type packed_type;
+
+	GPackedMesh() { }
+
+	GPackedMesh(const GMesh<vertex_type>& mesh) :
+		quantizer(mesh.bounds),
+		indices(mesh.indices, mesh.vertices.size()),
+		bounds(mesh.bounds) {
+		vertices.reserve(mesh.vertices.size());
+		for(const vertex_type& v : mesh.vertices)
+			vertices.push_back(Format::encode(v, quantizer));
+
+		// decoded positions may sit just outside the original bounds
+		bounds.radius += quantizer.error();
+	}
+
+	vertex_type vertex(std::size_t i) const {
+		return Format::decode(vertices[i], quantizer);
+	}
+
+	std::size_t size_in_bytes() const {
+		return vertices.size() * sizeof(packed_type) + indices.size_in_bytes();
+	}
+
+	GPositionQuantizer quantizer;
+	std::vector<packed_type> vertices;
+	GIndexBuffer indices;
+	GBounds bounds;
+};
+
+}
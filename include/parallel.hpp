@@ -0,0 +1,116 @@
+// this file describes a team of threads for data parallel loops
+// the threads are started once and sleep between loops. a loop hands out ranges
+// of indices from a shared counter, so faster threads take more of them, and the
+// calling thread works on the loop too instead of waiting
+
+#pragma once
+
+#include "util.hpp"
+
+namespace demo {
+
+class GThreadTeam {
+public:
+	typedef std::function<void(std::size_t, std::size_t)> Body;
+
+	// threads besides the caller, by default one per remaining core
+	GThreadTeam(int threads = (int)std::thread::hardware_concurrency() - 1) {
+		for(int i = 0; i < threads; i++)
+			workers.emplace_back([this]() { work(); });
+	}
+
+	GThreadTeam(const GThreadTeam&) = delete;
+	GThreadTeam& operator=(const GThreadTeam&) = delete;
+
+	~GThreadTeam() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+		}
+
+		wake.notify_all();
+		for(std::thread& t : workers)
+			t.join();
+	}
+
+	// calls body(begin, end) on ranges of at most `grain` indices until all of
+	// [0, count) is covered, returns when every range is done. one loop at a time
+	void run(std::size_t count, std::size_t grain, const Body& body) {
+		grain = std::max<std::size_t>(grain, 1);
+
+		if(workers.empty() || count <= grain) {
+			for(std::size_t begin = 0; begin < count; begin += grain)
+				body(begin, std::min(begin + grain, count));
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &body;
+			job_count = count;
+			job_grain = grain;
+			next = 0;
+			busy = workers.size();
+			generation++;
+		}
+
+		wake.notify_all();
+		take_ranges();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return busy == 0; });
+		job = nullptr;
+	}
+
+	// threads working on a loop, the caller included
+	int size() const {
+		return workers.size() + 1;
+	}
+
+private:
+	void work() {
+		std::uint64_t seen = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while(true) {
+			wake.wait(lock, [&]() { return !running || generation != seen; });
+			if(!running)
+				return;
+
+			seen = generation;
+
+			lock.unlock();
+			take_ranges();
+			lock.lock();
+
+			if(--busy == 0)
+				done.notify_one();
+		}
+	}
+
+	void take_ranges() {
+		while(true) {
+			std::size_t begin = next.fetch_add(job_grain);
+			if(begin >= job_count)
+				return;
+
+			(*job)(begin, std::min(begin + job_grain, job_count));
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	bool running = true;
+
+	// the current loop, written under the mutex before the workers wake
+	const Body* job = nullptr;
+	std::size_t job_count = 0;
+	std::size_t job_grain = 1;
+	std::atomic<std::size_t> next{ 0 };
+	std::size_t busy = 0;
+	std::uint64_t generation = 0;
+};
+
+}
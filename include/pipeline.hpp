@@ -6,14 +6,95 @@
 #include "util.hpp"
 #include "window.hpp"
 #include "context.hpp"
+#include "lod.hpp"
+#include "simd.hpp"
+#include "fastmath.hpp"
+#include "rate.hpp"
+#include "packed.hpp"
 
 namespace demo {
 
 using namespace glm;
 
-template <class VertexShader, class GeometryShader, class FragmentShader>
+template <class VertexShader, class GeometryShader, class FragmentShader, class Math>
 class GContext;
 
+// per draw rasterizer state
+struct GRasterState {
+	// skip attribute interpolation, the fragment shader and color writes
+	bool depth_only = false;
+	bool depth_write = true;
+	GDepthFunc depth_func = GDepthFunc::less;
+
+	// pixels per side of the blocks the fragment shader runs once for: 1, 2 or 4
+	int shading_rate = 1;
+
+	// above 0 each triangle picks its rate from its varyings instead: the coarsest
+	// at which none of them changes by more than this across a block
+	float rate_threshold = 0;
+
+	// triangles covering at most the pipeline's small_triangle_centers pixel centers
+	// skip plane setup for their varyings. depth is the same as on the general
+	// path, colors can differ from it by rounding
+	bool small_triangles = false;
+
+	// fills the depth buffer ahead of shading
+	static GRasterState depth_prepass() {
+		return GRasterState{ true, true, GDepthFunc::less };
+	}
+
+	// shades only the fragments that won the prepass, each pixel once
+	static GRasterState after_prepass() {
+		return GRasterState{ false, false, GDepthFunc::equal };
+	}
+};
+
+// one of the views of a multi view draw
+struct GView {
+	mat4x4 view_projection; // world space -> clip space
+	GRenderTarget* target;
+};
+
+// samples that passed the depth test while the query was active
+struct GOcclusionQuery {
+	std::size_t samples = 0;
+};
+
+struct GPipelineStats {
+	std::size_t draws = 0;
+	std::size_t instances_culled = 0;
+	std::size_t triangles_submitted = 0;
+	std::size_t fragments_shaded = 0;
+	std::size_t fragments_broadcast = 0; // took the color of a coarse block
+	std::size_t bounds_tested = 0;
+
+	// triangles that reached the rasterizer, by the pixel centers their bounding
+	// box covers: 0, 1, 2, 3-4, 5-16, 17-64, 65-256, 257-1024 and more
+	static constexpr int size_buckets = 9;
+	std::size_t triangle_sizes[size_buckets] = {};
+	std::size_t triangles_small = 0; // drawn without plane setup
+
+	void reset() {
+		*this = GPipelineStats{};
+	}
+
+	static int size_bucket(int centers) {
+		if(centers <= 2)
+			return centers;
+
+		int bucket = 3;
+		for(int limit = 4; centers > limit && bucket < size_buckets - 1; limit *= 4)
+			bucket++;
+
+		return bucket;
+	}
+
+	static const char* size_bucket_name(int bucket) {
+		static const char* names[size_buckets] = { "0", "1", "2", "3-4", "5-16", "17-64", "65-256", "257-1024", ">1024" };
+		return names[bucket];
+	}
+};
+
 /*
  * vertex transformer -> vertex shader -> triangle assembler -> 
  * triangle clipper -> geometry shader -> persp/screen transformer -> 
@@ -28,50 +109,393 @@ public:
 	typedef typename Context::VOutputType VOutputType;
 	typedef typename Context::GOutputType GOutputType;
 	typedef typename Context::FOutputType FOutputType;
+	typedef typename Context::MathType MathType;
 
-	GPipeline(GWindow& win) : window(win), context(win) { }
+	GPipeline(GWindow& win) : 
+		window(win), 
+		target(&win.get_render_target()), 
+		context(win) { }
+
+	// draw into another target than the window's
+	void set_render_target(GRenderTarget* t) {
+		target = t;
+	}
+
+	GRenderTarget* get_render_target() {
+		return target;
+	}
 
 	// start pipeline
+	// uses whatever model transform the vertex shader currently holds.
+	// Mesh is a GMesh, GPackedMesh or GMappedMesh
+	template <class Mesh>
+	void process(const Mesh& mesh) {
+		if(on_draw)
+			on_draw(&mesh, nullptr);
+
+		draw_mesh(mesh);
+	}
+
+	// draw one copy of the mesh per model matrix. the vertex data is shared,
+	// only the vertex shader's per-instance constants change between copies
+	template <class Mesh>
+	void process_instanced(const Mesh& mesh, const std::vector<mat4x4>& instances) {
+		if(on_draw)
+			on_draw(&mesh, &instances);
+
+		for(const mat4x4& model : instances) {
+			context.vertex_shader.set_model(model);
+			draw_mesh(mesh);
+		}
+
+		context.vertex_shader.set_model(mat4x4(1));
+	}
+
+	// draw the level of detail that fits the mesh's current screen size.
+	// `level` is the level used last time and is updated in place
 	template <typename T>
-	void process(GMesh<T> tri) {
-		std::vector<VOutputType> tri_transformed;
+	void process_lod(const GLodChain<T>& chain, std::size_t& level) {
+		level = chain.select(screen_radius(chain.levels[0].bounds), level);
+
+		if(on_draw)
+			on_draw(&chain.levels[level], nullptr);
+
+		draw_mesh(chain.levels[level]);
+	}
+
+	// draw the mesh into several views at once, like the faces of a cube map, a
+	// stereo pair or shadow cascades. vertices are shaded once by the vertex
+	// shader's shade_world, which does all the work but the projection and leaves
+	// positions in world space, then each view projects, culls and rasterizes them
+	// into its own target. the vertex shader needs shade_world and get_model.
+	// frame captures do not record these draws
+	template <class Mesh>
+	void process_multiview(const Mesh& mesh, const std::vector<GView>& views) {
+		const mat4x4 model = context.vertex_shader.get_model();
+
+		visible_views.clear();
+
+		for(const GView& v : views) {
+			GFrustum frustum(v.view_projection * model);
+
+			if(frustum.test_sphere(mesh.bounds.center, mesh.bounds.radius))
+				visible_views.push_back(&v);
+			else
+				stats.instances_culled++;
+		}
+
+		if(visible_views.empty())
+			return;
+
+		world.clear();
+		world.reserve(mesh.vertices.size());
+
+		fetch_vertices(mesh, world, [this](const VInputType& v) { return context.vertex_shader.shade_world(v); });
+
+		GRenderTarget* main_target = target;
+
+		for(const GView* v : visible_views) {
+			stats.draws++;
+			stats.triangles_submitted += mesh.indices.size() / 3;
+
+			// only the position differs between views
+			shaded.resize(world.size());
+			for(std::size_t i = 0; i < world.size(); i++) {
+				shaded[i] = world[i];
+				shaded[i].pos = v->view_projection * world[i].pos;
+			}
+
+			target = v->target;
+			assemble_triangles(shaded, mesh.indices);
+		}
+
+		target = main_target;
+	}
+
+	// count the samples of the following draws that pass the depth test
+	void begin_query(GOcclusionQuery& q) {
+		q.samples = 0;
+		query = &q;
+	}
+
+	void end_query() {
+		query = nullptr;
+	}
+
+	// samples of the bounding box, with the vertex shader's current model
+	// transform, that would pass the depth test. nothing is shaded or written.
+	// a box reaching through the near plane counts as fully visible
+	std::size_t query_bounds(const GBounds& bounds) {
+		mat4x4 m = context.vertex_shader.clip_matrix();
+		std::vector<VOutputType> corners(8);
+
+		stats.bounds_tested++;
 
-		for(auto v : tri.vertices) {
-			tri_transformed.emplace_back(context.vertex_shader(v));
+		for(int i = 0; i < 8; i++) {
+			vec3 corner(
+				(i & 1) ? bounds.max.x : bounds.min.x,
+				(i & 2) ? bounds.max.y : bounds.min.y,
+				(i & 4) ? bounds.max.z : bounds.min.z);
+
+			corners[i].pos = m * vec4(corner, 1);
+
+			if(corners[i].pos.z <= 0)
+				return std::numeric_limits<std::size_t>::max();
 		}
 
-		assemble_triangles(tri_transformed, tri.indices);
+		// outward facing, corner i has x from bit 0, y from bit 1 and z from bit 2
+		static const std::uint8_t box[36] = {
+			0, 2, 3, 0, 3, 1, // -z
+			4, 5, 7, 4, 7, 6, // +z
+			0, 4, 6, 0, 6, 2, // -x
+			1, 3, 7, 1, 7, 5, // +x
+			0, 1, 5, 0, 5, 4, // -y
+			2, 6, 7, 2, 7, 3  // +y
+		};
+
+		GRasterState saved = state;
+		GOcclusionQuery* saved_query = query;
+		GOcclusionQuery q;
+
+		state = GRasterState{ true, false, GDepthFunc::less };
+		query = &q;
+
+		assemble_triangles(corners, std::vector<std::uint8_t>(box, box + 36));
+
+		state = saved;
+		query = saved_query;
+
+		return q.samples;
+	}
+
+	// approximate radius of the bounding sphere on screen, in pixels
+	float screen_radius(const GBounds& bounds) {
+		mat4x4 m = context.vertex_shader.clip_matrix();
+		vec4 center = m * vec4(bounds.center, 1);
+
+		// row 1 of the clip matrix is the y projection scale times the view/model rows
+		float scale = length(vec3(m[0][1], m[1][1], m[2][1]));
+
+		// camera is inside the sphere
+		if(center.w <= bounds.radius)
+			return INFINITY;
+
+		return bounds.radius * scale / center.w * target->height * 0.5f;
+	}
+
+	// conservative pixel rectangle covered by the bounding box, with the vertex
+	// shader's current model transform. the whole target if the box crosses the
+	// camera plane, empty if it is off screen
+	GRect screen_rect(const GBounds& bounds) {
+		mat4x4 m = context.vertex_shader.clip_matrix();
+		GRect screen{ 0, 0, target->width - 1, target->height - 1 };
+		vec2 lo(INFINITY), hi(-INFINITY);
+
+		for(int i = 0; i < 8; i++) {
+			vec3 corner(
+				(i & 1) ? bounds.max.x : bounds.min.x,
+				(i & 2) ? bounds.max.y : bounds.min.y,
+				(i & 4) ? bounds.max.z : bounds.min.z);
+
+			vec4 clip = m * vec4(corner, 1);
+
+			if(clip.w <= 0)
+				return screen;
+
+			lo = glm::min(lo, vec2(clip) / clip.w);
+			hi = glm::max(hi, vec2(clip) / clip.w);
+		}
+
+		if(lo.x > 1 || lo.y > 1 || hi.x < -1 || hi.y < -1)
+			return GRect{};
+
+		// ndc y points up, screen y points down. one pixel of slack for rounding
+		GRect r{
+			(int)std::floor((lo.x + 1) * 0.5f * target->width) - 1,
+			(int)std::floor((-hi.y + 1) * 0.5f * target->height) - 1,
+			(int)std::ceil((hi.x + 1) * 0.5f * target->width) + 1,
+			(int)std::ceil((-lo.y + 1) * 0.5f * target->height) + 1
+		};
+
+		return r.intersect(screen);
+	}
+
+	// union of the screen rectangles of all instances
+	template <class Mesh>
+	GRect screen_rect(const Mesh& mesh, const std::vector<mat4x4>& instances) {
+		GRect r;
+
+		for(const mat4x4& model : instances) {
+			context.vertex_shader.set_model(model);
+			r = r.merge(screen_rect(mesh.bounds));
+		}
+
+		context.vertex_shader.set_model(mat4x4(1));
+		return r;
+	}
+
+	GRasterState state;
+	GPipelineStats stats;
+
+	// fragments outside are never touched, draws outside are skipped
+	GRect scissor = GRect::all();
+
+	// triangles covering at most this many pixel centers skip plane setup and the
+	// tile walk when the raster state asks for it, their few fragments are
+	// interpolated directly
+	int small_triangle_centers = 4;
+
+	// optional, a shading rate per screen tile. multisampled targets and small
+	// triangles are always shaded per pixel
+	const GShadingRateMap* rate_map = nullptr;
+
+	// called before every draw with the mesh and its instances, null when the mesh
+	// is drawn with the shader's current model matrix. frame captures hook in here
+	std::function<void(const void*, const std::vector<mat4x4>*)> on_draw;
+
+private:
+	template <class Mesh>
+	void draw_mesh(const Mesh& mesh) {
+		// cull the whole instance against the view frustum
+		GFrustum frustum(context.vertex_shader.clip_matrix());
+
+		if(!frustum.test_sphere(mesh.bounds.center, mesh.bounds.radius)) {
+			stats.instances_culled++;
+			return;
+		}
+
+		// partial redraws only touch the scissor rectangle
+		if(scissor.x0 > 0 || scissor.y0 > 0 || scissor.x1 < target->width - 1 || scissor.y1 < target->height - 1) {
+			if(!screen_rect(mesh.bounds).overlaps(scissor)) {
+				stats.instances_culled++;
+				return;
+			}
+		}
+
+		stats.draws++;
+		stats.triangles_submitted += mesh.indices.size() / 3;
+
+		shaded.clear();
+		shaded.reserve(mesh.vertices.size());
+
+		fetch_vertices(mesh, shaded, [this](const VInputType& v) { return context.vertex_shader(v); });
+
+		assemble_triangles(shaded, mesh.indices);
+	}
+
+	// GMesh, GMappedMesh
+	template <class Mesh, class Shade>
+	void fetch_vertices(const Mesh& mesh, std::vector<VOutputType>& out, Shade shade) {
+		for(const auto& v : mesh.vertices) {
+			out.emplace_back(shade(v));
+		}
+	}
+
+	// packed vertices are decoded on the way into the vertex shader
+	template <class Format, class Shade>
+	void fetch_vertices(const GPackedMesh<Format>& mesh, std::vector<VOutputType>& out, Shade shade) {
+		for(std::size_t i = 0; i < mesh.vertices.size(); i++) {
+			out.emplace_back(shade(mesh.vertex(i)));
+		}
 	}
 
 private:
+	// result of triangle setup for one triangle that was not culled
+	struct GSetupTriangle {
+		std::uint32_t index; // first index of the triangle
+		bool clip; // false if the triangle is completely inside the frustum
+	};
+
+	// 16 or 32 bit indices of a packed mesh
+	void assemble_triangles(const std::vector<VOutputType>& vertices, const GIndexBuffer& indices) {
+		indices.visit([&](const auto& is) { assemble_triangles(vertices, is); });
+	}
+
 	// build triangles, culls back facing triangles
-	void assemble_triangles(std::vector<VOutputType>& vertices, std::vector<size_t>& indices) {
-		for(size_t idx = 0; idx < indices.size(); idx += 3) {
-			const VOutputType& v0 = vertices[indices[idx]],
-				v1 = vertices[indices[idx + 1]],
-				v2 = vertices[indices[idx + 2]];
-		
-			// vec4 -> vec3 for back-face culling
-			vec3 vv0(v0.pos), vv1(v1.pos), vv2(v2.pos);
+	// triangles are set up 4 at a time: positions are gathered into lanes, then facing
+	// and outcodes are computed for all 4 at once. survivors are compacted into a
+	// stream, trivially accepted ones skip the clipper
+	template <class Indices>
+	void assemble_triangles(const std::vector<VOutputType>& vertices, const Indices& indices) {
+		const std::size_t count = indices.size() / 3;
 
-			// back-face culling
-			if((dot(normalize(-vv0), cross((vv1 - vv0), (vv2 - vv0)))) >= 0)
-				continue;
+		setup_stream.clear();
+
+		for(std::size_t first = 0; first < count; first += 4) {
+			// gather positions, vertex k of lane l at [k][c][l]
+			alignas(16) float p[3][4][4];
+			int lanes = std::min<std::size_t>(4, count - first);
+
+			for(int l = 0; l < 4; l++) {
+				std::size_t t = first + std::min(l, lanes - 1);
+
+				for(int k = 0; k < 3; k++) {
+					const vec4& pos = vertices[indices[t * 3 + k]].pos;
+					p[k][0][l] = pos.x;
+					p[k][1][l] = pos.y;
+					p[k][2][l] = pos.z;
+					p[k][3][l] = pos.w;
+				}
+			}
+
+			f32x4 x[3], y[3], z[3], w[3];
+			for(int k = 0; k < 3; k++) {
+				x[k] = f32x4::load(p[k][0]);
+				y[k] = f32x4::load(p[k][1]);
+				z[k] = f32x4::load(p[k][2]);
+				w[k] = f32x4::load(p[k][3]);
+			}
+
+			// back-face culling, dot(-v0, cross(v1 - v0, v2 - v0)) >= 0
+			f32x4 e1x = x[1] - x[0], e1y = y[1] - y[0], e1z = z[1] - z[0],
+				e2x = x[2] - x[0], e2y = y[2] - y[0], e2z = z[2] - z[0];
+			f32x4 nx = e1y * e2z - e1z * e2y,
+				ny = e1z * e2x - e1x * e2z,
+				nz = e1x * e2y - e1y * e2x;
+			f32x4 facing = x[0] * nx + y[0] * ny + z[0] * nz;
+
+			int front = movemask(facing > f32x4(0.0f));
 
 			// view frustum culling
+			// per plane: inside mask of every vertex. all outside rejects, any outside clips
+			int all_out = 0, any_out = 0;
+			for(int i = 0; i < 6; i++) {
+				int out[3];
+				for(int k = 0; k < 3; k++) {
+					f32x4 d;
+					switch(i) {
+					case 0: d = w[k] + x[k]; break; // left
+					case 1: d = w[k] - x[k]; break; // right
+					case 2: d = w[k] - y[k]; break; // top
+					case 3: d = w[k] + y[k]; break; // bottom
+					case 4: d = z[k]; break; // near, also rejects triangles behind the camera
+					default: d = w[k] - z[k]; break; // far
+					}
+					out[k] = movemask(d < f32x4(0.0f));
+				}
+
+				all_out |= out[0] & out[1] & out[2];
+				any_out |= out[0] | out[1] | out[2];
+			}
+
+			int keep = front & ~all_out & ((1 << lanes) - 1);
 
-			// frustum inequalities
-			if((v0.pos.x > v0.pos.w && v1.pos.x > v1.pos.w && v2.pos.x > v2.pos.w) ||
-				(v0.pos.x < -v0.pos.w && v1.pos.x < -v1.pos.w && v2.pos.x < -v2.pos.w)) continue;
-			if((v0.pos.y > v0.pos.w && v1.pos.y > v1.pos.w && v2.pos.y > v2.pos.w) ||
-				(v0.pos.y < -v0.pos.w && v1.pos.y < -v1.pos.w && v2.pos.y < -v2.pos.w)) continue;
-			if((v0.pos.z > v0.pos.w && v1.pos.z > v1.pos.w && v2.pos.z > v2.pos.w) || 
-				(v0.pos.z < -v0.pos.w && v1.pos.z < -v1.pos.w && v2.pos.z < -v2.pos.w)) continue;
-			
-			// behind camera
-			if(v0.pos.z < 0 && v1.pos.z < 0 && v2.pos.z < 0) continue;
+			// compact survivors
+			for(int l = 0; l < lanes; l++) {
+				if(keep & (1 << l))
+					setup_stream.push_back(GSetupTriangle{ (std::uint32_t)((first + l) * 3), (any_out & (1 << l)) != 0 });
+			}
+		}
 
-			clip_triangle(v0, v1, v2);
+		for(const GSetupTriangle& t : setup_stream) {
+			const VOutputType& v0 = vertices[indices[t.index]],
+				v1 = vertices[indices[t.index + 1]],
+				v2 = vertices[indices[t.index + 2]];
+
+			if(t.clip)
+				clip_triangle(v0, v1, v2);
+			else
+				transform_triangle(GOutputType(v0, v1, v2));
 		}
 	}
 
@@ -179,68 +603,444 @@ private:
 		}
 	}
 
-	template <typename V>
-	void transform(V& v) {
-		float invw = 1 / v.pos.w;
+	// perspective divide and screen transform of a clip space position, 1/w in w.
+	// the reciprocal is the context's, with GFastMath within 3e-7 relative of a
+	// divide. every path that needs a vertex's depth comes through here, so depth
+	// equal tests still agree
+	vec4 screen_position(const vec4& pos) {
+		float invw = MathType::rcp(pos.w);
 
-		// perspective divide
-		v = v * invw;
-		v.pos.w = invw;
+		return vec4(
+			((pos.x * invw + 1) * target->width) / 2,
+			((-pos.y * invw + 1) * target->height) / 2,
+			pos.z * invw,
+			invw);
+	}
 
-		// screen transform
-		v.pos.x = ((v.pos.x + 1) * window.width) / 2;
-		v.pos.y = ((-v.pos.y + 1) * window.height) / 2;
+	// divide the vertex attributes by w
+	template <typename V>
+	void transform(V& v, const vec4& screen) {
+		v = v * screen.w;
+		v.pos = screen;
 	}
 	
 	// perspective divide and screen transform
-	// also transform vertex attributes
+	// also transform vertex attributes. positions go first: a triangle whose
+	// bounding box holds no pixel center cannot cover one and is dropped before its
+	// attributes are touched
 	void transform_triangle(GOutputType tri) {
-		transform(tri.a);
-		transform(tri.b);
-		transform(tri.c);
+		vec4 a = screen_position(tri.a.pos),
+			b = screen_position(tri.b.pos),
+			c = screen_position(tri.c.pos);
+
+		// pixels whose centers lie in the bounding box, clamped to the screen and the
+		// scissor rectangle. on a multisampled target a pixel counts if any of its
+		// samples does
+		const bool multisample = target->samples > 1;
+		const float reach = multisample ? msaa_reach : 0;
+
+		GRect box{
+			std::max<int>(std::ceil(std::min(std::min(a.x, b.x), c.x) - 0.5f - reach), std::max(0, scissor.x0)),
+			std::max<int>(std::ceil(std::min(std::min(a.y, b.y), c.y) - 0.5f - reach), std::max(0, scissor.y0)),
+			std::min<int>(std::floor(std::max(std::max(a.x, b.x), c.x) - 0.5f + reach), std::min(target->width - 1, scissor.x1)),
+			std::min<int>(std::floor(std::max(std::max(a.y, b.y), c.y) - 0.5f + reach), std::min(target->height - 1, scissor.y1))
+		};
 
-		draw_triangle(tri);
+		if(box.empty()) {
+			stats.triangle_sizes[0]++;
+			return;
+		}
+
+		int centers = (box.x1 - box.x0 + 1) * (box.y1 - box.y0 + 1);
+		stats.triangle_sizes[GPipelineStats::size_bucket(centers)]++;
+
+		transform(tri.a, a);
+		transform(tri.b, b);
+		transform(tri.c, c);
+
+		if(state.small_triangles && centers <= small_triangle_centers && !multisample) {
+			stats.triangles_small++;
+			draw_small_triangle(tri, box);
+		} else {
+			draw_triangle(tri, box);
+		}
+	}
+
+	// depth only draws test one depth per pixel even on a multisampled target
+	void draw_triangle(GOutputType& tri, const GRect& box) {
+		if(state.depth_only)
+			rasterize<false, false>(tri, box);
+		else if(target->samples > 1)
+			rasterize<true, true>(tri, box);
+		else
+			rasterize<true, false>(tri, box);
+	}
+
+	void draw_small_triangle(GOutputType& tri, const GRect& box) {
+		if(state.depth_only)
+			rasterize_small<false>(tri, box);
+		else
+			rasterize_small<true>(tri, box);
 	}
 
 	// rasterize
 	// triangle is already in screen space
-	void draw_triangle(GOutputType& tri) {
-		// get bounding box
-		int bb_min_x = std::min(std::min(tri.a.pos.x, tri.b.pos.x), tri.c.pos.x),
-			bb_min_y = std::min(std::min(tri.a.pos.y, tri.b.pos.y), tri.c.pos.y),
-			bb_max_x = std::max(std::max(tri.a.pos.x, tri.b.pos.x), tri.c.pos.x),
-			bb_max_y = std::max(std::max(tri.a.pos.y, tri.b.pos.y), tri.c.pos.y);
-
-		// loop over bounding box
-		for(int y = bb_min_y; y <= bb_max_y; y++) {
-			for(int x = bb_min_x; x <= bb_max_x; x++) {
-				vec2 point(x+0.5f, y+0.5f),
-					ta(tri.a.pos), tb(tri.b.pos), tc(tri.c.pos);
-				
-				// screen space (2D) barycentric
-				vec3 s_bary = barycentric(point, ta, tb, tc);
-				
-				// discard outside fragments
-				if(s_bary.x < 0 || s_bary.y < 0 || s_bary.z < 0)
+	// every interpolated quantity (barycentric weights, z, 1/w and the varyings,
+	// which are already divided by w) is a plane f = f_a + dfdx * dx + dfdy * dy
+	// relative to vertex a. the planes are set up once per triangle and stepped with
+	// one add per pixel. the bounding box is walked in the depth buffer's tile order.
+	// without Shade only depth is interpolated and written. with Multisample the
+	// edges are tested at each sample position, pixels that are fully covered and
+	// have no edge record take the single sample path and the rest go to
+	// shade_samples
+	template <bool Shade, bool Multisample>
+	void rasterize(GOutputType& tri, const GRect& box) {
+		static constexpr int N = Shade ? FInputType::varying_count : 0;
+		static_assert(!Shade || N == VOutputType::varying_count, "vertex and fragment varyings differ");
+
+		// barycentric weights, z, 1/w, varyings
+		static constexpr int P = N + 5;
+
+		const GDepthFunc depth_func = state.depth_func;
+		const bool depth_write = state.depth_write;
+
+		GWindowDepthBuffer& depth = target->depth;
+		const int ts = GWindowDepthBuffer::tile_size;
+
+		const int bb_min_x = box.x0, bb_min_y = box.y0, bb_max_x = box.x1, bb_max_y = box.y1;
+
+		vec2 ta(tri.a.pos), tb(tri.b.pos), tc(tri.c.pos);
+
+		float area = (tb.x - ta.x) * (tc.y - ta.y) - (tb.y - ta.y) * (tc.x - ta.x);
+		if(area == 0)
+			return;
+
+		float inv_area = 1 / area;
+
+		// screen space gradients of the barycentric weights of a, b and c
+		const float lx[3] = { (tb.y - tc.y) * inv_area, (tc.y - ta.y) * inv_area, (ta.y - tb.y) * inv_area },
+			ly[3] = { (tc.x - tb.x) * inv_area, (ta.x - tc.x) * inv_area, (tb.x - ta.x) * inv_area };
+
+		float base[P], ddx[P], ddy[P];
+
+		auto setup = [&](int i, float fa, float fb, float fc) {
+			base[i] = fa;
+			ddx[i] = lx[0] * fa + lx[1] * fb + lx[2] * fc;
+			ddy[i] = ly[0] * fa + ly[1] * fb + ly[2] * fc;
+		};
+
+		setup(0, 1, 0, 0);
+		setup(1, 0, 1, 0);
+		setup(2, 0, 0, 1);
+		setup(3, tri.a.pos.z, tri.b.pos.z, tri.c.pos.z);
+		setup(4, tri.a.pos.w, tri.b.pos.w, tri.c.pos.w);
+
+		if constexpr(Shade) {
+			const float *va = tri.a.varyings(), *vb = tri.b.varyings(), *vc = tri.c.varyings();
+			for(int i = 0; i < N; i++)
+				setup(5 + i, va[i], vb[i], vc[i]);
+		}
+
+		// the barycentric weights at each sample relative to the pixel center
+		float sample_offset[msaa_samples][3];
+		for(int s = 0; s < msaa_samples; s++) {
+			for(int k = 0; k < 3; k++)
+				sample_offset[s][k] = ddx[k] * msaa_offsets[s][0] + ddy[k] * msaa_offsets[s][1];
+		}
+
+		const int all_samples = (1 << msaa_samples) - 1;
+		GSampleStore<GWindowDepthBuffer::FormatType>& store = target->sample_store;
+
+		// pixels per side of the blocks shaded at once
+		int triangle_rate = 1;
+
+		if constexpr(Shade && !Multisample) {
+			if(state.rate_threshold > 0) {
+				// the largest change of a perspective correct varying from one pixel
+				// to the next, at the centroid
+				const float *va = tri.a.varyings(), *vb = tri.b.varyings(), *vc = tri.c.varyings();
+				float w = 3 / (tri.a.pos.w + tri.b.pos.w + tri.c.pos.w), gradient = 0;
+
+				for(int i = 0; i < N; i++) {
+					float v = (va[i] + vb[i] + vc[i]) * (1 / 3.0f) * w;
+					gradient = std::max(gradient, 
+						std::max(std::abs(ddx[5 + i] - v * ddx[4]), std::abs(ddy[5 + i] - v * ddy[4])) * w);
+				}
+
+				triangle_rate = shading_rate_for(gradient, state.rate_threshold);
+			} else {
+				triangle_rate = state.shading_rate;
+			}
+		}
+
+		// a block's color, shaded at its center if the triangle covers that and at
+		// the pixel (planes f) otherwise, so nothing is extrapolated
+		auto shade_block = [&](int x, int y, int rate, const float* f) {
+			float cx = (x / rate) * rate + rate * 0.5f, cy = (y / rate) * rate + rate * 0.5f;
+			float dx = cx - ta.x, dy = cy - ta.y;
+			float g[P];
+
+			for(int i = 0; i < 3; i++)
+				g[i] = base[i] + ddx[i] * dx + ddy[i] * dy;
+
+			if(g[0] < 0 || g[1] < 0 || g[2] < 0)
+				return pack_argb(shade(x + 0.5f, y + 0.5f, f[3], f[4], f + 5));
+
+			for(int i = 3; i < P; i++)
+				g[i] = base[i] + ddx[i] * dx + ddy[i] * dy;
+
+			return pack_argb(shade(cx, cy, g[3], g[4], g + 5));
+		};
+
+		std::size_t passed = 0;
+
+		// loop over the tiles covered by the bounding box
+		for(int ty = bb_min_y / ts; ty <= bb_max_y / ts; ty++) {
+			for(int tx = bb_min_x / ts; tx <= bb_max_x / ts; tx++) {
+				auto* tile = depth.tile(tx, ty);
+
+				// rate tiles are a multiple of depth tiles, so are coarse blocks
+				int rate = triangle_rate;
+				if(Shade && !Multisample && rate_map)
+					rate = std::max(rate, rate_map->rate(tx * ts, ty * ts));
+
+				// colors of the blocks shaded so far in this tile
+				std::uint32_t block_color[(ts / 2) * (ts / 2)];
+				std::uint32_t block_done = 0;
+
+				int y0 = std::max(bb_min_y, ty * ts), y1 = std::min(bb_max_y, ty * ts + ts - 1),
+					x0 = std::max(bb_min_x, tx * ts), x1 = std::min(bb_max_x, tx * ts + ts - 1);
+
+				for(int y = y0; y <= y1; y++) {
+					// evaluate the planes at the first pixel center of the span
+					float dx = x0 + 0.5f - ta.x, dy = y + 0.5f - ta.y;
+					float f[P];
+
+					for(int i = 0; i < P; i++)
+						f[i] = base[i] + ddx[i] * dx + ddy[i] * dy;
+
+					for(int x = x0; x <= x1; x++) {
+						bool inside;
+
+						if constexpr(Multisample) {
+							int mask = 0;
+							for(int s = 0; s < msaa_samples; s++) {
+								if(f[0] + sample_offset[s][0] >= 0 && f[1] + sample_offset[s][1] >= 0 && f[2] + sample_offset[s][2] >= 0)
+									mask |= 1 << s;
+							}
+
+							inside = mask == all_samples && !store.find(y * target->width + x);
+							if(mask && !inside)
+								passed += shade_samples<P>(x, y, mask, f, ddx, ddy, tile[GWindowDepthBuffer::tile_offset(x, y)]);
+						} else {
+							inside = f[0] >= 0 && f[1] >= 0 && f[2] >= 0;
+						}
+
+						// discard outside fragments
+						if(inside) {
+							float z = f[3], inv_w = f[4];
+
+							// depth buffer test
+							bool pass = depth.test(tile[GWindowDepthBuffer::tile_offset(x, y)], 
+								z, inv_w, depth_func, depth_write);
+
+							passed += pass;
+
+							if constexpr(Shade) {
+								if(pass && rate == 1) {
+									shade_fragment(x, y, z, inv_w, f + 5);
+								} else if(pass) {
+									int b = ((y - ty * ts) / rate) * (ts / rate) + (x - tx * ts) / rate;
+
+									if(block_done & (1u << b)) {
+										stats.fragments_broadcast++;
+									} else {
+										block_color[b] = shade_block(x, y, rate, f);
+										block_done |= 1u << b;
+									}
+
+									target->color[y * target->width + x] = block_color[b];
+								}
+							}
+						}
+
+						for(int i = 0; i < P; i++)
+							f[i] += ddx[i];
+					}
+				}
+			}
+		}
+
+		if(query)
+			query->samples += passed;
+	}
+
+	// rasterize a triangle covering a handful of pixel centers
+	// only z and 1/w get planes, set up and evaluated like the general rasterizer's,
+	// so the depth written matches it and depth equal passes agree. that is all
+	// this path guarantees: the varyings of the fragments that pass are blended
+	// from the vertices with the fragment's barycentric weights and can round
+	// differently from the plane equations
+	template <bool Shade>
+	void rasterize_small(GOutputType& tri, const GRect& box) {
+		static constexpr int N = Shade ? FInputType::varying_count : 0;
+
+		GWindowDepthBuffer& depth = target->depth;
+
+		vec2 ta(tri.a.pos), tb(tri.b.pos), tc(tri.c.pos);
+
+		float area = (tb.x - ta.x) * (tc.y - ta.y) - (tb.y - ta.y) * (tc.x - ta.x);
+		if(area == 0)
+			return;
+
+		float inv_area = 1 / area;
+
+		const float lx[3] = { (tb.y - tc.y) * inv_area, (tc.y - ta.y) * inv_area, (ta.y - tb.y) * inv_area },
+			ly[3] = { (tc.x - tb.x) * inv_area, (ta.x - tc.x) * inv_area, (tb.x - ta.x) * inv_area };
+
+		const float zx = lx[0] * tri.a.pos.z + lx[1] * tri.b.pos.z + lx[2] * tri.c.pos.z,
+			zy = ly[0] * tri.a.pos.z + ly[1] * tri.b.pos.z + ly[2] * tri.c.pos.z,
+			wx = lx[0] * tri.a.pos.w + lx[1] * tri.b.pos.w + lx[2] * tri.c.pos.w,
+			wy = ly[0] * tri.a.pos.w + ly[1] * tri.b.pos.w + ly[2] * tri.c.pos.w;
+
+		std::size_t passed = 0;
+
+		for(int y = box.y0; y <= box.y1; y++) {
+			for(int x = box.x0; x <= box.x1; x++) {
+				float dx = x + 0.5f - ta.x, dy = y + 0.5f - ta.y;
+				float l0 = 1 + lx[0] * dx + ly[0] * dy,
+					l1 = lx[1] * dx + ly[1] * dy,
+					l2 = lx[2] * dx + ly[2] * dy;
+
+				if(l0 < 0 || l1 < 0 || l2 < 0)
 					continue;
 
-				// find interpolated depth at point
-				float in_w = 1 / b_interpolate(s_bary, vec3(tri.a.pos.w, tri.b.pos.w, tri.c.pos.w));
+				float z = tri.a.pos.z + zx * dx + zy * dy,
+					inv_w = tri.a.pos.w + wx * dx + wy * dy;
 
-				// depth buffer test
-				if(window.test_set_depth_buffer(x, y, in_w)) {
-					// interpolate vertex attributes
-					FInputType input;
-					input.berp(s_bary, tri.a, tri.b, tri.c, in_w);
+				auto* tile = depth.tile(x / GWindowDepthBuffer::tile_size, y / GWindowDepthBuffer::tile_size);
+				bool pass = depth.test(tile[GWindowDepthBuffer::tile_offset(x, y)], 
+					z, inv_w, state.depth_func, state.depth_write);
+				passed += pass;
 
-					window.put_pixel(x, y, context.fragment_shader(input));
+				if constexpr(Shade) {
+					if(pass) {
+						const float *va = tri.a.varyings(), *vb = tri.b.varyings(), *vc = tri.c.varyings();
+						float v[N > 0 ? N : 1];
+
+						for(int i = 0; i < N; i++)
+							v[i] = va[i] * l0 + vb[i] * l1 + vc[i] * l2;
+
+						shade_fragment(x, y, z, inv_w, v);
+					}
 				}
 			}
 		}
+
+		if(query)
+			query->samples += passed;
+	}
+
+	// the covered samples of one pixel of a multisampled target, f holds the planes
+	// at the pixel center. every covered sample is depth tested against the pixel's
+	// edge record, or against its single depth if it has none, and the fragment is
+	// shaded once at the centroid of the samples that passed, which is always inside
+	// the triangle. returns 1 if any sample passed
+	template <int P>
+	std::size_t shade_samples(int x, int y, int mask, const float* f, const float* ddx, const float* ddy,
+		GWindowDepthBuffer::value_type& stored) {
+		typedef GWindowDepthBuffer::FormatType Format;
+		typedef GSampleStore<Format> Store;
+
+		Store& store = target->sample_store;
+		int pixel = y * target->width + x;
+		typename Store::GEdgePixel* e = store.find(pixel);
+
+		GWindowDepthBuffer::value_type d[msaa_samples];
+		int pass = 0, count = 0;
+		float cx = 0, cy = 0;
+
+		for(int s = 0; s < msaa_samples; s++) {
+			if(!(mask & (1 << s)))
+				continue;
+
+			float ox = msaa_offsets[s][0], oy = msaa_offsets[s][1];
+			d[s] = Format::encode(f[3] + ddx[3] * ox + ddy[3] * oy, f[4] + ddx[4] * ox + ddy[4] * oy);
+
+			if(GWindowDepthBuffer::compare(d[s], e ? e->depth[s] : stored, state.depth_func)) {
+				pass |= 1 << s;
+				cx += ox;
+				cy += oy;
+				count++;
+			}
+		}
+
+		if(!pass)
+			return 0;
+
+		cx /= count;
+		cy /= count;
+
+		float g[P];
+		for(int i = 0; i < P; i++)
+			g[i] = f[i] + ddx[i] * cx + ddy[i] * cy;
+
+		std::uint32_t c = pack_argb(shade(x + 0.5f + cx, y + 0.5f + cy, g[3], g[4], g + 5));
+		std::uint32_t& out = target->color[pixel];
+
+		// the triangle now owns every sample, the pixel goes back to one depth
+		if(pass == (1 << msaa_samples) - 1 && state.depth_write) {
+			store.release(pixel);
+			out = c;
+			stored = Format::encode(f[3], f[4]);
+			return 1;
+		}
+
+		if(!e)
+			e = &store.split(pixel, out, stored);
+
+		Store::add_fragment(*e, pass, c, d, state.depth_write);
+		out = Store::resolve(*e);
+		stored = Store::farthest(*e);
+
+		return 1;
+	}
+
+	// run the fragment shader at a screen position, varyings are still divided by w
+	GRgba shade(float x, float y, float z, float inv_w, const float* varyings) {
+		// perspective correct varyings
+		FInputType input;
+		float w = MathType::rcp(inv_w);
+		float* out = input.varyings();
+
+		input.pos = vec4(x, y, z, inv_w);
+		for(int i = 0; i < FInputType::varying_count; i++)
+			out[i] = varyings[i] * w;
+
+		stats.fragments_shaded++;
+		return context.fragment_shader(input);
+	}
+
+	// run the fragment shader on one pixel
+	void shade_fragment(int x, int y, float z, float inv_w, const float* varyings) {
+		target->put_pixel(x, y, shade(x + 0.5f, y + 0.5f, z, inv_w, varyings));
 	}
 
 private:
 	GWindow& window;
+	GRenderTarget* target;
+
+	// vertex shader output, reused between draws
+	std::vector<VOutputType> shaded;
+
+	// world space vertices and the views that see the mesh, for multi view draws
+	std::vector<VOutputType> world;
+	std::vector<const GView*> visible_views;
+
+	// triangles that survived setup, reused between draws
+	std::vector<GSetupTriangle> setup_stream;
+
+	GOcclusionQuery* query = nullptr;
 
 public:
 	Context context;
@@ -0,0 +1,466 @@
+// this file describes post processing of finished frames
+// passes are declared as a chain and grouped into sweeps over the frame. a sweep
+// reads each row of its input once, runs all of its passes on the row while it
+// sits in a small float buffer and writes it out once, so a pass that only looks
+// at its own pixel costs no extra trip through the frame. a pass that needs the
+// finished result of the passes before it starts a new sweep. rows are handed
+// out in bands to a thread team and the kernels work on 4 pixels at a time
+
+#pragma once
+
+#include "util.hpp"
+#include "simd.hpp"
+#include "parallel.hpp"
+#include "target.hpp"
+
+namespace demo {
+
+enum class GPostKind {
+	bloom, // bright parts blurred at quarter resolution and added back
+	tone_map, // exposure and a filmic curve
+	gamma, // display encoding, applied while a sweep writes its rows
+	fxaa // blends pixels across high contrast edges
+};
+
+struct GPostPass {
+	GPostKind kind;
+	float amount; // bloom intensity, exposure or gamma
+	float threshold; // bloom brightness or fxaa contrast
+
+	static GPostPass bloom(float intensity = 0.6f, float threshold = 0.7f) {
+		return GPostPass{ GPostKind::bloom, intensity, threshold };
+	}
+
+	static GPostPass tone_map(float exposure = 1.0f) {
+		return GPostPass{ GPostKind::tone_map, exposure, 0 };
+	}
+
+	static GPostPass gamma(float gamma = 2.2f) {
+		return GPostPass{ GPostKind::gamma, gamma, 0 };
+	}
+
+	// threshold is the local contrast, relative to the brightest neighbour, an
+	// edge needs before it is smoothed
+	static GPostPass fxaa(float threshold = 0.125f) {
+		return GPostPass{ GPostKind::fxaa, 0, threshold };
+	}
+};
+
+class GPostChain {
+public:
+	void add(const GPostPass& pass) {
+		passes.push_back(pass);
+		sweeps.clear();
+	}
+
+	void clear() {
+		passes.clear();
+		sweeps.clear();
+	}
+
+	bool empty() const {
+		return passes.empty();
+	}
+
+	std::size_t sweep_count() {
+		compile();
+		return sweeps.size();
+	}
+
+	// the target's color run through the chain, the target itself is left alone
+	// so partial redraws can keep drawing into it. returns width * height ARGB8888
+	// pixels, valid until the next run
+	const std::vector<std::uint32_t>& run(const GRenderTarget& target) {
+		compile();
+
+		if(!team)
+			team.reset(new GThreadTeam(threads < 0 ? (int)std::thread::hardware_concurrency() - 1 : threads));
+
+		width = target.width;
+		height = target.height;
+
+		if(sweeps.empty()) {
+			buffers[0] = target.color;
+			return buffers[0];
+		}
+
+		const std::uint32_t* src = target.color.data();
+
+		for(std::size_t i = 0; i < sweeps.size(); i++) {
+			const GSweep& sweep = sweeps[i];
+			std::vector<std::uint32_t>& out = buffers[i & 1];
+			out.resize(width * height);
+
+			if(sweep.bloom)
+				build_bloom(src, sweep.bloom_threshold);
+
+			std::uint32_t* dst = out.data();
+			team->run(height, band_rows, [&](std::size_t begin, std::size_t end) {
+				for(std::size_t y = begin; y < end; y++)
+					run_row(sweep, src, dst, y);
+			});
+
+			src = dst;
+		}
+
+		return buffers[(sweeps.size() - 1) & 1];
+	}
+
+	// false puts every pass in a sweep of its own, to measure what fusing saves
+	bool fuse = true;
+
+	// rows of a band handed to one thread
+	int band_rows = 8;
+
+	// threads besides the caller, -1 for one per remaining core. read once, when
+	// the first run starts the team
+	int threads = -1;
+
+private:
+	static constexpr int bloom_scale = 4;
+	static constexpr int blur_radius = 4;
+
+	// passes that run over the same rows
+	struct GSweep {
+		bool fxaa = false; // the sweep reads its input through the fxaa kernel
+		float fxaa_threshold = 0;
+
+		bool bloom = false; // the bloom buffers are built from the sweep's input first
+		float bloom_threshold = 0;
+
+		std::vector<GPostPass> stages; // per pixel passes, in order
+		std::vector<std::uint8_t> gamma_table; // applied on write, empty for none
+
+		bool used() const {
+			return fxaa || bloom || !stages.empty() || !gamma_table.empty();
+		}
+	};
+
+	// per pixel passes join the open sweep unless gamma already closed it. bloom and
+	// fxaa read neighbours, so everything before them has to be finished
+	void compile() {
+		if(!sweeps.empty() || passes.empty())
+			return;
+
+		GSweep sweep;
+
+		for(const GPostPass& pass : passes) {
+			bool neighbours = pass.kind == GPostKind::bloom || pass.kind == GPostKind::fxaa;
+
+			if(sweep.used() && (neighbours || !sweep.gamma_table.empty() || !fuse)) {
+				sweeps.push_back(sweep);
+				sweep = GSweep();
+			}
+
+			switch(pass.kind) {
+			case GPostKind::bloom:
+				sweep.bloom = true;
+				sweep.bloom_threshold = pass.threshold;
+				sweep.stages.push_back(pass);
+				break;
+			case GPostKind::fxaa:
+				sweep.fxaa = true;
+				sweep.fxaa_threshold = pass.threshold;
+				break;
+			case GPostKind::tone_map:
+				sweep.stages.push_back(pass);
+				break;
+			case GPostKind::gamma:
+				sweep.gamma_table.resize(gamma_levels);
+				for(int i = 0; i < gamma_levels; i++)
+					sweep.gamma_table[i] = (std::uint8_t)(std::pow(i / (float)(gamma_levels - 1), 1 / pass.amount) * 255 + 0.5f);
+				break;
+			}
+		}
+
+		if(sweep.used())
+			sweeps.push_back(sweep);
+	}
+
+	void run_row(const GSweep& sweep, const std::uint32_t* src, std::uint32_t* dst, int y) {
+		// channels of the row in 0..1, padded to whole groups of 4
+		thread_local std::vector<float> row;
+		int padded = (width + 3) & ~3;
+		row.resize(padded * 3);
+
+		float *r = row.data(), *g = r + padded, *b = g + padded;
+
+		if(sweep.fxaa)
+			fxaa_row(src, y, sweep.fxaa_threshold, r, g, b);
+		else
+			unpack_row(src + y * width, r, g, b);
+
+		for(const GPostPass& pass : sweep.stages) {
+			if(pass.kind == GPostKind::bloom)
+				add_bloom(y, pass.amount, r, g, b);
+			else
+				tone_map(padded, pass.amount, r, g, b);
+		}
+
+		pack_row(sweep, r, g, b, dst + y * width);
+	}
+
+	// 4 pixels of p, the last group repeats the row's last pixel
+	const std::uint32_t* group(const std::uint32_t* p, int x, std::uint32_t* tail) const {
+		if(x + 4 <= width)
+			return p + x;
+
+		for(int i = 0; i < 4; i++)
+			tail[i] = p[std::min(x + i, width - 1)];
+		return tail;
+	}
+
+	void unpack_row(const std::uint32_t* p, float* r, float* g, float* b) {
+		const f32x4 scale(1 / 255.0f);
+		std::uint32_t tail[4];
+
+		for(int x = 0; x < width; x += 4) {
+			const std::uint32_t* q = group(p, x, tail);
+
+			(f32x4::unpack_channel(q, 16) * scale).store(r + x);
+			(f32x4::unpack_channel(q, 8) * scale).store(g + x);
+			(f32x4::unpack_channel(q, 0) * scale).store(b + x);
+		}
+	}
+
+	void pack_row(const GSweep& sweep, const float* r, const float* g, const float* b, std::uint32_t* out) {
+		if(!sweep.gamma_table.empty()) {
+			const std::uint8_t* table = sweep.gamma_table.data();
+			auto encode = [&](float c) { return (std::uint32_t)table[(int)(clamp(c, 0.0f, 1.0f) * (gamma_levels - 1) + 0.5f)]; };
+
+			for(int x = 0; x < width; x++)
+				out[x] = 0xff000000 | encode(r[x]) << 16 | encode(g[x]) << 8 | encode(b[x]);
+			return;
+		}
+
+		const f32x4 scale(255.0f);
+		std::uint32_t tail[4];
+
+		for(int x = 0; x < width; x += 4) {
+			bool whole = x + 4 <= width;
+			pack_argb(f32x4::load(r + x) * scale, f32x4::load(g + x) * scale, f32x4::load(b + x) * scale, whole ? out + x : tail);
+
+			if(!whole)
+				std::copy(tail, tail + (width - x), out + x);
+		}
+	}
+
+	// narkowicz's fit of the ACES filmic curve, per channel
+	static void tone_map(int n, float exposure, float* r, float* g, float* b) {
+		const f32x4 e(exposure), a(2.51f), c(0.03f), d(2.43f), f(0.59f), k(0.14f);
+
+		for(float* p : { r, g, b }) {
+			for(int x = 0; x < n; x += 4) {
+				f32x4 v = f32x4::load(p + x) * e;
+				(v * (a * v + c) * rcp(v * (d * v + f) + k)).store(p + x);
+			}
+		}
+	}
+
+	// fxaa without the search along the edge: a pixel whose neighbourhood has
+	// enough contrast is blended towards the neighbour across the edge, by how much
+	// it stands out from the average around it
+	void fxaa_row(const std::uint32_t* src, int y, float threshold, float* r, float* g, float* b) {
+		const std::uint32_t* c = src + y * width;
+		const std::uint32_t* n = src + std::max(y - 1, 0) * width;
+		const std::uint32_t* s = src + std::min(y + 1, height - 1) * width;
+
+		for(int x = 0; x < width; x += 4) {
+			if(x >= 1 && x + 5 <= width) {
+				fxaa4(c + x, n + x, s + x, c + x - 1, c + x + 1, threshold, r + x, g + x, b + x);
+				continue;
+			}
+
+			// borders repeat the edge pixels
+			std::uint32_t tm[4], tn[4], ts[4], tw[4], te[4];
+			for(int i = 0; i < 4; i++) {
+				int px = std::min(x + i, width - 1);
+				tm[i] = c[px];
+				tn[i] = n[px];
+				ts[i] = s[px];
+				tw[i] = c[std::max(px - 1, 0)];
+				te[i] = c[std::min(px + 1, width - 1)];
+			}
+
+			fxaa4(tm, tn, ts, tw, te, threshold, r + x, g + x, b + x);
+		}
+	}
+
+	static f32x4 luma(const std::uint32_t* p) {
+		return f32x4::unpack_channel(p, 16) * f32x4(0.299f)
+			+ f32x4::unpack_channel(p, 8) * f32x4(0.587f)
+			+ f32x4::unpack_channel(p, 0) * f32x4(0.114f);
+	}
+
+	static f32x4 abs(f32x4 v) {
+		return max(v, f32x4(0.0f) - v);
+	}
+
+	static void fxaa4(const std::uint32_t* m, const std::uint32_t* n, const std::uint32_t* s,
+		const std::uint32_t* w, const std::uint32_t* e, float threshold, float* r, float* g, float* b) {
+		f32x4 lm = luma(m), ln = luma(n), ls = luma(s), lw = luma(w), le = luma(e);
+
+		f32x4 lo = min(lm, min(min(ln, ls), min(lw, le))),
+			hi = max(lm, max(max(ln, ls), max(lw, le)));
+		f32x4 range = hi - lo;
+
+		// contrast below the threshold, or below 1/32 in the dark, is left alone
+		f32x4 edge = range >= max(f32x4(255.0f / 32), hi * f32x4(threshold));
+
+		// an edge running horizontally changes luma vertically
+		f32x4 horizontal = abs(ln + ls - lm - lm) >= abs(lw + le - lm - lm);
+		f32x4 l1 = select(horizontal, ln, lw), l2 = select(horizontal, ls, le);
+		f32x4 first = abs(l1 - lm) >= abs(l2 - lm);
+
+		f32x4 sub = min(abs((ln + ls + lw + le) * f32x4(0.25f) - lm) * rcp(max(range, f32x4(1.0f))), f32x4(1.0f));
+		sub = sub * sub * (f32x4(3.0f) - sub - sub);
+		f32x4 blend = select(edge, max(sub * sub * f32x4(0.75f), f32x4(0.25f)), f32x4(0.0f)) * f32x4(1 / 255.0f);
+
+		const int shifts[3] = { 16, 8, 0 };
+		float* out[3] = { r, g, b };
+
+		for(int i = 0; i < 3; i++) {
+			f32x4 cm = f32x4::unpack_channel(m, shifts[i]);
+			f32x4 across = select(horizontal,
+				select(first, f32x4::unpack_channel(n, shifts[i]), f32x4::unpack_channel(s, shifts[i])),
+				select(first, f32x4::unpack_channel(w, shifts[i]), f32x4::unpack_channel(e, shifts[i])));
+
+			(cm * f32x4(1 / 255.0f) + (across - cm) * blend).store(out[i]);
+		}
+	}
+
+	// quarter resolution planes with a border of blur_radius zeros around them
+	int bloom_stride() const {
+		return ((bloom_width + 3) & ~3) + 2 * blur_radius;
+	}
+
+	float* bloom_plane(int plane, int channel) {
+		return &bloom[(plane * 3 + channel) * bloom_stride() * (bloom_height + 2 * blur_radius)];
+	}
+
+	// bright pass and downsample, then a separable gaussian blur
+	void build_bloom(const std::uint32_t* src, float threshold) {
+		bloom_width = (width + bloom_scale - 1) / bloom_scale;
+		bloom_height = (height + bloom_scale - 1) / bloom_scale;
+
+		const int stride = bloom_stride();
+		bloom.assign(6 * stride * (bloom_height + 2 * blur_radius), 0.0f);
+
+		auto at = [&](int plane, int channel, int x, int y) {
+			return bloom_plane(plane, channel) + (y + blur_radius) * stride + x + blur_radius;
+		};
+
+		// each output pixel averages a 4x4 block, a row of the block at a time
+		team->run(bloom_height, 4, [&](std::size_t begin, std::size_t end) {
+			const f32x4 scale(1 / (255.0f * bloom_scale * bloom_scale));
+			std::uint32_t tail[4];
+
+			for(std::size_t by = begin; by < end; by++) {
+				for(int bx = 0; bx < bloom_width; bx++) {
+					f32x4 sum[3] = { 0.0f, 0.0f, 0.0f };
+
+					for(int k = 0; k < bloom_scale; k++) {
+						int y = std::min<int>(by * bloom_scale + k, height - 1);
+						const std::uint32_t* q = group(src + y * width, bx * bloom_scale, tail);
+
+						sum[0] = sum[0] + f32x4::unpack_channel(q, 16);
+						sum[1] = sum[1] + f32x4::unpack_channel(q, 8);
+						sum[2] = sum[2] + f32x4::unpack_channel(q, 0);
+					}
+
+					for(int c = 0; c < 3; c++) {
+						alignas(16) float lanes[4];
+						(sum[c] * scale).store(lanes);
+						*at(0, c, bx, by) = std::max(lanes[0] + lanes[1] + lanes[2] + lanes[3] - threshold, 0.0f);
+					}
+				}
+			}
+		});
+
+		static const float weights[2 * blur_radius + 1] = {
+			0.028f, 0.066f, 0.124f, 0.180f, 0.204f, 0.180f, 0.124f, 0.066f, 0.028f
+		};
+
+		// plane 0 -> plane 1 along rows, then back along columns
+		for(int pass = 0; pass < 2; pass++) {
+			const int step = pass == 0 ? 1 : stride;
+
+			team->run(bloom_height, 4, [&](std::size_t begin, std::size_t end) {
+				for(std::size_t y = begin; y < end; y++) {
+					for(int c = 0; c < 3; c++) {
+						const float* in = at(pass, c, 0, y);
+						float* out = at(1 - pass, c, 0, y);
+
+						for(int x = 0; x < bloom_width; x += 4) {
+							f32x4 sum(0.0f);
+							for(int k = -blur_radius; k <= blur_radius; k++)
+								sum = sum + f32x4::load(in + x + k * step) * f32x4(weights[k + blur_radius]);
+							sum.store(out + x);
+						}
+					}
+				}
+			});
+		}
+
+		// bilinear along rows to the full width, once per quarter resolution row
+		const int padded = (width + 3) & ~3;
+		bloom_rows.resize(3 * bloom_height * padded);
+
+		team->run(bloom_height, 4, [&](std::size_t begin, std::size_t end) {
+			for(std::size_t y = begin; y < end; y++) {
+				for(int c = 0; c < 3; c++) {
+					const float* in = at(0, c, 0, y);
+					float* out = &bloom_rows[(c * bloom_height + y) * padded];
+
+					for(int x = 0; x < padded; x++) {
+						float fx = (x + 0.5f) / bloom_scale - 0.5f;
+						int x0 = clamp((int)std::floor(fx), 0, bloom_width - 1), x1 = std::min(x0 + 1, bloom_width - 1);
+						fx = clamp(fx - x0, 0.0f, 1.0f);
+
+						out[x] = in[x0] + (in[x1] - in[x0]) * fx;
+					}
+				}
+			}
+		});
+	}
+
+	// the blurred planes were upsampled along rows by build_bloom, what is left is
+	// blending the two rows around y
+	void add_bloom(int y, float intensity, float* r, float* g, float* b) {
+		const int padded = (width + 3) & ~3;
+		float fy = (y + 0.5f) / bloom_scale - 0.5f;
+		int y0 = clamp((int)std::floor(fy), 0, bloom_height - 1), y1 = std::min(y0 + 1, bloom_height - 1);
+		fy = clamp(fy - y0, 0.0f, 1.0f);
+
+		float* out[3] = { r, g, b };
+
+		for(int c = 0; c < 3; c++) {
+			const float* top = &bloom_rows[(c * bloom_height + y0) * padded];
+			const float* bottom = &bloom_rows[(c * bloom_height + y1) * padded];
+
+			for(int x = 0; x < padded; x += 4) {
+				f32x4 t = f32x4::load(top + x), d = f32x4::load(bottom + x) - t;
+				(f32x4::load(out[c] + x) + (t + d * f32x4(fy)) * f32x4(intensity)).store(out[c] + x);
+			}
+		}
+	}
+
+	static constexpr int gamma_levels = 4096;
+
+	std::vector<GPostPass> passes;
+	std::vector<GSweep> sweeps;
+	std::unique_ptr<GThreadTeam> team;
+
+	int width = 0;
+	int height = 0;
+
+	// sweeps write to these in turn
+	std::vector<std::uint32_t> buffers[2];
+
+	std::vector<float> bloom;
+	std::vector<float> bloom_rows; // rows of the blurred planes at full width
+	int bloom_width = 0;
+	int bloom_height = 0;
+};
+
+}
@@ -0,0 +1,130 @@
+// this file describes coarse pixel shading rates
+// at a rate of 2 or 4 the fragment shader runs once per 2x2 or 4x4 block of a
+// triangle and the color goes to every pixel of the block that passes the depth
+// test, depth stays per pixel. a draw sets a rate in its raster state, a rate map
+// sets one per screen tile, and the rasterizer takes the coarser of the two.
+// a rate map can follow the picture: tiles whose last frame barely changed from
+// pixel to pixel are shaded coarsely in the next
+
+#pragma once
+
+#include "util.hpp"
+#include "target.hpp"
+#include "simd.hpp"
+
+namespace demo {
+
+// pixels per side of a shaded block
+static constexpr int max_shading_rate = 4;
+
+static inline bool valid_shading_rate(int rate) {
+	return rate == 1 || rate == 2 || rate == max_shading_rate;
+}
+
+// the coarsest rate whose blocks change by at most threshold across, for
+// something that changes by gradient per pixel. a block of r pixels spans r - 1
+static inline int shading_rate_for(float gradient, float threshold) {
+	if(gradient * (max_shading_rate - 1) <= threshold)
+		return max_shading_rate;
+	return gradient <= threshold ? 2 : 1;
+}
+
+class GShadingRateMap {
+public:
+	// a multiple of the depth buffer's tiles, the rasterizer looks a rate up once per depth tile
+	static constexpr int tile_size = 16;
+
+	void resize(int w, int h) {
+		width = w;
+		height = h;
+		tiles_x = (w + tile_size - 1) / tile_size;
+		tiles_y = (h + tile_size - 1) / tile_size;
+		rates.assign(tiles_x * tiles_y, 1);
+	}
+
+	void fill(int rate) {
+		if(!valid_shading_rate(rate))
+			throw std::runtime_error("shading rates are 1, 2 or 4");
+		std::fill(rates.begin(), rates.end(), rate);
+	}
+
+	void set(int tx, int ty, int rate) {
+		if(!valid_shading_rate(rate))
+			throw std::runtime_error("shading rates are 1, 2 or 4");
+		rates[ty * tiles_x + tx] = rate;
+	}
+
+	// rate at a pixel, 1 outside the map
+	int rate(int x, int y) const {
+		if(x >= width || y >= height)
+			return 1;
+		return rates[(y / tile_size) * tiles_x + x / tile_size];
+	}
+
+	// rates from a finished frame: the largest luma step between neighbouring
+	// pixels of a tile, in 0..255, is its gradient. a tile that was shaded coarsely
+	// steps by about its rate times the gradient at block borders and not at all
+	// inside, so the step is divided by the rate the tile had. resizes the map to
+	// the frame first if they differ
+	void update(const GRenderTarget& frame, float threshold) {
+		if(frame.width != width || frame.height != height)
+			resize(frame.width, frame.height);
+
+		// one row of luma at a time, against the row above in the same tile row
+		std::vector<float> above(width), row(width), steps(tiles_x);
+
+		for(int y = 0; y < height; y++) {
+			const std::uint32_t* c = &frame.color[y * width];
+
+			int x = 0;
+			for(; x + 4 <= width; x += 4) {
+				(f32x4::unpack_channel(c + x, 16) * f32x4(0.299f) + f32x4::unpack_channel(c + x, 8) * f32x4(0.587f)
+					+ f32x4::unpack_channel(c + x, 0) * f32x4(0.114f)).store(&row[x]);
+			}
+			for(; x < width; x++)
+				row[x] = ((c[x] >> 16) & 0xff) * 0.299f + ((c[x] >> 8) & 0xff) * 0.587f + (c[x] & 0xff) * 0.114f;
+
+			bool first_row = y % tile_size == 0;
+
+			for(int tx = 0; tx < tiles_x; tx++) {
+				int x0 = tx * tile_size, x1 = std::min(x0 + tile_size, width);
+				float step = steps[tx];
+
+				for(int x = x0 + 1; x < x1; x++)
+					step = std::max(step, std::abs(row[x] - row[x - 1]));
+
+				if(!first_row) {
+					for(int x = x0; x < x1; x++)
+						step = std::max(step, std::abs(row[x] - above[x]));
+				}
+
+				steps[tx] = step;
+			}
+
+			std::swap(row, above);
+
+			// the tile row is done
+			if(y % tile_size == tile_size - 1 || y == height - 1) {
+				std::uint8_t* r = &rates[(y / tile_size) * tiles_x];
+
+				for(int tx = 0; tx < tiles_x; tx++) {
+					r[tx] = shading_rate_for(steps[tx] / r[tx], threshold);
+					steps[tx] = 0;
+				}
+			}
+		}
+	}
+
+	// tiles at each rate, [0] for 1, [1] for 2 and [2] for 4
+	void count(std::size_t counts[3]) const {
+		counts[0] = counts[1] = counts[2] = 0;
+		for(std::uint8_t r : rates)
+			counts[r == 1 ? 0 : (r == 2 ? 1 : 2)]++;
+	}
+
+	int width = 0, height = 0;
+	int tiles_x = 0, tiles_y = 0;
+	std::vector<std::uint8_t> rates;
+};
+
+}
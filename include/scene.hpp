@@ -15,7 +15,15 @@ public:
 	GScene() { }
 
 	virtual void process(const SDL_Event&) { }
+
+	// called once per frame before draw. false keeps the last frame on screen and
+	// the window sleeps until the next event
+	virtual bool needs_redraw() { return true; }
+
 	virtual void draw() { }
+
+	// called after a drawn frame is on screen
+	virtual void presented() { }
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,308 @@
+// this file describes the pieces of a local render server
+// a listener on a unix socket, line based connections, a fixed pool of worker
+// threads fed from a bounded queue, and a cache that loads each asset once and
+// keeps it for every later request. what a request means is up to the program
+
+#pragma once
+
+#include "util.hpp"
+
+namespace demo {
+
+class GUnixListener {
+public:
+	// replaces a stale socket file left at path
+	GUnixListener(const std::string& path, int backlog = 64) : socket_path(path) {
+		sockaddr_un address = unix_address(path);
+
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(fd < 0)
+			throw std::runtime_error("could not create socket");
+
+		unlink(path.c_str());
+
+		if(bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(fd, backlog) != 0) {
+			::close(fd);
+			throw std::runtime_error("could not listen on " + path);
+		}
+	}
+
+	GUnixListener(const GUnixListener&) = delete;
+	GUnixListener& operator=(const GUnixListener&) = delete;
+
+	~GUnixListener() {
+		::close(fd);
+		unlink(socket_path.c_str());
+	}
+
+	// blocks until a client connects, returns its descriptor
+	int accept() {
+		while(true) {
+			int client = ::accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+			if(client >= 0)
+				return client;
+			if(errno != EINTR)
+				throw std::runtime_error("could not accept on " + socket_path);
+		}
+	}
+
+	// for poll, readable when a client is waiting to be accepted
+	int descriptor() const {
+		return fd;
+	}
+
+	static sockaddr_un unix_address(const std::string& path) {
+		sockaddr_un address{};
+		address.sun_family = AF_UNIX;
+
+		if(path.size() >= sizeof(address.sun_path))
+			throw std::runtime_error("socket path too long: " + path);
+
+		std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+		return address;
+	}
+
+private:
+	std::string socket_path;
+	int fd;
+};
+
+// one end of a stream socket, read a line at a time, closed with the object
+class GConnection {
+public:
+	GConnection(int socket_fd) : fd(socket_fd) { }
+
+	// connect to a GUnixListener
+	GConnection(const std::string& path) {
+		sockaddr_un address = GUnixListener::unix_address(path);
+
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+			if(fd >= 0)
+				::close(fd);
+			throw std::runtime_error("could not connect to " + path);
+		}
+	}
+
+	GConnection(const GConnection&) = delete;
+	GConnection& operator=(const GConnection&) = delete;
+
+	~GConnection() {
+		::close(fd);
+	}
+
+	// without the newline. false once the other end closed the connection
+	bool read_line(std::string& line) {
+		while(!buffered_line(line)) {
+			if(!receive())
+				return false;
+		}
+
+		return true;
+	}
+
+	// a line that was already received, without reading. false if there is none
+	bool buffered_line(std::string& line) {
+		auto newline = std::find(buffer.begin(), buffer.end(), '\n');
+		if(newline == buffer.end())
+			return false;
+
+		line.assign(buffer.begin(), newline);
+		buffer.erase(buffer.begin(), newline + 1);
+		return true;
+	}
+
+	// buffers whatever arrived, waiting for something if nothing did. false once
+	// the other end closed the connection
+	bool receive() {
+		char chunk[4096];
+		ssize_t n;
+
+		do {
+			n = ::read(fd, chunk, sizeof(chunk));
+		} while(n < 0 && errno == EINTR);
+
+		if(n <= 0)
+			return false;
+
+		buffer.insert(buffer.end(), chunk, chunk + n);
+		return true;
+	}
+
+	// false if the connection closed first
+	bool read(void* data, std::size_t size) {
+		char* p = (char*)data;
+
+		while(size > 0) {
+			if(buffer.empty() && !receive())
+				return false;
+
+			std::size_t n = std::min(size, buffer.size());
+			std::memcpy(p, buffer.data(), n);
+			buffer.erase(buffer.begin(), buffer.begin() + n);
+			p += n;
+			size -= n;
+		}
+
+		return true;
+	}
+
+	// false if the other end went away
+	bool write(const void* data, std::size_t size) {
+		const char* p = (const char*)data;
+
+		while(size > 0) {
+			ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+			if(n < 0 && errno == EINTR)
+				continue;
+			if(n <= 0)
+				return false;
+
+			p += n;
+			size -= n;
+		}
+
+		return true;
+	}
+
+	bool write(const std::string& s) {
+		return write(s.data(), s.size());
+	}
+
+	// bytes received and not read yet
+	std::size_t buffered() const {
+		return buffer.size();
+	}
+
+	int descriptor() const {
+		return fd;
+	}
+
+private:
+	int fd;
+	std::vector<char> buffer;
+};
+
+// a fixed number of threads taking jobs from a queue of at most `capacity`
+// waiting jobs. the handler gets the index of the thread running it, so each
+// thread can keep state of its own
+template <class Job>
+class GWorkerPool {
+public:
+	typedef std::function<void(int, Job&)> Handler;
+
+	GWorkerPool(int threads, std::size_t capacity, Handler h) :
+		queue_capacity(capacity),
+		handler(h) {
+		for(int i = 0; i < threads; i++)
+			workers.emplace_back([this, i]() { work(i); });
+	}
+
+	GWorkerPool(const GWorkerPool&) = delete;
+	GWorkerPool& operator=(const GWorkerPool&) = delete;
+
+	// finishes the queued jobs first
+	~GWorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+		}
+
+		wake.notify_all();
+		for(std::thread& t : workers)
+			t.join();
+	}
+
+	// false if the queue is full, the job is left with the caller
+	bool try_push(Job& job) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(jobs.size() >= queue_capacity)
+				return false;
+			jobs.push_back(std::move(job));
+		}
+
+		wake.notify_one();
+		return true;
+	}
+
+	int size() const {
+		return workers.size();
+	}
+
+private:
+	void work(int index) {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while(true) {
+			wake.wait(lock, [this]() { return !running || !jobs.empty(); });
+			if(jobs.empty())
+				return;
+
+			Job job = std::move(jobs.front());
+			jobs.pop_front();
+
+			lock.unlock();
+			handler(index, job);
+			lock.lock();
+		}
+	}
+
+	std::size_t queue_capacity;
+	Handler handler;
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Job> jobs;
+	bool running = true;
+};
+
+// assets by name, loaded by the first request that needs them and shared by all
+// later ones. loads run one at a time, lookups of loaded assets only take a lock
+template <typename T>
+class GAssetCache {
+public:
+	typedef std::function<std::shared_ptr<const T>(const std::string&)> Loader;
+
+	GAssetCache(Loader l) : loader(l) { }
+
+	// throws whatever the loader throws, the next get tries again
+	std::shared_ptr<const T> get(const std::string& name) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = assets.find(name);
+			if(it != assets.end())
+				return it->second;
+		}
+
+		std::lock_guard<std::mutex> load_lock(load_mutex);
+
+		// another thread may have loaded it while this one waited
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = assets.find(name);
+			if(it != assets.end())
+				return it->second;
+		}
+
+		std::shared_ptr<const T> asset = loader(name);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		assets[name] = asset;
+		return asset;
+	}
+
+	std::size_t size() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return assets.size();
+	}
+
+private:
+	Loader loader;
+	std::mutex mutex;
+	std::mutex load_mutex;
+	std::map<std::string, std::shared_ptr<const T>> assets;
+};
+
+}
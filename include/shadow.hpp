@@ -0,0 +1,119 @@
+// this file describes shadow maps
+// a shadow map is a depth only render target drawn from the light's point of view
+// with a depth only pipeline. shaders look points up in it to find out if something
+// sits between them and the light
+
+#pragma once
+
+#include "util.hpp"
+#include "context.hpp"
+#include "target.hpp"
+
+namespace demo {
+
+class GShadowMap {
+public:
+	typedef GWindowDepthBuffer::FormatType Format;
+
+	GShadowMap(int size) : target(size, size, false) { }
+
+	// perspective projection from eye towards center
+	void look_at(vec3 eye, vec3 center, float fov, float near, float far) {
+		vec3 dir = normalize(center - eye);
+		vec3 up = std::fabs(dir.y) > 0.99f ? vec3(0, 0, 1) : vec3(0, 1, 0);
+
+		view = lookAt(eye, center, up);
+		projection = perspective(fov, 1.0f, near, far);
+		view_projection = projection * view;
+	}
+
+	void clear() {
+		target.depth.clear();
+	}
+
+	// 1 if the world space point is lit, 0 if something is closer to the light.
+	// the point is pushed out along its normal so surfaces do not shadow themselves
+	float visibility(const vec3& world_pos, const vec3& world_normal) const {
+		vec4 p = view_projection * vec4(world_pos + world_normal * normal_bias, 1);
+
+		// behind the light
+		if(p.w <= 0)
+			return 1;
+
+		float inv_w = 1 / p.w;
+		float x = ((p.x * inv_w + 1) * target.width) / 2,
+			y = ((-p.y * inv_w + 1) * target.height) / 2;
+
+		// outside of the map counts as lit
+		if(x < 0 || y < 0 || x >= target.width || y >= target.height)
+			return 1;
+
+		Format::value_type stored = target.depth.get(x, y);
+		Format::value_type d = Format::encode(p.z * inv_w, inv_w);
+
+		return Format::closer(stored, d) ? 0 : 1;
+	}
+
+	GRenderTarget target;
+
+	mat4x4 view;
+	mat4x4 projection;
+	mat4x4 view_projection;
+
+	// world units
+	float normal_bias = 0.05f;
+};
+
+// transforms positions into the light's clip space, other attributes are unused
+template <class V>
+class GShadowVertexShader : public GShader<V, V> {
+public:
+	GShadowVertexShader(GWindow& win) : GShader<V, V>(win) { }
+
+	V operator()(const V& v) {
+		V out = v;
+		out.pos = model_view_projection * v.pos;
+		return out;
+	}
+
+	void update() { }
+
+	// for multi view draws, one per cascade
+	V shade_world(const V& v) {
+		V out = v;
+		out.pos = model * v.pos;
+		return out;
+	}
+
+	const mat4x4& get_model() const {
+		return model;
+	}
+
+	void set_view_projection(const mat4x4& vp) {
+		view_projection = vp;
+		set_model(model);
+	}
+
+	void set_model(const mat4x4& m) {
+		model = m;
+		model_view_projection = view_projection * model;
+	}
+
+	mat4x4 clip_matrix() {
+		return model_view_projection;
+	}
+
+private:
+	mat4x4 view_projection{ 1 };
+	mat4x4 model{ 1 };
+	mat4x4 model_view_projection{ 1 };
+};
+
+// context for pipelines that render shadow maps, use it with depth only raster state
+template <class V>
+using GShadowContext = GContext<
+	GShadowVertexShader<V>,
+	GPassthroughGeometryShader<V>,
+	GNullFragmentShader<V>>;
+
+}
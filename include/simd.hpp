@@ -0,0 +1,155 @@
+// this file describes a small 4 wide float vector
+// it maps to SSE where available and to plain arrays otherwise.
+// comparisons return lane masks (all bits set or clear) like the SSE intrinsics do
+
+#pragma once
+
+#include "util.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DEMO_SIMD_SSE
+#endif
+
+namespace demo {
+
+struct f32x4 {
+#ifdef DEMO_SIMD_SSE
+	__m128 v;
+
+	f32x4() { }
+	f32x4(__m128 x) : v(x) { }
+	f32x4(float s) : v(_mm_set1_ps(s)) { }
+
+	static f32x4 load(const float* p) { return _mm_loadu_ps(p); }
+	void store(float* p) const { _mm_storeu_ps(p, v); }
+
+	friend f32x4 operator+(f32x4 a, f32x4 b) { return _mm_add_ps(a.v, b.v); }
+	friend f32x4 operator-(f32x4 a, f32x4 b) { return _mm_sub_ps(a.v, b.v); }
+	friend f32x4 operator*(f32x4 a, f32x4 b) { return _mm_mul_ps(a.v, b.v); }
+	friend f32x4 operator/(f32x4 a, f32x4 b) { return _mm_div_ps(a.v, b.v); }
+	friend f32x4 operator&(f32x4 a, f32x4 b) { return _mm_and_ps(a.v, b.v); }
+	friend f32x4 operator|(f32x4 a, f32x4 b) { return _mm_or_ps(a.v, b.v); }
+
+	friend f32x4 operator<(f32x4 a, f32x4 b) { return _mm_cmplt_ps(a.v, b.v); }
+	friend f32x4 operator>(f32x4 a, f32x4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+	friend f32x4 operator<=(f32x4 a, f32x4 b) { return _mm_cmple_ps(a.v, b.v); }
+	friend f32x4 operator>=(f32x4 a, f32x4 b) { return _mm_cmpge_ps(a.v, b.v); }
+
+	friend f32x4 min(f32x4 a, f32x4 b) { return _mm_min_ps(a.v, b.v); }
+	friend f32x4 max(f32x4 a, f32x4 b) { return _mm_max_ps(a.v, b.v); }
+	friend f32x4 sqrt(f32x4 a) { return _mm_sqrt_ps(a.v); }
+
+	// 1 / a and 1 / sqrt(a) from the 12 bit estimates refined by a newton step,
+	// about 22 bits. a has to be finite and above 0 (any nonzero a for rcp)
+	friend f32x4 rcp(f32x4 a) {
+		__m128 r = _mm_rcp_ps(a.v);
+		return _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(2.0f), _mm_mul_ps(a.v, r)));
+	}
+
+	friend f32x4 rsqrt(f32x4 a) {
+		__m128 r = _mm_rsqrt_ps(a.v);
+		__m128 arr = _mm_mul_ps(_mm_mul_ps(a.v, r), r);
+		return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r), _mm_sub_ps(_mm_set1_ps(3.0f), arr));
+	}
+
+	// mask ? a : b
+	friend f32x4 select(f32x4 mask, f32x4 a, f32x4 b) {
+		return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+	}
+
+	// one bit per lane, from the lane's sign bit
+	friend int movemask(f32x4 a) { return _mm_movemask_ps(a.v); }
+
+	// the 8 bit channel at bit `shift` of 4 packed pixels, as 0..255
+	static f32x4 unpack_channel(const std::uint32_t* p, int shift) {
+		__m128i v = _mm_srl_epi32(_mm_loadu_si128((const __m128i*)p), _mm_cvtsi32_si128(shift));
+		return _mm_cvtepi32_ps(_mm_and_si128(v, _mm_set1_epi32(0xff)));
+	}
+
+	// 4 ARGB8888 pixels from channels in 0..255, rounded and clamped. alpha is 255
+	friend void pack_argb(f32x4 r, f32x4 g, f32x4 b, std::uint32_t* out) {
+		auto q = [](f32x4 c) { return _mm_cvtps_epi32(min(max(c, f32x4(0.0f)), f32x4(255.0f)).v); };
+		__m128i v = _mm_or_si128(_mm_slli_epi32(q(r), 16), _mm_or_si128(_mm_slli_epi32(q(g), 8), q(b)));
+
+		_mm_storeu_si128((__m128i*)out, _mm_or_si128(v, _mm_set1_epi32((int)0xff000000)));
+	}
+#else
+	float v[4];
+
+	f32x4() { }
+	f32x4(float s) { for(int i = 0; i < 4; i++) v[i] = s; }
+
+	static f32x4 load(const float* p) { f32x4 r; std::memcpy(r.v, p, sizeof(r.v)); return r; }
+	void store(float* p) const { std::memcpy(p, v, sizeof(v)); }
+
+	template <typename F>
+	static f32x4 map(f32x4 a, f32x4 b, F f) {
+		f32x4 r;
+		for(int i = 0; i < 4; i++) r.v[i] = f(a.v[i], b.v[i]);
+		return r;
+	}
+
+	static float mask(bool b) {
+		std::uint32_t bits = b ? 0xffffffff : 0;
+		float f;
+		std::memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+
+	static std::uint32_t bits(float f) {
+		std::uint32_t b;
+		std::memcpy(&b, &f, sizeof(b));
+		return b;
+	}
+
+	static float from_bits(std::uint32_t b) {
+		float f;
+		std::memcpy(&f, &b, sizeof(f));
+		return f;
+	}
+
+	friend f32x4 operator+(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return x + y; }); }
+	friend f32x4 operator-(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return x - y; }); }
+	friend f32x4 operator*(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return x * y; }); }
+	friend f32x4 operator/(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return x / y; }); }
+	friend f32x4 operator&(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return from_bits(bits(x) & bits(y)); }); }
+	friend f32x4 operator|(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return from_bits(bits(x) | bits(y)); }); }
+
+	friend f32x4 operator<(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return mask(x < y); }); }
+	friend f32x4 operator>(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return mask(x > y); }); }
+	friend f32x4 operator<=(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return mask(x <= y); }); }
+	friend f32x4 operator>=(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return mask(x >= y); }); }
+
+	friend f32x4 min(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return x < y ? x : y; }); }
+	friend f32x4 max(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return x > y ? x : y; }); }
+	friend f32x4 sqrt(f32x4 a) { return map(a, a, [](float x, float) { return std::sqrt(x); }); }
+	friend f32x4 rcp(f32x4 a) { return map(a, a, [](float x, float) { return 1 / x; }); }
+	friend f32x4 rsqrt(f32x4 a) { return map(a, a, [](float x, float) { return 1 / std::sqrt(x); }); }
+
+	friend f32x4 select(f32x4 mask, f32x4 a, f32x4 b) {
+		f32x4 r;
+		for(int i = 0; i < 4; i++) r.v[i] = bits(mask.v[i]) ? a.v[i] : b.v[i];
+		return r;
+	}
+
+	friend int movemask(f32x4 a) {
+		int m = 0;
+		for(int i = 0; i < 4; i++) m |= (bits(a.v[i]) >> 31) << i;
+		return m;
+	}
+
+	static f32x4 unpack_channel(const std::uint32_t* p, int shift) {
+		f32x4 r;
+		for(int i = 0; i < 4; i++) r.v[i] = (p[i] >> shift) & 0xff;
+		return r;
+	}
+
+	friend void pack_argb(f32x4 r, f32x4 g, f32x4 b, std::uint32_t* out) {
+		auto q = [](float c) { return (std::uint32_t)std::lrint(c < 0 ? 0 : (c > 255 ? 255 : c)); };
+		for(int i = 0; i < 4; i++) out[i] = 0xff000000 | q(r.v[i]) << 16 | q(g.v[i]) << 8 | q(b.v[i]);
+	}
+#endif
+};
+
+}
@@ -0,0 +1,148 @@
+// this file describes the simulation thread
+// input and scene updates run on their own thread with a fixed time step, so they do
+// not depend on the frame rate. every step that changes the state publishes an
+// immutable snapshot and the render loop picks up the newest one right before it
+// draws. SDL only pumps events on the main thread, the window still polls them and
+// the scene forwards them here
+
+#pragma once
+
+#include "util.hpp"
+
+namespace demo {
+
+template <typename State>
+struct GSnapshot {
+	State state;
+	std::uint64_t tick = 0;
+
+	// SDL_GetTicks time of the oldest input event in this snapshot that no
+	// presented frame has shown yet. input_id changes every time new input went in
+	std::uint32_t input_time = 0;
+	std::uint64_t input_id = 0;
+};
+
+template <typename State>
+class GSimulation {
+public:
+	typedef GSnapshot<State> SnapshotType;
+
+	// advances the state by dt seconds, events are the ones pushed since the last
+	// step. returns false if the state did not change
+	typedef std::function<bool(State&, const std::vector<SDL_Event>&, float)> StepFunction;
+
+	GSimulation() { }
+	GSimulation(const GSimulation&) = delete;
+	GSimulation& operator=(const GSimulation&) = delete;
+
+	~GSimulation() {
+		stop();
+	}
+
+	void start(const State& initial, StepFunction f, float rate = 120) {
+		stop();
+
+		SnapshotType s;
+		s.state = initial;
+		std::atomic_store(&snapshot, std::make_shared<const SnapshotType>(s));
+
+		step = f;
+		dt = 1 / rate;
+		running = true;
+		thread = std::thread([this]() { loop(); });
+	}
+
+	void stop() {
+		running = false;
+		if(thread.joinable())
+			thread.join();
+	}
+
+	// any thread
+	void push(const SDL_Event& event) {
+		std::lock_guard<std::mutex> lock(mutex);
+		events.push_back(event);
+	}
+
+	// newest published state, never null after start
+	std::shared_ptr<const SnapshotType> latest() const {
+		return std::atomic_load(&snapshot);
+	}
+
+	// render thread, once a frame drawn from the snapshot with this input_id is
+	// on screen. input up to it no longer counts as waiting
+	void presented(std::uint64_t input_id) {
+		presented_input = input_id;
+	}
+
+	// called on the simulation thread after a snapshot was published
+	std::function<void()> on_publish;
+
+private:
+	void loop() {
+		typedef std::chrono::steady_clock clock;
+
+		const auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(dt));
+		auto next = clock::now();
+
+		SnapshotType current = *latest();
+		std::vector<SDL_Event> batch;
+
+		// input_id and time of the batches no presented frame has shown yet
+		std::deque<std::pair<std::uint64_t, std::uint32_t>> waiting;
+
+		while(running) {
+			batch.clear();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				batch.swap(events);
+			}
+
+			bool changed = step(current.state, batch, dt);
+			current.tick++;
+
+			if(!batch.empty()) {
+				current.input_id++;
+				waiting.emplace_back(current.input_id, batch.front().common.timestamp);
+				changed = true;
+			}
+
+			// several steps can publish before the render loop takes a snapshot, the
+			// latency counts from the oldest input still waiting
+			std::uint64_t shown = presented_input;
+			while(!waiting.empty() && waiting.front().first <= shown)
+				waiting.pop_front();
+
+			if(!waiting.empty())
+				current.input_time = waiting.front().second;
+
+			if(changed) {
+				std::atomic_store(&snapshot, std::make_shared<const SnapshotType>(current));
+				if(on_publish)
+					on_publish();
+			}
+
+			// after a stall skip the missed steps instead of running them back to back
+			next += period;
+			if(clock::now() > next + period * 4)
+				next = clock::now();
+
+			std::this_thread::sleep_until(next);
+		}
+	}
+
+	StepFunction step;
+	float dt = 1.0f / 120;
+
+	std::atomic<bool> running{ false };
+	std::thread thread;
+
+	std::mutex mutex;
+	std::vector<SDL_Event> events;
+
+	std::atomic<std::uint64_t> presented_input{ 0 };
+
+	std::shared_ptr<const SnapshotType> snapshot;
+};
+
+}
@@ -0,0 +1,302 @@
+// this file describes skeletal animation on the cpu
+// a skeleton is a hierarchy of joints and a clip holds keyframes for them.
+// sampling a clip gives every joint's transform relative to its parent, a pose
+// turns those into one skinning matrix per joint, and a skinned mesh blends up to
+// four of those matrices per vertex to move its bind pose vertices into place.
+// the skinned vertices are an ordinary GMesh, the vertex stage does not know
+// they were animated
+
+#pragma once
+
+#include "util.hpp"
+#include "simd.hpp"
+#include "parallel.hpp"
+
+namespace demo {
+
+struct GJoint {
+	int parent; // -1 for a root, parents come before their children
+	mat4x4 local; // bind pose transform relative to the parent
+	mat4x4 inverse_bind; // model space -> joint space in the bind pose
+};
+
+class GSkeleton {
+public:
+	// global is the joint's bind pose transform in model space
+	int add_joint(int parent, const mat4x4& global) {
+		if(parent >= (int)joints.size())
+			throw std::runtime_error("a joint's parent has to be added before it");
+
+		mat4x4 local = parent < 0 ? global : joints[parent].inverse_bind * global;
+		joints.push_back(GJoint{ parent, local, inverse(global) });
+
+		return joints.size() - 1;
+	}
+
+	std::vector<GJoint> joints;
+};
+
+struct GJointKey {
+	float time;
+	vec3 translation;
+	quat rotation;
+	vec3 scale;
+
+	mat4x4 matrix() const {
+		return glm::scale(translate(mat4x4(1), translation) * mat4_cast(rotation), scale);
+	}
+};
+
+class GAnimationClip {
+public:
+	GAnimationClip(float length = 0, std::size_t joint_count = 0) :
+		duration(length),
+		channels(joint_count) { }
+
+	// keys are kept in time order
+	void add_key(int joint, const GJointKey& key) {
+		std::vector<GJointKey>& keys = channels.at(joint);
+		auto it = std::upper_bound(keys.begin(), keys.end(), key.time,
+			[](float t, const GJointKey& k) { return t < k.time; });
+
+		keys.insert(it, key);
+	}
+
+	// every joint's transform relative to its parent at `time`, which wraps around
+	// the clip. between keys translation and scale are interpolated linearly and
+	// rotation spherically, before the first and after the last key the nearest
+	// key holds. joints without keys stay in their bind pose
+	void sample(const GSkeleton& skeleton, float time, std::vector<mat4x4>& local) const {
+		if(duration > 0) {
+			time = std::fmod(time, duration);
+			if(time < 0)
+				time += duration;
+		}
+
+		local.resize(skeleton.joints.size());
+
+		for(std::size_t j = 0; j < local.size(); j++) {
+			if(j >= channels.size() || channels[j].empty()) {
+				local[j] = skeleton.joints[j].local;
+				continue;
+			}
+
+			const std::vector<GJointKey>& keys = channels[j];
+			auto next = std::upper_bound(keys.begin(), keys.end(), time,
+				[](float t, const GJointKey& k) { return t < k.time; });
+
+			if(next == keys.begin()) {
+				local[j] = keys.front().matrix();
+			} else if(next == keys.end()) {
+				local[j] = keys.back().matrix();
+			} else {
+				const GJointKey& a = *(next - 1);
+				const GJointKey& b = *next;
+				float t = (time - a.time) / (b.time - a.time);
+
+				GJointKey k{ time,
+					mix(a.translation, b.translation, t),
+					slerp(a.rotation, b.rotation, t),
+					mix(a.scale, b.scale, t) };
+
+				local[j] = k.matrix();
+			}
+		}
+	}
+
+	float duration;
+	std::vector<std::vector<GJointKey>> channels; // keys per joint
+};
+
+// the joint matrices of a skeleton at one moment
+class GPose {
+public:
+	void evaluate(const GSkeleton& skeleton, const GAnimationClip& clip, float time) {
+		clip.sample(skeleton, time, local);
+		update(skeleton);
+	}
+
+	// global and skinning matrices from the local ones
+	void update(const GSkeleton& skeleton) {
+		global.resize(local.size());
+		skinning.resize(local.size());
+
+		for(std::size_t j = 0; j < local.size(); j++) {
+			int parent = skeleton.joints[j].parent;
+
+			global[j] = parent < 0 ? local[j] : global[parent] * local[j];
+			skinning[j] = global[j] * skeleton.joints[j].inverse_bind;
+		}
+	}
+
+	std::vector<mat4x4> local; // relative to the parent
+	std::vector<mat4x4> global; // joint space -> model space
+	std::vector<mat4x4> skinning; // bind pose model space -> posed model space
+};
+
+// a bind pose vertex and the joints that move it. weights are sorted from the
+// largest down and sum to 1, unused slots have weight 0
+struct GSkinVertex {
+	vec3 pos;
+	vec3 normal;
+	std::uint8_t joints[4];
+	float weights[4];
+};
+
+// T needs a vec4 pos and a vec3 normal, the other attributes are left alone
+template <typename T>
+class GSkinnedMesh {
+public:
+	// bind has one entry per vertex of the mesh, its weights are normalized here
+	GSkinnedMesh(const GMesh<T>& m, std::vector<GSkinVertex> b) :
+		mesh(m),
+		bind(std::move(b)) {
+		if(bind.size() != mesh.vertices.size())
+			throw std::runtime_error("skinned mesh needs one bind vertex per vertex");
+
+		for(GSkinVertex& v : bind) {
+			// largest weight first, so the kernel can stop at the first 0
+			for(int i = 1; i < 4; i++) {
+				for(int k = i; k > 0 && v.weights[k] > v.weights[k - 1]; k--) {
+					std::swap(v.weights[k], v.weights[k - 1]);
+					std::swap(v.joints[k], v.joints[k - 1]);
+				}
+			}
+
+			float sum = v.weights[0] + v.weights[1] + v.weights[2] + v.weights[3];
+			if(sum <= 0)
+				throw std::runtime_error("skinned vertex without weights");
+
+			for(int i = 0; i < 4; i++) {
+				v.weights[i] /= sum;
+
+				if(v.weights[i] > 0) {
+					GBounds& b = bounds_of(v.joints[i]);
+					b.min = glm::min(b.min, v.pos);
+					b.max = glm::max(b.max, v.pos);
+				}
+			}
+		}
+	}
+
+	// move the vertices into the pose. ranges of vertices are skinned four
+	// matrix columns at a time on the team's threads, or on this one without a team
+	void skin(const std::vector<mat4x4>& skinning, GThreadTeam* team = nullptr) {
+		check(skinning);
+
+		if(team)
+			team->run(bind.size(), grain, [&](std::size_t begin, std::size_t end) { skin_range(skinning.data(), begin, end); });
+		else
+			skin_range(skinning.data(), 0, bind.size());
+
+		update_bounds(skinning);
+	}
+
+	// one vertex at a time with glm, to check skin against
+	void skin_reference(const std::vector<mat4x4>& skinning) {
+		check(skinning);
+
+		for(std::size_t i = 0; i < bind.size(); i++) {
+			const GSkinVertex& s = bind[i];
+			mat4x4 m = skinning[s.joints[0]] * s.weights[0];
+
+			for(int k = 1; k < 4 && s.weights[k] > 0; k++)
+				m = m + skinning[s.joints[k]] * s.weights[k];
+
+			mesh.vertices[i].pos = m * vec4(s.pos, 1);
+			mesh.vertices[i].normal = vec3(m * vec4(s.normal, 0));
+		}
+
+		update_bounds(skinning);
+	}
+
+	std::size_t vertex_count() const {
+		return bind.size();
+	}
+
+	// the posed vertices, for the pipeline
+	GMesh<T> mesh;
+
+	std::vector<GSkinVertex> bind;
+
+private:
+	// vertices per range handed to a thread
+	static constexpr std::size_t grain = 2048;
+
+	GBounds& bounds_of(int joint) {
+		if(joint >= (int)joint_bounds.size())
+			joint_bounds.resize(joint + 1);
+		return joint_bounds[joint];
+	}
+
+	void check(const std::vector<mat4x4>& skinning) const {
+		if(skinning.size() < joint_bounds.size())
+			throw std::runtime_error("pose has fewer joints than the skinned mesh uses");
+	}
+
+	// glm matrices are column major, column c of joint j is at &m[j][c].x
+	void skin_range(const mat4x4* m, std::size_t begin, std::size_t end) {
+		for(std::size_t i = begin; i < end; i++) {
+			const GSkinVertex& s = bind[i];
+
+			const float* j = &m[s.joints[0]][0].x;
+			f32x4 w(s.weights[0]);
+			f32x4 c0 = f32x4::load(j) * w, c1 = f32x4::load(j + 4) * w,
+				c2 = f32x4::load(j + 8) * w, c3 = f32x4::load(j + 12) * w;
+
+			for(int k = 1; k < 4 && s.weights[k] > 0; k++) {
+				j = &m[s.joints[k]][0].x;
+				w = f32x4(s.weights[k]);
+
+				c0 = c0 + f32x4::load(j) * w;
+				c1 = c1 + f32x4::load(j + 4) * w;
+				c2 = c2 + f32x4::load(j + 8) * w;
+				c3 = c3 + f32x4::load(j + 12) * w;
+			}
+
+			f32x4 p = c0 * f32x4(s.pos.x) + c1 * f32x4(s.pos.y) + c2 * f32x4(s.pos.z) + c3,
+				n = c0 * f32x4(s.normal.x) + c1 * f32x4(s.normal.y) + c2 * f32x4(s.normal.z);
+
+			alignas(16) float out[8];
+			p.store(out);
+			n.store(out + 4);
+
+			T& v = mesh.vertices[i];
+			v.pos = vec4(out[0], out[1], out[2], out[3]);
+			v.normal = vec3(out[4], out[5], out[6]);
+		}
+	}
+
+	// every skinned position is a weighted average of the bind position moved by
+	// each of its joints, so it lies inside the union of the joints' moved boxes
+	void update_bounds(const std::vector<mat4x4>& skinning) {
+		GBounds& b = mesh.bounds;
+		b.min = vec3(INFINITY);
+		b.max = vec3(-INFINITY);
+
+		for(std::size_t j = 0; j < joint_bounds.size(); j++) {
+			const GBounds& jb = joint_bounds[j];
+			if(jb.min.x > jb.max.x)
+				continue;
+
+			for(int i = 0; i < 8; i++) {
+				vec3 corner(
+					(i & 1) ? jb.max.x : jb.min.x,
+					(i & 2) ? jb.max.y : jb.min.y,
+					(i & 4) ? jb.max.z : jb.min.z);
+				vec3 p = vec3(skinning[j] * vec4(corner, 1));
+
+				b.min = glm::min(b.min, p);
+				b.max = glm::max(b.max, p);
+			}
+		}
+
+		b.center = (b.min + b.max) * 0.5f;
+		b.radius = length(b.max - b.center);
+	}
+
+	// bind pose box of the vertices each joint moves
+	std::vector<GBounds> joint_bounds;
+};
+
+}
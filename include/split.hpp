@@ -0,0 +1,437 @@
+// this file describes sort-first rendering across processes
+// a coordinator splits the frame into horizontal bands, one per worker process.
+// the workers map the same mesh files instead of loading the meshes themselves,
+// each renders its band with a scissor and writes the pixels into a frame buffer
+// in shared memory. band heights follow the time each worker took last frame, so
+// a band full of geometry shrinks and an empty one grows
+
+#pragma once
+
+#include "util.hpp"
+
+namespace demo {
+
+// a named POSIX shared memory object, removed again by the process that created it
+class GSharedMemory {
+public:
+	GSharedMemory() { }
+
+	GSharedMemory(const GSharedMemory&) = delete;
+	GSharedMemory& operator=(const GSharedMemory&) = delete;
+
+	~GSharedMemory() {
+		if(memory)
+			munmap(memory, memory_size);
+
+		if(owner)
+			shm_unlink(memory_name.c_str());
+	}
+
+	void create(const std::string& name, std::size_t size) {
+		int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if(fd < 0)
+			throw std::runtime_error("could not create shared memory " + name);
+
+		owner = true;
+		memory_name = name;
+
+		if(ftruncate(fd, size) != 0) {
+			::close(fd);
+			throw std::runtime_error("could not size shared memory " + name);
+		}
+
+		map(fd, size);
+	}
+
+	void open(const std::string& name) {
+		int fd = shm_open(name.c_str(), O_RDWR, 0600);
+		if(fd < 0)
+			throw std::runtime_error("could not open shared memory " + name);
+
+		memory_name = name;
+
+		struct stat st;
+		if(fstat(fd, &st) != 0) {
+			::close(fd);
+			throw std::runtime_error("could not open shared memory " + name);
+		}
+
+		map(fd, st.st_size);
+	}
+
+	void* data() const {
+		return memory;
+	}
+
+	std::size_t size() const {
+		return memory_size;
+	}
+
+private:
+	void map(int fd, std::size_t size) {
+		void* m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+
+		if(m == MAP_FAILED)
+			throw std::runtime_error("could not map shared memory " + memory_name);
+
+		memory = m;
+		memory_size = size;
+	}
+
+	void* memory = nullptr;
+	std::size_t memory_size = 0;
+	std::string memory_name;
+	bool owner = false;
+};
+
+// read only view of an array somebody else owns
+template <typename T>
+struct GArrayView {
+	const T* data = nullptr;
+	std::size_t count = 0;
+
+	std::size_t size() const { return count; }
+	const T& operator[](std::size_t i) const { return data[i]; }
+	const T* begin() const { return data; }
+	const T* end() const { return data + count; }
+};
+
+struct GMeshFileHeader {
+	std::uint32_t magic;
+	std::uint32_t version;
+	std::uint32_t vertex_size;
+	std::uint32_t vertex_count;
+	std::uint64_t index_count;
+	GBounds bounds;
+};
+
+static constexpr std::uint32_t mesh_file_magic = 0x48534d44; // "DMSH"
+static constexpr std::uint32_t mesh_file_version = 1;
+
+// vertices and 32 bit indices as they are in memory, for GMappedMesh
+template <typename T>
+static void write_mesh_file(const std::string& filename, const GMesh<T>& mesh) {
+	std::ofstream f(filename, std::ios::binary);
+	if(!f)
+		throw std::runtime_error("could not open mesh file " + filename);
+
+	GMeshFileHeader header{ mesh_file_magic, mesh_file_version, (std::uint32_t)sizeof(T),
+		(std::uint32_t)mesh.vertices.size(), mesh.indices.size(), mesh.bounds };
+	std::vector<std::uint32_t> indices(mesh.indices.begin(), mesh.indices.end());
+
+	f.write((const char*)&header, sizeof(header));
+	f.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(T));
+	f.write((const char*)indices.data(), indices.size() * sizeof(std::uint32_t));
+
+	if(!f)
+		throw std::runtime_error("could not write mesh file " + filename);
+}
+
+// a mesh file mapped read only. processes mapping the same file share its pages,
+// the pipeline draws it like a GMesh
+template <typename T>
+class GMappedMesh {
+public:
+	GMappedMesh(const std::string& filename) {
+		int fd = ::open(filename.c_str(), O_RDONLY);
+		if(fd < 0)
+			throw std::runtime_error("could not open mesh file " + filename);
+
+		struct stat st;
+		if(fstat(fd, &st) != 0 || (std::size_t)st.st_size < sizeof(GMeshFileHeader)) {
+			::close(fd);
+			throw std::runtime_error("bad mesh file " + filename);
+		}
+
+		map_size = st.st_size;
+		map = (const char*)mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+
+		if(map == MAP_FAILED) {
+			map = nullptr;
+			throw std::runtime_error("could not map mesh file " + filename);
+		}
+
+		const GMeshFileHeader& header = *(const GMeshFileHeader*)map;
+		std::size_t size = sizeof(header) + header.vertex_count * sizeof(T) + header.index_count * sizeof(std::uint32_t);
+
+		if(header.magic != mesh_file_magic || header.version != mesh_file_version ||
+			header.vertex_size != sizeof(T) || size > map_size) {
+			munmap((void*)map, map_size);
+			map = nullptr;
+			throw std::runtime_error("not a mesh file for this vertex type: " + filename);
+		}
+
+		vertices = GArrayView<T>{ (const T*)(map + sizeof(header)), header.vertex_count };
+		indices = GArrayView<std::uint32_t>{
+			(const std::uint32_t*)(map + sizeof(header) + header.vertex_count * sizeof(T)), header.index_count };
+		bounds = header.bounds;
+	}
+
+	GMappedMesh(const GMappedMesh&) = delete;
+	GMappedMesh& operator=(const GMappedMesh&) = delete;
+
+	~GMappedMesh() {
+		if(map)
+			munmap((void*)map, map_size);
+	}
+
+	GArrayView<T> vertices;
+	GArrayView<std::uint32_t> indices;
+	GBounds bounds;
+
+private:
+	const char* map = nullptr;
+	std::size_t map_size = 0;
+};
+
+// fixed size messages over a pair of pipes
+class GPipeChannel {
+public:
+	GPipeChannel(int in_fd = -1, int out_fd = -1) : in(in_fd), out(out_fd) { }
+
+	template <typename T>
+	void send(const T& v) {
+		const char* p = (const char*)&v;
+		std::size_t done = 0;
+
+		while(done < sizeof(T)) {
+			ssize_t n = ::write(out, p + done, sizeof(T) - done);
+			if(n <= 0)
+				throw std::runtime_error("could not write to pipe");
+			done += n;
+		}
+	}
+
+	// false once the other end closed its pipe
+	template <typename T>
+	bool receive(T& v) {
+		char* p = (char*)&v;
+		std::size_t done = 0;
+
+		while(done < sizeof(T)) {
+			ssize_t n = ::read(in, p + done, sizeof(T) - done);
+			if(n == 0)
+				return false;
+			if(n < 0)
+				throw std::runtime_error("could not read from pipe");
+			done += n;
+		}
+
+		return true;
+	}
+
+	void close() {
+		if(in >= 0) ::close(in);
+		if(out >= 0) ::close(out);
+		in = out = -1;
+	}
+
+	int in;
+	int out;
+};
+
+// a child process running an executable. the descriptors of its ends of the
+// channel are appended to its arguments, reading from the first and writing to
+// the second. closing the channel tells it to exit. SIGPIPE is ignored from the
+// first worker on, so sending to one that died throws instead of killing us
+class GWorkerProcess {
+public:
+	GWorkerProcess(const std::string& executable, std::vector<std::string> args) {
+		int to[2], from[2];
+
+		// the ends the child keeps are made inheritable after the fork, every other
+		// worker must not hold them or closing a channel would not reach its child
+		if(pipe2(to, O_CLOEXEC) != 0 || pipe2(from, O_CLOEXEC) != 0)
+			throw std::runtime_error("could not create worker pipes");
+
+		args.insert(args.begin(), executable);
+		args.push_back(std::to_string(to[0]));
+		args.push_back(std::to_string(from[1]));
+
+		pid = fork();
+		if(pid < 0)
+			throw std::runtime_error("could not start worker " + executable);
+
+		if(pid == 0) {
+			fcntl(to[0], F_SETFD, 0);
+			fcntl(from[1], F_SETFD, 0);
+
+			std::vector<char*> argv;
+			for(std::string& a : args)
+				argv.push_back(&a[0]);
+			argv.push_back(nullptr);
+
+			execv(executable.c_str(), argv.data());
+			_exit(127);
+		}
+
+		::close(to[0]);
+		::close(from[1]);
+		channel = GPipeChannel(from[0], to[1]);
+
+		signal(SIGPIPE, SIG_IGN);
+	}
+
+	GWorkerProcess(const GWorkerProcess&) = delete;
+	GWorkerProcess& operator=(const GWorkerProcess&) = delete;
+
+	~GWorkerProcess() {
+		channel.close();
+
+		int status;
+		waitpid(pid, &status, 0);
+	}
+
+	GPipeChannel channel;
+
+private:
+	pid_t pid = -1;
+};
+
+// frame buffer and per frame constants shared by a coordinator and its workers
+class GSplitFrame {
+public:
+	static constexpr int max_workers = 64;
+	static constexpr std::size_t max_constants = 4096;
+
+	struct Header {
+		std::uint32_t magic;
+		std::int32_t width;
+		std::int32_t height;
+		std::int32_t worker_count;
+		GRect bands[max_workers];
+		std::uint64_t constants_size;
+		char constants[max_constants];
+	};
+
+	void create(const std::string& name, int width, int height, int workers) {
+		if(workers < 1 || workers > max_workers)
+			throw std::runtime_error("unsupported number of workers");
+
+		// every worker gets at least one row
+		if(width < 1 || height < workers)
+			throw std::runtime_error("frame too small for its workers");
+
+		memory.create(name, pixel_offset() + (std::size_t)width * height * sizeof(std::uint32_t));
+
+		Header& h = header();
+		h.magic = magic;
+		h.width = width;
+		h.height = height;
+		h.worker_count = workers;
+		h.constants_size = 0;
+
+		split_evenly();
+	}
+
+	void open(const std::string& name) {
+		memory.open(name);
+
+		if(memory.size() < pixel_offset() || header().magic != magic ||
+			memory.size() < pixel_offset() + (std::size_t)header().width * header().height * sizeof(std::uint32_t))
+			throw std::runtime_error("not a split frame: " + name);
+	}
+
+	Header& header() const {
+		return *(Header*)memory.data();
+	}
+
+	std::uint32_t* pixels() const {
+		return (std::uint32_t*)((char*)memory.data() + pixel_offset());
+	}
+
+	// constants for the next frame, read back in the order they were written
+	void reset_constants() {
+		header().constants_size = 0;
+		read_pos = 0;
+	}
+
+	template <typename T>
+	void put(const T& v) {
+		Header& h = header();
+		if(h.constants_size + sizeof(T) > max_constants)
+			throw std::runtime_error("split frame constants are full");
+
+		std::memcpy(h.constants + h.constants_size, &v, sizeof(T));
+		h.constants_size += sizeof(T);
+	}
+
+	template <typename T>
+	void get(T& v) {
+		if(read_pos + sizeof(T) > header().constants_size)
+			throw std::runtime_error("split frame constants are shorter than expected");
+
+		std::memcpy(&v, header().constants + read_pos, sizeof(T));
+		read_pos += sizeof(T);
+	}
+
+	void rewind() {
+		read_pos = 0;
+	}
+
+	// bands of equal height
+	void split_evenly() {
+		Header& h = header();
+
+		for(int i = 0; i < h.worker_count; i++)
+			h.bands[i] = GRect{ 0, h.height * i / h.worker_count, h.width - 1, h.height * (i + 1) / h.worker_count - 1 };
+	}
+
+	// move band boundaries so every worker gets the same share of last frame's
+	// time, assuming it was spread evenly over the rows of each band. half of the
+	// correction is applied per frame to keep the bands from oscillating
+	void rebalance(const std::vector<float>& ms) {
+		Header& h = header();
+		const int n = h.worker_count;
+
+		float total = 0;
+		for(int i = 0; i < n; i++)
+			total += ms[i];
+
+		if(n < 2 || total <= 0)
+			return;
+
+		std::vector<int> cuts(n + 1);
+		cuts[0] = 0;
+		cuts[n] = h.height;
+
+		int band = 0;
+		float before = 0; // time of the bands above `band`
+
+		for(int k = 1; k < n; k++) {
+			float goal = total * k / n;
+
+			while(band < n - 1 && before + ms[band] < goal)
+				before += ms[band++];
+
+			const GRect& b = h.bands[band];
+			int rows = b.y1 - b.y0 + 1;
+			float row = ms[band] > 0 ? (goal - before) / ms[band] * rows : rows;
+			int target = b.y0 + (int)std::lround(row);
+			int current = h.bands[k].y0;
+
+			cuts[k] = current + (target - current) / 2;
+		}
+
+		// every band keeps at least one row
+		for(int k = 1; k < n; k++)
+			cuts[k] = clamp(cuts[k], cuts[k - 1] + 1, h.height - (n - k));
+
+		for(int i = 0; i < n; i++)
+			h.bands[i] = GRect{ 0, cuts[i], h.width - 1, cuts[i + 1] - 1 };
+	}
+
+private:
+	static constexpr std::uint32_t magic = 0x544c5053; // "SPLT"
+
+	static std::size_t pixel_offset() {
+		return (sizeof(Header) + 63) / 64 * 64;
+	}
+
+	GSharedMemory memory;
+	std::size_t read_pos = 0;
+};
+
+}
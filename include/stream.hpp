@@ -0,0 +1,476 @@
+// this file describes out of core mesh streaming
+// a mesh is split offline into spatially coherent clusters and written to a file
+// together with a coarse version of every cluster. at run time the file is memory
+// mapped, the coarse clusters stay resident and full clusters are loaded on a
+// background thread when they are visible and big enough on screen. resident
+// clusters are kept within a memory budget and the least recently drawn ones are
+// evicted first. clusters that are not resident draw their coarse version
+
+#pragma once
+
+#include "util.hpp"
+#include "lod.hpp"
+#include "optimize.hpp"
+#include "pipeline.hpp"
+
+namespace demo {
+
+struct GClusterFileHeader {
+	std::uint32_t magic;
+	std::uint32_t version;
+	std::uint32_t vertex_size;
+	std::uint32_t cluster_count;
+};
+
+// where a cluster's full and coarse geometry sit in the file. vertices are followed
+// by 16 bit indices local to the cluster
+struct GClusterInfo {
+	vec3 min;
+	vec3 max;
+	vec3 center;
+	float radius;
+
+	std::uint64_t offset;
+	std::uint32_t vertex_count;
+	std::uint32_t index_count;
+
+	std::uint64_t coarse_offset;
+	std::uint32_t coarse_vertex_count;
+	std::uint32_t coarse_index_count;
+};
+
+// writes meshes into the clustered format. this runs offline and needs the whole
+// mesh in memory, only the renderer works out of core
+template <typename T>
+class GClusterWriter {
+public:
+	static constexpr std::uint32_t magic = 0x4c434447; // "GDCL"
+	static constexpr std::uint32_t version = 1;
+
+	// coarse clusters keep 1/coarse_ratio of the triangles
+	static void write(const std::string& filename, const GMesh<T>& mesh,
+		std::size_t cluster_triangles = 4096, std::size_t coarse_ratio = 8) {
+		if(cluster_triangles < 1 || coarse_ratio < 1)
+			throw std::runtime_error("clusters need at least one triangle");
+
+		std::ofstream f(filename, std::ios::binary);
+		if(!f)
+			throw std::runtime_error("could not open cluster file " + filename);
+
+		std::vector<std::uint32_t> order = spatial_order(mesh);
+		std::size_t triangle_count = order.size();
+		std::size_t cluster_count = (triangle_count + cluster_triangles - 1) / cluster_triangles;
+
+		GClusterFileHeader header{ magic, version, (std::uint32_t)sizeof(T), (std::uint32_t)cluster_count };
+		std::vector<GClusterInfo> table(cluster_count);
+
+		// the table is written again once the offsets are known
+		f.write((const char*)&header, sizeof(header));
+		f.write((const char*)table.data(), table.size() * sizeof(GClusterInfo));
+
+		for(std::size_t c = 0; c < cluster_count; c++) {
+			std::size_t first = c * cluster_triangles,
+				last = std::min(first + cluster_triangles, triangle_count);
+
+			GMesh<T> cluster = extract(mesh, order, first, last);
+			optimize_mesh(cluster);
+
+			GMesh<T> coarse = cluster;
+			std::size_t target = cluster.indices.size() / 3 / coarse_ratio;
+			if(target >= 16) {
+				GSimplifier<T> simplifier(cluster);
+				coarse = simplifier.simplify(target);
+				optimize_mesh(coarse);
+			}
+
+			GClusterInfo& info = table[c];
+			info.min = cluster.bounds.min;
+			info.max = cluster.bounds.max;
+			info.center = cluster.bounds.center;
+			info.radius = cluster.bounds.radius;
+
+			info.offset = write_mesh(f, cluster);
+			info.vertex_count = cluster.vertices.size();
+			info.index_count = cluster.indices.size();
+
+			info.coarse_offset = write_mesh(f, coarse);
+			info.coarse_vertex_count = coarse.vertices.size();
+			info.coarse_index_count = coarse.indices.size();
+		}
+
+		f.seekp(sizeof(header));
+		f.write((const char*)table.data(), table.size() * sizeof(GClusterInfo));
+
+		if(!f)
+			throw std::runtime_error("could not write cluster file " + filename);
+	}
+
+private:
+	// triangles sorted along a morton curve through their centroids, so runs of
+	// the order are compact in space
+	static std::vector<std::uint32_t> spatial_order(const GMesh<T>& mesh) {
+		std::size_t triangle_count = mesh.indices.size() / 3;
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> keys(triangle_count);
+		vec3 extent = glm::max(mesh.bounds.max - mesh.bounds.min, vec3(1e-6f));
+
+		for(std::size_t t = 0; t < triangle_count; t++) {
+			vec3 c = (vec3(mesh.vertices[mesh.indices[t * 3]].pos) +
+				vec3(mesh.vertices[mesh.indices[t * 3 + 1]].pos) +
+				vec3(mesh.vertices[mesh.indices[t * 3 + 2]].pos)) / 3.0f;
+			vec3 n = (c - mesh.bounds.min) / extent * 1023.0f;
+
+			keys[t] = { morton(n.x) | morton(n.y) << 1 | morton(n.z) << 2, (std::uint32_t)t };
+		}
+
+		std::sort(keys.begin(), keys.end());
+
+		std::vector<std::uint32_t> order(triangle_count);
+		for(std::size_t t = 0; t < triangle_count; t++)
+			order[t] = keys[t].second;
+
+		return order;
+	}
+
+	// spreads 10 bits out to every third bit
+	static std::uint32_t morton(float v) {
+		std::uint32_t x = (std::uint32_t)clamp(v, 0.0f, 1023.0f);
+		x = (x | (x << 16)) & 0x030000ff;
+		x = (x | (x << 8)) & 0x0300f00f;
+		x = (x | (x << 4)) & 0x030c30c3;
+		x = (x | (x << 2)) & 0x09249249;
+		return x;
+	}
+
+	static GMesh<T> extract(const GMesh<T>& mesh, const std::vector<std::uint32_t>& order, std::size_t first, std::size_t last) {
+		std::map<std::size_t, std::size_t> remap;
+		std::vector<T> vertices;
+		std::vector<size_t> indices;
+
+		for(std::size_t i = first; i < last; i++) {
+			for(int k = 0; k < 3; k++) {
+				std::size_t v = mesh.indices[order[i] * 3 + k];
+				auto it = remap.find(v);
+
+				if(it == remap.end()) {
+					it = remap.emplace(v, vertices.size()).first;
+					vertices.push_back(mesh.vertices[v]);
+				}
+
+				indices.push_back(it->second);
+			}
+		}
+
+		return GMesh<T>(vertices, indices);
+	}
+
+	// vertices then 16 bit indices, padded to 16 bytes. returns the offset
+	static std::uint64_t write_mesh(std::ofstream& f, const GMesh<T>& mesh) {
+		if(mesh.vertices.size() > 65536)
+			throw std::runtime_error("cluster has too many vertices for 16 bit indices");
+
+		std::uint64_t offset = f.tellp();
+		f.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(T));
+
+		std::vector<std::uint16_t> indices(mesh.indices.begin(), mesh.indices.end());
+		f.write((const char*)indices.data(), indices.size() * sizeof(std::uint16_t));
+
+		static const char zero[16] = { 0 };
+		f.write(zero, (16 - f.tellp() % 16) % 16);
+
+		return offset;
+	}
+};
+
+template <typename T>
+class GStreamingMesh {
+public:
+	struct GStreamingStats {
+		std::size_t full_draws = 0;
+		std::size_t coarse_draws = 0;
+		std::size_t loads = 0;
+		std::size_t evictions = 0;
+	};
+
+	// budget in bytes of resident full clusters
+	GStreamingMesh(const std::string& filename, std::size_t budget) : budget_bytes(budget) {
+		fd = ::open(filename.c_str(), O_RDONLY);
+		if(fd < 0)
+			throw std::runtime_error("could not open cluster file " + filename);
+
+		struct stat st;
+		if(fstat(fd, &st) != 0 || (std::size_t)st.st_size < sizeof(GClusterFileHeader)) {
+			::close(fd);
+			throw std::runtime_error("bad cluster file " + filename);
+		}
+
+		map_size = st.st_size;
+		map = (const char*)mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map == MAP_FAILED) {
+			::close(fd);
+			throw std::runtime_error("could not map cluster file " + filename);
+		}
+
+		const GClusterFileHeader& header = *(const GClusterFileHeader*)map;
+		if(header.magic != GClusterWriter<T>::magic || header.version != GClusterWriter<T>::version ||
+			header.vertex_size != sizeof(T) ||
+			sizeof(header) + header.cluster_count * sizeof(GClusterInfo) > map_size) {
+			close();
+			throw std::runtime_error("not a cluster file for this vertex type: " + filename);
+		}
+
+		const GClusterInfo* table = (const GClusterInfo*)(map + sizeof(GClusterFileHeader));
+		infos.assign(table, table + header.cluster_count);
+		clusters.resize(infos.size());
+
+		// a budget that cannot hold a cluster would never load any
+		std::size_t largest = 0;
+		for(const GClusterInfo& info : infos)
+			largest = std::max(largest, full_size(info));
+
+		if(budget_bytes < largest) {
+			close();
+			throw std::runtime_error("streaming budget below the largest cluster, " + std::to_string(largest) + " bytes");
+		}
+
+		// the coarse clusters are small and always resident
+		for(std::size_t i = 0; i < infos.size(); i++) {
+			const GClusterInfo& info = infos[i];
+			clusters[i].coarse = read_mesh(info.coarse_offset, info.coarse_vertex_count, info.coarse_index_count);
+			clusters[i].bounds = GBounds{ info.min, info.max, info.center, info.radius };
+		}
+
+		loader = std::thread([this]() { load_loop(); });
+	}
+
+	GStreamingMesh(const GStreamingMesh&) = delete;
+	GStreamingMesh& operator=(const GStreamingMesh&) = delete;
+
+	~GStreamingMesh() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+		}
+
+		wake.notify_all();
+		if(loader.joinable())
+			loader.join();
+
+		close();
+	}
+
+	// once per frame before drawing: picks up finished loads and evicts the least
+	// recently drawn clusters until they and the ones still loading fit in the
+	// budget. clusters the last frame chose to keep are never evicted
+	void update() {
+		std::vector<std::pair<std::uint32_t, GMesh<T>>> done;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done.swap(finished);
+		}
+
+		for(auto& d : done) {
+			Cluster& c = clusters[d.first];
+			c.full = std::move(d.second);
+			c.state = Cluster::resident;
+			c.lru = lru.insert(lru.begin(), d.first);
+			resident_bytes += c.full.size_in_bytes();
+			queued_bytes -= c.full.size_in_bytes();
+			stats.loads++;
+			version++;
+		}
+
+		while(resident_bytes + queued_bytes > budget_bytes && !lru.empty()) {
+			std::uint32_t i = lru.back();
+			Cluster& c = clusters[i];
+
+			if(c.last_used >= frame)
+				break;
+
+			lru.pop_back();
+			resident_bytes -= c.full.size_in_bytes();
+			c.full = GMesh<T>();
+			c.state = Cluster::absent;
+			stats.evictions++;
+			version++;
+		}
+
+		frame++;
+	}
+
+	// draws every visible cluster, full if it is resident and covers at least
+	// full_radius pixels, coarse otherwise. the biggest clusters on screen that fit
+	// in the budget together are kept resident, the missing ones among them are
+	// requested. other resident clusters still draw full until they are evicted
+	template <class Context>
+	void draw(GPipeline<Context>& p) {
+		GFrustum frustum(p.context.vertex_shader.clip_matrix());
+		std::vector<std::pair<float, std::uint32_t>> visible;
+
+		for(std::uint32_t i = 0; i < clusters.size(); i++) {
+			const Cluster& c = clusters[i];
+
+			if(!frustum.test_sphere(c.bounds.center, c.bounds.radius))
+				continue;
+
+			float radius = p.screen_radius(c.bounds);
+
+			if(radius >= full_radius) {
+				visible.push_back({ -radius, i });
+			} else {
+				p.process(c.coarse);
+				stats.coarse_draws++;
+			}
+		}
+
+		std::sort(visible.begin(), visible.end());
+
+		std::size_t used = 0;
+		bool requested = false;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			for(const auto& v : visible) {
+				Cluster& c = clusters[v.second];
+				std::size_t size = full_size(infos[v.second]);
+
+				if(used + size > budget_bytes)
+					break;
+
+				used += size;
+
+				if(c.state == Cluster::resident) {
+					c.last_used = frame;
+					lru.splice(lru.begin(), lru, c.lru);
+				} else if(c.state == Cluster::absent) {
+					c.state = Cluster::queued;
+					queued_bytes += size;
+					requests.push_back(v.second);
+					requested = true;
+				}
+			}
+		}
+
+		if(requested)
+			wake.notify_one();
+
+		for(const auto& v : visible) {
+			const Cluster& c = clusters[v.second];
+
+			if(c.state == Cluster::resident) {
+				p.process(c.full);
+				stats.full_draws++;
+			} else {
+				p.process(c.coarse);
+				stats.coarse_draws++;
+			}
+		}
+	}
+
+	std::size_t cluster_count() const {
+		return clusters.size();
+	}
+
+	std::size_t resident_count() const {
+		return lru.size();
+	}
+
+	// size of the mapped file
+	std::size_t file_size() const {
+		return map_size;
+	}
+
+	std::size_t budget_bytes;
+	std::size_t resident_bytes = 0;
+
+	// clusters narrower than this on screen, in pixels, draw coarse
+	float full_radius = 16;
+
+	// changes whenever a cluster was loaded or evicted
+	std::uint64_t version = 0;
+
+	GStreamingStats stats;
+
+	// called on the loader thread when a cluster is ready for the next update
+	std::function<void()> on_load;
+
+private:
+	struct Cluster {
+		enum State { absent, queued, resident };
+
+		State state = absent;
+		GBounds bounds;
+		GMesh<T> coarse;
+		GMesh<T> full;
+		std::uint64_t last_used = 0;
+		std::list<std::uint32_t>::iterator lru;
+	};
+
+	// what a full cluster takes once loaded, as GMesh::size_in_bytes counts it
+	static std::size_t full_size(const GClusterInfo& info) {
+		return info.vertex_count * sizeof(T) + info.index_count * sizeof(size_t);
+	}
+
+	GMesh<T> read_mesh(std::uint64_t offset, std::uint32_t vertex_count, std::uint32_t index_count) const {
+		if(offset + vertex_count * sizeof(T) + index_count * sizeof(std::uint16_t) > map_size)
+			throw std::runtime_error("cluster lies outside of the cluster file");
+
+		const T* v = (const T*)(map + offset);
+		const std::uint16_t* i = (const std::uint16_t*)(map + offset + vertex_count * sizeof(T));
+
+		return GMesh<T>(std::vector<T>(v, v + vertex_count), std::vector<size_t>(i, i + index_count));
+	}
+
+	// copies requested clusters out of the mapping, the page faults are the disk reads
+	void load_loop() {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while(true) {
+			wake.wait(lock, [this]() { return !running || !requests.empty(); });
+			if(!running)
+				return;
+
+			std::uint32_t i = requests.front();
+			requests.pop_front();
+
+			lock.unlock();
+			const GClusterInfo& info = infos[i];
+			GMesh<T> mesh = read_mesh(info.offset, info.vertex_count, info.index_count);
+			lock.lock();
+
+			finished.emplace_back(i, std::move(mesh));
+
+			if(on_load)
+				on_load();
+		}
+	}
+
+	void close() {
+		if(map && map != MAP_FAILED)
+			munmap((void*)map, map_size);
+		map = nullptr;
+
+		if(fd >= 0)
+			::close(fd);
+		fd = -1;
+	}
+
+	int fd = -1;
+	const char* map = nullptr;
+	std::size_t map_size = 0;
+
+	std::vector<GClusterInfo> infos;
+	std::vector<Cluster> clusters;
+	std::list<std::uint32_t> lru; // resident clusters, most recently drawn first
+	std::size_t queued_bytes = 0; // full size of the clusters requested but not resident
+	std::uint64_t frame = 1;
+
+	std::thread loader;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool running = true;
+	std::deque<std::uint32_t> requests;
+	std::vector<std::pair<std::uint32_t, GMesh<T>>> finished;
+};
+
+}
@@ -0,0 +1,236 @@
+// this file describes render targets and dynamic resolution scaling
+// a render target is the color and depth memory the pipeline rasterizes into.
+// the window owns one and scales it to the window size when presenting
+
+#pragma once
+
+#include "util.hpp"
+#include "depth.hpp"
+#include "msaa.hpp"
+
+namespace demo {
+
+static inline std::uint32_t pack_argb(GRgba c) {
+	return ((std::uint32_t)c.a << 24) | ((std::uint32_t)c.r << 16) | ((std::uint32_t)c.g << 8) | c.b;
+}
+
+class GRenderTarget {
+public:
+	GRenderTarget() { }
+
+	// depth only targets (has_color = false) have no color buffer at all
+	GRenderTarget(int w, int h, bool color = true) : has_color(color) { 
+		resize(w, h); 
+	}
+
+	// shrinking keeps the allocations, so scaling down and back up is cheap
+	void resize(int w, int h) {
+		width = w;
+		height = h;
+		if(has_color)
+			color.assign(w * h, clear_color);
+		depth.resize(w, h);
+
+		if(samples > 1)
+			sample_store.resize(w, h);
+	}
+
+	// 1, or msaa_samples for multisampled color draws. depth only draws stay at
+	// one sample per pixel
+	void set_samples(int n) {
+		if(n != 1 && n != msaa_samples)
+			throw std::runtime_error("render targets have 1 or " + std::to_string(msaa_samples) + " samples");
+		if(n > 1 && !has_color)
+			throw std::runtime_error("depth only targets can not be multisampled");
+
+		samples = n;
+		sample_store.resize(n > 1 ? width : 0, n > 1 ? height : 0);
+	}
+
+	void clear() {
+		std::fill(color.begin(), color.end(), clear_color);
+		depth.clear();
+
+		if(samples > 1)
+			sample_store.clear();
+	}
+
+	void clear(const GRect& r) {
+		GRect rect = r.intersect(GRect{ 0, 0, width - 1, height - 1 });
+		if(rect.empty())
+			return;
+
+		if(has_color) {
+			for(int y = rect.y0; y <= rect.y1; y++)
+				std::fill(&color[y * width + rect.x0], &color[y * width + rect.x1] + 1, clear_color);
+		}
+
+		depth.clear(rect);
+
+		if(samples > 1)
+			sample_store.clear(rect);
+	}
+
+	void put_pixel(int x, int y, GRgba c) {
+		color[y * width + x] = pack_argb(c);
+	}
+
+	// binary PPM of the color buffer, for comparing frames offline
+	void save_ppm(const std::string& filename) const {
+		std::ofstream f(filename, std::ios::binary);
+		if(!f)
+			throw std::runtime_error("could not open " + filename);
+
+		std::vector<char> ppm = encode_ppm();
+		f.write(ppm.data(), ppm.size());
+	}
+
+	std::vector<char> encode_ppm() const {
+		std::string header = "P6 " + std::to_string(width) + " " + std::to_string(height) + " 255\n";
+		std::vector<char> out(header.begin(), header.end());
+		out.reserve(header.size() + color.size() * 3);
+
+		for(std::uint32_t c : color) {
+			char rgb[3] = { (char)(c >> 16), (char)(c >> 8), (char)c };
+			out.insert(out.end(), rgb, rgb + 3);
+		}
+
+		return out;
+	}
+
+	// bilinear upscale into a w by h ARGB8888 image
+	void upscale(std::uint32_t* dst, int pitch, int w, int h) const {
+		upscale(color.data(), width, height, dst, pitch, w, h);
+	}
+
+	// the same for any width by height ARGB8888 image, like a post processed frame
+	static void upscale(const std::uint32_t* color, int width, int height, std::uint32_t* dst, int pitch, int w, int h) {
+		if(w == width && h == height) {
+			for(int y = 0; y < h; y++)
+				std::memcpy((std::uint8_t*)dst + y * pitch, &color[y * width], w * sizeof(std::uint32_t));
+			return;
+		}
+
+		// source coordinates of each destination column in 16.16 fixed point
+		std::vector<int> sx0(w), sx1(w), fx(w);
+		for(int x = 0; x < w; x++) {
+			int s = std::max(0, (int)(((x + 0.5f) * width / w - 0.5f) * 65536));
+			sx0[x] = std::min(s >> 16, width - 1);
+			sx1[x] = std::min(sx0[x] + 1, width - 1);
+			fx[x] = (s >> 8) & 0xff;
+		}
+
+		for(int y = 0; y < h; y++) {
+			int s = std::max(0, (int)(((y + 0.5f) * height / h - 0.5f) * 65536));
+			int sy0 = std::min(s >> 16, height - 1),
+				sy1 = std::min(sy0 + 1, height - 1),
+				fy = (s >> 8) & 0xff;
+
+			const std::uint32_t* r0 = &color[sy0 * width];
+			const std::uint32_t* r1 = &color[sy1 * width];
+			std::uint32_t* out = (std::uint32_t*)((std::uint8_t*)dst + y * pitch);
+
+			for(int x = 0; x < w; x++) {
+				out[x] = blend(
+					blend(r0[sx0[x]], r0[sx1[x]], fx[x]),
+					blend(r1[sx0[x]], r1[sx1[x]], fx[x]),
+					fy);
+			}
+		}
+	}
+
+	int width = 0;
+	int height = 0;
+	bool has_color = true;
+
+	std::uint32_t clear_color = 0xff000000;
+	std::vector<std::uint32_t> color; // ARGB8888
+	GWindowDepthBuffer depth;
+
+	int samples = 1;
+	GSampleStore<GWindowDepthBuffer::FormatType> sample_store; // edge pixels when multisampled
+
+private:
+	// per channel (a * (256 - f) + b * f) / 256, two channels at a time
+	static std::uint32_t blend(std::uint32_t a, std::uint32_t b, int f) {
+		std::uint32_t rb = (((a & 0x00ff00ff) * (256 - f) + (b & 0x00ff00ff) * f) >> 8) & 0x00ff00ff,
+			ag = ((((a >> 8) & 0x00ff00ff) * (256 - f) + ((b >> 8) & 0x00ff00ff) * f) >> 8) & 0x00ff00ff;
+
+		return rb | (ag << 8);
+	}
+};
+
+// picks the render target scale from measured frame times.
+// fill cost is roughly proportional to pixel count, so the scale moves by the
+// square root of the budget ratio
+class GDynamicResolution {
+public:
+	// returns true if the scale changed
+	bool update(float frame_ms) {
+		// budget hit rate over the last frames
+		history[history_pos] = frame_ms <= budget_ms;
+		history_pos = (history_pos + 1) % history_size;
+		history_count = std::min(history_count + 1, history_size);
+
+		if(!enabled) {
+			bool changed = scale != 1;
+			scale = 1;
+			return changed;
+		}
+
+		average_ms = average_ms <= 0 ? frame_ms : l_interpolate(average_ms, frame_ms, 0.2f);
+
+		if(cooldown > 0) {
+			cooldown--;
+			return false;
+		}
+
+		float target = scale;
+
+		if(average_ms > budget_ms) {
+			target = std::min(scale * std::sqrt(budget_ms / average_ms), scale - step);
+		} else if(average_ms < budget_ms * 0.8f) {
+			target = scale + step;
+		}
+
+		// quantize so small fluctuations do not resize the target every frame
+		target = clamp(std::round(target / step) * step, min_scale, max_scale);
+
+		if(target == scale)
+			return false;
+
+		scale = target;
+		cooldown = 10;
+		return true;
+	}
+
+	float hit_rate() const {
+		if(!history_count)
+			return 1;
+
+		int hits = 0;
+		for(int i = 0; i < history_count; i++)
+			hits += history[i];
+
+		return (float)hits / history_count;
+	}
+
+	bool enabled = true;
+	float budget_ms = 1000.0f / 60;
+	float scale = 1;
+	float min_scale = 0.25f;
+	float max_scale = 1;
+	float step = 0.05f;
+
+private:
+	static constexpr int history_size = 120;
+
+	float average_ms = 0;
+	int cooldown = 0;
+
+	bool history[history_size] = { false };
+	int history_pos = 0;
+	int history_count = 0;
+};
+
+}
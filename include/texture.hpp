@@ -54,6 +54,17 @@ public:
         return surface;
     }
 
+    std::vector<GRgba> get_pixels() {
+        std::vector<GRgba> pixels;
+        pixels.reserve(width * height);
+
+        for(int y = 0; y < height; y++)
+            for(int x = 0; x < width; x++)
+                pixels.push_back(pixel(x, y));
+
+        return pixels;
+    }
+
     int width;
     int height;
 
@@ -61,4 +72,56 @@ private:
     SDL_Surface* surface;
 };
 
+// uncompressed RGBA8 texels, row major
+class GImage {
+public:
+    GImage() { }
+    GImage(int w, int h, std::vector<GRgba> p) : width(w), height(h), pixels(p) { }
+    GImage(GTexture& t) : width(t.width), height(t.height), pixels(t.get_pixels()) { }
+
+    GRgba texel(int x, int y) const {
+        return pixels[y * width + x];
+    }
+
+    std::size_t size_in_bytes() const {
+        return pixels.size() * sizeof(GRgba);
+    }
+
+    int width = 0;
+    int height = 0;
+    std::vector<GRgba> pixels;
+};
+
+// samplers work on anything with width, height and texel(x, y).
+// coordinates wrap around
+
+template <class Source>
+static GRgba sample_nearest(Source& s, vec2 uv) {
+    int x = (int)std::floor(uv.x * s.width), y = (int)std::floor(uv.y * s.height);
+    x = ((x % s.width) + s.width) % s.width;
+    y = ((y % s.height) + s.height) % s.height;
+    return s.texel(x, y);
+}
+
+template <class Source>
+static GRgba sample_bilinear(Source& s, vec2 uv) {
+    float fx = uv.x * s.width - 0.5f, fy = uv.y * s.height - 0.5f;
+    float bx = std::floor(fx), by = std::floor(fy);
+    int wx = (int)((fx - bx) * 256), wy = (int)((fy - by) * 256);
+
+    int x0 = (((int)bx % s.width) + s.width) % s.width, y0 = (((int)by % s.height) + s.height) % s.height;
+    int x1 = (x0 + 1) % s.width, y1 = (y0 + 1) % s.height;
+
+    GRgba t[4] = { s.texel(x0, y0), s.texel(x1, y0), s.texel(x0, y1), s.texel(x1, y1) };
+    GRgba out;
+
+    for(int c = 0; c < 4; c++) {
+        int top = (&t[0].r)[c] * (256 - wx) + (&t[1].r)[c] * wx,
+            bottom = (&t[2].r)[c] * (256 - wx) + (&t[3].r)[c] * wx;
+        (&out.r)[c] = (std::uint8_t)((top * (256 - wy) + bottom * wy) >> 16);
+    }
+
+    return out;
+}
+
 }
\ No newline at end of file
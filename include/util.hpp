@@ -7,11 +7,36 @@
 #include <algorithm>
 #include <utility>
 #include <cstring>
+#include <cerrno>
 #include <optional>
 #include <cstdint>
 #include <deque>
 #include <sstream>
 #include <fstream>
+#include <cassert>
+#include <map>
+#include <tuple>
+#include <random>
+#include <climits>
+#include <limits>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <condition_variable>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
 
 #include <SDL.h>
 #include <SDL_ttf.h>
@@ -23,6 +48,9 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <glm/gtx/compatibility.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 namespace demo {
 
@@ -70,65 +98,90 @@ static T l_interpolate(const T& a, const T& b, float alpha) {
 
 struct GPlane {
 	float a, b, c, d;
+
+	float distance(const vec3& p) const {
+		return a * p.x + b * p.y + c * p.z + d;
+	}
 };
 
+// axis aligned bounding box and bounding sphere of a set of points
+struct GBounds {
+	vec3 min{ INFINITY }, max{ -INFINITY };
+	vec3 center{ 0 };
+	float radius = 0;
+
+	template <typename T>
+	static GBounds from_vertices(const std::vector<T>& vertices) {
+		GBounds b;
+
+		for(const T& v : vertices) {
+			b.min = glm::min(b.min, vec3(v.pos));
+			b.max = glm::max(b.max, vec3(v.pos));
+		}
+
+		b.center = (b.min + b.max) * 0.5f;
+
+		for(const T& v : vertices)
+			b.radius = glm::max(b.radius, length(vec3(v.pos) - b.center));
+
+		return b;
+	}
+};
+
+// planes are extracted from the rows of a clip matrix (gribb/hartmann).
+// glm matrices are column major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i]).
+// the near plane is z >= 0 to match the pipeline's clipper
 class GFrustum {
 public:
 	GFrustum() { }
+	GFrustum(const mat4x4& mat) { update(mat); }
 
 	void update(const mat4x4& mat) {
-		// left
-		planes[0].a = mat[3][0] + mat[0][0];
-		planes[0].b = mat[3][1] + mat[0][1];
-		planes[0].c = mat[3][2] + mat[0][2];
-		planes[0].d = mat[3][3] + mat[0][3];
-
-		// right
-		planes[1].a = mat[3][0] - mat[0][0];
-		planes[1].b = mat[3][1] - mat[0][1];
-		planes[1].c = mat[3][2] - mat[0][2];
-		planes[1].d = mat[3][3] - mat[0][3];
-		
-		// top
-		planes[2].a = mat[3][0] - mat[1][0];
-		planes[2].b = mat[3][1] - mat[1][1];
-		planes[2].c = mat[3][2] - mat[1][2];
-		planes[2].d = mat[3][3] - mat[1][3];
-		
-		// bottom
-		planes[3].a = mat[3][0] + mat[1][0];
-		planes[3].b = mat[3][1] + mat[1][1];
-		planes[3].c = mat[3][2] + mat[1][2];
-		planes[3].d = mat[3][3] + mat[1][3];
-		
-		// near
-		planes[4].a = mat[3][0] + mat[2][0];
-		planes[4].b = mat[3][1] + mat[2][1];
-		planes[4].c = mat[3][2] + mat[2][2];
-		planes[4].d = mat[3][3] + mat[2][3];
-		
-		// far
-		planes[5].a = mat[3][0] - mat[2][0];
-		planes[5].b = mat[3][1] - mat[2][1];
-		planes[5].c = mat[3][2] - mat[2][2];
-		planes[5].d = mat[3][3] - mat[2][3];
+		auto row = [&](int i) { return vec4(mat[0][i], mat[1][i], mat[2][i], mat[3][i]); };
+		vec4 r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+
+		set_plane(0, r3 + r0); // left
+		set_plane(1, r3 - r0); // right
+		set_plane(2, r3 - r1); // top
+		set_plane(3, r3 + r1); // bottom
+		set_plane(4, r2);      // near
+		set_plane(5, r3 - r2); // far
+	}
+
+	// false if the sphere is completely outside of any plane
+	bool test_sphere(const vec3& center, float radius) const {
+		for(const GPlane& p : planes) {
+			if(p.distance(center) < -radius)
+				return false;
+		}
+
+		return true;
 	}
 
 	GPlane planes[6];
+
+private:
+	void set_plane(int i, vec4 p) {
+		float len = length(vec3(p));
+		if(len > 0) p /= len;
+		planes[i] = GPlane{ p.x, p.y, p.z, p.w };
+	}
 };
 
 struct IVertex {
 	IVertex() { }
 
-	// interpolate attributes with barycentric coordinates
-	IVertex(vec3, IVertex, IVertex, IVertex, float);
 	IVertex operator*(float);
 	IVertex operator/(float);
 
 	std::string to_string();
 
-	// barycentric interpolate attributes 
-	void berp(vec3, IVertex, IVertex, IVertex);
+	// attributes interpolated across triangles by the rasterizer, stored as
+	// varying_count contiguous floats. pos is not a varying: fragment shaders get
+	// the window position (x, y, z, 1/w) of the fragment in it
+	static constexpr int varying_count = 0;
+	float* varyings();
+	const float* varyings() const;
 	
 	// linear interpolate attributes
 	void lerp(IVertex, IVertex, float);
@@ -143,10 +196,22 @@ struct GMesh {
 		indices(is) { 
 		assert(vertices.size() > 2);
 		assert(indices.size() % 3 == 0);
+
+		update_bounds();
+	}
+
+	// call after modifying vertex positions
+	void update_bounds() {
+		bounds = GBounds::from_vertices(vertices);
+	}
+
+	std::size_t size_in_bytes() const {
+		return vertices.size() * sizeof(T) + indices.size() * sizeof(size_t);
 	}
 
 	std::vector<T> vertices;
 	std::vector<size_t> indices;
+	GBounds bounds;
 };
 
 template <typename T>
@@ -155,6 +220,41 @@ struct GTriangle {
 	T a, b, c;
 };
 
+// inclusive pixel rectangle
+struct GRect {
+	int x0 = 0, y0 = 0, x1 = -1, y1 = -1;
+
+	static GRect all() {
+		return GRect{ 0, 0, INT_MAX, INT_MAX };
+	}
+
+	bool empty() const {
+		return x1 < x0 || y1 < y0;
+	}
+
+	GRect merge(const GRect& r) const {
+		if(empty()) return r;
+		if(r.empty()) return *this;
+		return GRect{ std::min(x0, r.x0), std::min(y0, r.y0), std::max(x1, r.x1), std::max(y1, r.y1) };
+	}
+
+	GRect intersect(const GRect& r) const {
+		return GRect{ std::max(x0, r.x0), std::max(y0, r.y0), std::min(x1, r.x1), std::min(y1, r.y1) };
+	}
+
+	bool overlaps(const GRect& r) const {
+		return !intersect(r).empty();
+	}
+
+	bool contains(int x, int y) const {
+		return x >= x0 && x <= x1 && y >= y0 && y <= y1;
+	}
+
+	int area() const {
+		return empty() ? 0 : (x1 - x0 + 1) * (y1 - y0 + 1);
+	}
+};
+
 struct GRgba {
 	std::uint8_t r, g, b, a;
 };
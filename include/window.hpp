@@ -6,6 +6,9 @@
 #include "util.hpp"
 #include "scene.hpp"
 #include "texture.hpp"
+#include "depth.hpp"
+#include "target.hpp"
+#include "post.hpp"
 
 namespace demo {
 
@@ -73,8 +76,15 @@ private:
 
 class GWindow {
 public:
-	GWindow(std::string title, int W, int H, int flags) : 
-		width(W), height(H), quit(false) {
+	// a headless window has a render target but no SDL window, renderer or font.
+	// it cannot run or present, it is for drawing offline
+	GWindow(std::string title, int W, int H, int flags, bool headless_ = false) : 
+		width(W), height(H), quit(false), headless(headless_) {
+		target.resize(width, height);
+
+		if(headless)
+			return;
+
 		SDL_Init(SDL_INIT_EVERYTHING);
 
 		window = SDL_CreateWindow(
@@ -100,19 +110,23 @@ public:
 		if(TTF_Init() == -1)
 			throw std::runtime_error("could not initialize SDL_ttf");
 
-		depth_buffer = new float[width*height];
+		frame_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, 
+			SDL_TEXTUREACCESS_STREAMING, width, height);
 
-		if(!depth_buffer)
-			throw std::runtime_error("could not allocate depth buffer");
+		if(!frame_texture)
+			throw std::runtime_error("could not create frame texture");
 
 		font.init(renderer, "../assets/Hack-Bold.ttf", 18);
 	}
 
 	~GWindow() {
+		if(headless)
+			return;
+
 		font.destroy();
 
-		if(depth_buffer != NULL)
-			delete[] depth_buffer;
+		if(frame_texture)
+			SDL_DestroyTexture(frame_texture);
 
 		if(SDL_WasInit(SDL_INIT_EVERYTHING) != 0) {
 			SDL_DestroyRenderer(renderer);
@@ -129,89 +143,161 @@ public:
 	}
 
 	void put_pixel(int x, int y, GRgba c) {
-		SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, c.a);
-		SDL_RenderDrawPoint(renderer, x, y);
+		target.put_pixel(x, y, c);
 	}
 
 	void clear() {
-		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-		SDL_RenderClear(renderer);
-
-		clear_depth_buffer();
+		target.clear();
 	}
 
+	// text is queued and drawn on top of the frame when it is presented
 	void print(int x, int y, std::string text) {
-		font.draw_to_screen(x, y, font_color, text);
+		text_queue.push_back(GText{ x, y, text });
 	}
 
 	void run() {
+		if(headless)
+			throw std::runtime_error("headless windows cannot run");
+
 		clear();
 
 		while(!quit) {
-			u32 first = SDL_GetTicks(), delta;
+			// resize the render target between frames
+			if(scale_changed) {
+				resize_target();
+				scale_changed = false;
+			}
+
+			u64 first = SDL_GetPerformanceCounter();
 
 			while(SDL_PollEvent(&event)) {
 				scene->process(event);
 			}
 
+			// nothing changed, the presented frame is still valid
+			if(!scene->needs_redraw()) {
+				if(SDL_WaitEventTimeout(&event, idle_timeout_ms))
+					scene->process(event);
+				continue;
+			}
+
 			scene->draw();
 
-			delta = SDL_GetTicks() - first;
+			// post processing counts against the frame time
+			post_frame = post.empty() ? nullptr : &post.run(target);
+
+			float delta = (SDL_GetPerformanceCounter() - first) * 1000.0f / SDL_GetPerformanceFrequency();
 
 			{
 				std::stringstream ss;
-				ss << (int)(1000.0f / delta);
+				ss << (int)(1000.0f / delta) << " fps " << (int)delta << " ms";
 				print(0, 0, ss.str());
 			}
 
-			SDL_RenderPresent(renderer);
+			{
+				std::stringstream ss;
+				ss.precision(2);
+				ss << "scale " << dynamic_resolution.scale 
+					<< " (" << target.width << "x" << target.height << ")"
+					<< " budget hit " << (int)(dynamic_resolution.hit_rate() * 100) << "%";
+				print(0, height - 20, ss.str());
+			}
+
+			present();
+			scene->presented();
+
+			scale_changed = dynamic_resolution.update(delta);
 		}
 	}
 
+	// upscale the render target, or what post processing made of it, into the
+	// window and draw queued text
+	void present() {
+		if(headless)
+			return;
+
+		void* pixels;
+		int pitch;
+
+		if(SDL_LockTexture(frame_texture, NULL, &pixels, &pitch) == 0) {
+			const std::uint32_t* color = post_frame ? post_frame->data() : target.color.data();
+			GRenderTarget::upscale(color, target.width, target.height, (std::uint32_t*)pixels, pitch, width, height);
+			SDL_UnlockTexture(frame_texture);
+		}
+
+		SDL_RenderCopy(renderer, frame_texture, NULL, NULL);
+
+		for(const GText& t : text_queue)
+			font.draw_to_screen(t.x, t.y, font_color, t.text);
+
+		text_queue.clear();
+
+		SDL_RenderPresent(renderer);
+	}
+
+	void resize_target() {
+		target.resize(
+			std::max(1, (int)(width * dynamic_resolution.scale)),
+			std::max(1, (int)(height * dynamic_resolution.scale)));
+	}
+
 	SDL_PixelFormat* get_window_pixel_format() {
 		return SDL_GetWindowSurface(window)->format;
 	}
 
-	float* get_depth_buffer() {
-		return depth_buffer;
+	GRenderTarget& get_render_target() {
+		return target;
 	}
 
-	void clear_depth_buffer() {
-		if(depth_buffer != NULL) {
-			for(int i = 0; i < width * height - 1; i++)
-				depth_buffer[i] = INFINITY;
-		}
+	GWindowDepthBuffer& get_depth_buffer() {
+		return target.depth;
 	}
 
-	bool test_set_depth_buffer(int x, int y, float depth) {
-		if(x < 0 || y < 0 || x >= width || y >= height)
-			return false;
+	void clear_depth_buffer() {
+		target.depth.clear();
+	}
 
-		float* d = &depth_buffer[width * y + x];
-		
-		if(depth < *d) {
-			*d = depth;
-			return true;
-		}
-		
-		return false;
+	// z is the projected depth in [0, 1], inv_w is 1/w
+	bool test_set_depth_buffer(int x, int y, float z, float inv_w) {
+		return target.depth.test_set(x, y, z, inv_w);
 	}
 
 public:
 	int width;
 	int height;
 	bool quit;
+	bool headless;
 
 	SDL_Color font_color{255,255,255,255};
 
+	// scales the render target to hold the frame time budget
+	GDynamicResolution dynamic_resolution;
+
+	// longest sleep while the scene does not need redrawing
+	int idle_timeout_ms = 100;
+
+	// runs on every drawn frame before it is presented
+	GPostChain post;
+
 private:
+	struct GText {
+		int x, y;
+		std::string text;
+	};
+
 	SDL_Window* window;
 	SDL_Renderer* renderer;
 	SDL_Event event;
 	GFont font;
 
+	SDL_Texture* frame_texture;
+	std::vector<GText> text_queue;
+
 	GScene* scene;
-	float* depth_buffer;
+	GRenderTarget target;
+	bool scale_changed = false;
+
+	const std::vector<std::uint32_t>* post_frame = nullptr;
 };
 
 }
\ No newline at end of file
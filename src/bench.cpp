@@ -0,0 +1,944 @@
+// this file describes the demo's benchmarks
+
+#include "example.hpp"
+
+// an axis aligned box with flat normals, outward faces wound like the OBJ files
+static GMesh<GObjVertex> box_mesh(const vec3& min, const vec3& max) {
+	std::vector<GObjVertex> vertices;
+	std::vector<size_t> indices;
+
+	for(int axis = 0; axis < 3; axis++) {
+		for(int side = 0; side < 2; side++) {
+			vec3 normal(0);
+			normal[axis] = side ? 1.0f : -1.0f;
+
+			// u and v span the face so that u x v points along the normal
+			vec3 u(0), v(0);
+			u[(axis + 1) % 3] = 1;
+			v[(axis + 2) % 3] = 1;
+			if(!side)
+				std::swap(u, v);
+
+			vec3 center = (min + max) * 0.5f + normal * (max - min) * 0.5f;
+			vec3 half_u = u * (max - min) * 0.5f, half_v = v * (max - min) * 0.5f;
+			size_t base = vertices.size();
+
+			for(int k = 0; k < 4; k++) {
+				vec3 p = center + half_u * ((k == 1 || k == 2) ? 1.0f : -1.0f) + half_v * (k >= 2 ? 1.0f : -1.0f);
+				vertices.emplace_back(vec4(p, 1), vec2(k & 1, k >> 1), normal, vec3(1));
+			}
+
+			indices.insert(indices.end(), { base, base + 1, base + 2, base, base + 2, base + 3 });
+		}
+	}
+
+	return GMesh<GObjVertex>(vertices, indices);
+}
+
+// the dragon from close up to far away, drawn through its lod chain and at full
+// detail. the level the chain picks, the triangles it submits, frame time for
+// both and the pixels they differ in
+void ExampleScene::benchmark_lod() {
+	const int frames = 30;
+	const float distances[] = { 1.5f, 3, 6, 12, 25, 50 };
+
+	use_shadows = false;
+	pipeline.context.vertex_shader.shadow_map = nullptr;
+	draw_shadows_and_lights();
+
+	const GMesh<GObjVertex>& mesh = dragon_lods.levels[0];
+	GRenderTarget* target = pipeline.get_render_target();
+
+	std::cout << "distance\tlevel\ttriangles\tms lod\tms full\tdiffering pixels\n";
+
+	for(float distance : distances) {
+		vec3 center = mesh.bounds.center;
+
+		camera.eye = center + vec3(0.6f, 0.3f, 0.75f) * mesh.bounds.radius * distance;
+		camera.angle = normalize(center - camera.eye);
+		pipeline.context.vertex_shader.update();
+
+		// the two are interleaved frame by frame so that the machine warming up
+		// or slowing down hits both alike
+		std::size_t level = 0;
+		std::size_t triangles = 0;
+		float ms_lod = 0;
+		float ms_full = 0;
+
+		for(int i = 0; i < frames; i++) {
+			window.clear();
+			pipeline.stats.reset();
+			u64 start = SDL_GetPerformanceCounter();
+			// no previous level, so the pick has no hysteresis
+			level = dragon_lods.levels.size();
+			pipeline.process_lod(dragon_lods, level);
+			ms_lod += elapsed_ms(start) / frames;
+			triangles = pipeline.stats.triangles_submitted;
+
+			window.clear();
+			start = SDL_GetPerformanceCounter();
+			pipeline.process(mesh);
+			ms_full += elapsed_ms(start) / frames;
+		}
+
+		std::vector<std::uint32_t> full_color = target->color;
+
+		window.clear();
+		level = dragon_lods.levels.size();
+		pipeline.process_lod(dragon_lods, level);
+
+		std::cout << distance << "\t" << level << "\t" << triangles << "\t" << ms_lod
+			<< "\t" << ms_full << "\t" << frame_difference(target->color, full_color).pixels << "\n";
+	}
+}
+
+// a mesh drawn close up without and with the depth prepass. frame time,
+// fragments shaded and pixels that differ between the two
+void ExampleScene::benchmark_prepass(const std::string& filename) {
+	const int frames = 30;
+
+	use_shadows = false;
+	pipeline.context.vertex_shader.shadow_map = nullptr;
+	draw_shadows_and_lights();
+
+	GObj obj(filename);
+	const GMesh<GObjVertex>& mesh = obj.get_triangle_list();
+	GRenderTarget* target = pipeline.get_render_target();
+
+	vec3 center = mesh.bounds.center;
+	camera.eye = center + vec3(0.6f, 0.3f, 0.75f) * mesh.bounds.radius * 1.5f;
+	camera.angle = normalize(center - camera.eye);
+	pipeline.context.vertex_shader.update();
+
+	float ms[2] = { 0, 0 };
+	std::size_t fragments[2];
+	std::vector<std::uint32_t> color[2];
+
+	// interleaved frame by frame so that the machine warming up or slowing
+	// down hits both alike
+	for(int i = 0; i < frames; i++) {
+		for(int prepass = 0; prepass < 2; prepass++) {
+			window.clear();
+			pipeline.stats.reset();
+
+			u64 start = SDL_GetPerformanceCounter();
+			if(prepass) {
+				pipeline.state = GRasterState::depth_prepass();
+				pipeline.process(mesh);
+				pipeline.state = GRasterState::after_prepass();
+				pipeline.process(mesh);
+			} else {
+				pipeline.state = GRasterState{};
+				pipeline.process(mesh);
+			}
+			ms[prepass] += elapsed_ms(start) / frames;
+
+			fragments[prepass] = pipeline.stats.fragments_shaded;
+			if(i == frames - 1)
+				color[prepass] = target->color;
+		}
+	}
+
+	pipeline.state = GRasterState{};
+
+	std::size_t differing = frame_difference(color[0], color[1]).pixels;
+
+	std::cout << filename << ", " << mesh.indices.size() / 3 << " triangles\n"
+		<< "prepass\tms\tfragments shaded\tdiffering pixels\n"
+		<< "off\t" << ms[0] << "\t" << fragments[0] << "\t-\n"
+		<< "on\t" << ms[1] << "\t" << fragments[1] << "\t" << differing << "\n";
+}
+
+// frame time for a sweep of point light counts, tiled against brute force
+void ExampleScene::benchmark_lights() {
+	const int frames = 20;
+	use_shadows = false;
+	pipeline.context.vertex_shader.shadow_map = nullptr;
+
+	std::cout << "lights\ttiled ms\tbrute ms\tlights/tile\n";
+
+	for(std::size_t count : { 0, 16, 64, 256, 1024, 4096 }) {
+		set_point_light_count(count);
+		float ms[2];
+		float per_tile = 0;
+
+		for(int brute = 0; brute < 2; brute++) {
+			tiled_lights = !brute;
+
+			u64 start = SDL_GetPerformanceCounter();
+			for(int i = 0; i < frames; i++)
+				draw();
+
+			ms[brute] = elapsed_ms(start) / frames;
+
+			if(!brute)
+				per_tile = light_grid.average_lights();
+		}
+
+		std::cout << count << "\t" << ms[0] << "\t" << ms[1] << "\t" << per_tile << "\n";
+	}
+
+	tiled_lights = true;
+}
+
+// memory footprint, decode error and frame time of the full detail dragon in
+// every vertex format
+void ExampleScene::benchmark_vertex_formats() {
+	const GMesh<GObjVertex>& mesh = dragon_lods.levels[0];
+
+	use_shadows = false;
+	pipeline.context.vertex_shader.shadow_map = nullptr;
+	draw_shadows_and_lights();
+
+	std::cout << "format\tvertex bytes\tindex bytes\tbytes/vertex\tpos error\tnormal error deg\tms\n";
+
+	benchmark_vertex_format("mesh", mesh, 0, 0);
+	benchmark_vertex_format("float", GPackedMesh<GObjFormatFloat>(mesh), mesh);
+	benchmark_vertex_format("packed16", GPackedMesh<GObjFormatPacked16>(mesh), mesh);
+	benchmark_vertex_format("packed8", GPackedMesh<GObjFormatPacked8>(mesh), mesh);
+}
+
+template <class Format>
+void ExampleScene::benchmark_vertex_format(const std::string& name, const GPackedMesh<Format>& packed, const GMesh<GObjVertex>& mesh) {
+	float pos_error = 0, normal_error = 0;
+
+	for(std::size_t i = 0; i < mesh.vertices.size(); i++) {
+		GObjVertex v = packed.vertex(i);
+		pos_error = std::max(pos_error, distance(vec3(v.pos), vec3(mesh.vertices[i].pos)));
+
+		if(length(mesh.vertices[i].normal) > 0) {
+			float c = dot(v.normal, normalize(mesh.vertices[i].normal));
+			normal_error = std::max(normal_error, degrees(std::acos(clamp(c, -1.0f, 1.0f))));
+		}
+	}
+
+	benchmark_vertex_format(name, packed, pos_error, normal_error);
+}
+
+template <class Mesh>
+void ExampleScene::benchmark_vertex_format(const std::string& name, const Mesh& mesh, float pos_error, float normal_error) {
+	const int frames = 20;
+	std::size_t vertex_bytes = mesh.vertices.size() * sizeof(mesh.vertices[0]);
+
+	pipeline.process(mesh);
+
+	u64 start = SDL_GetPerformanceCounter();
+	for(int i = 0; i < frames; i++) {
+		window.clear();
+		pipeline.process(mesh);
+	}
+
+	float ms = elapsed_ms(start) / frames;
+
+	std::cout << name << "\t" << vertex_bytes 
+		<< "\t" << mesh.size_in_bytes() - vertex_bytes
+		<< "\t" << sizeof(mesh.vertices[0])
+		<< "\t" << pos_error << "\t" << normal_error << "\t" << ms << "\n";
+}
+
+// vertex cache misses, overdraw and frame time of the dragon in file order and
+// after the load time reordering, averaged over views around it
+void ExampleScene::benchmark_mesh_order() {
+	use_shadows = false;
+	pipeline.context.vertex_shader.shadow_map = nullptr;
+	draw_shadows_and_lights();
+
+	std::cout << "order\tacmr 16\tacmr 32\toverdraw\tms\n";
+
+	benchmark_mesh_order("file", object->get_triangle_list(false));
+	benchmark_mesh_order("optimized", object->get_triangle_list());
+}
+
+void ExampleScene::benchmark_mesh_order(const std::string& name, const GMesh<GObjVertex>& mesh) {
+	const int views = 8, frames = 5;
+	GRenderTarget* target = pipeline.get_render_target();
+	float overdraw = 0, ms = 0;
+
+	for(int v = 0; v < views; v++) {
+		float a = 2 * M_PI * v / views;
+		vec3 center = mesh.bounds.center;
+
+		camera.eye = center + vec3(cos(a), 0.3f, sin(a)) * mesh.bounds.radius * 2.5f;
+		camera.angle = normalize(center - camera.eye);
+		pipeline.context.vertex_shader.update();
+
+		u64 start = SDL_GetPerformanceCounter();
+		for(int i = 0; i < frames; i++) {
+			window.clear();
+			pipeline.stats.reset();
+			pipeline.process(mesh);
+		}
+
+		ms += elapsed_ms(start) / frames;
+
+		// shaded fragments per covered pixel
+		std::size_t covered = 0;
+		for(std::uint32_t c : target->color)
+			covered += c != target->clear_color;
+
+		overdraw += (float)pipeline.stats.fragments_shaded / std::max<std::size_t>(1, covered);
+	}
+
+	std::cout << name 
+		<< "\t" << vertex_cache_acmr(mesh.indices, mesh.vertices.size(), 16)
+		<< "\t" << vertex_cache_acmr(mesh.indices, mesh.vertices.size(), 32)
+		<< "\t" << overdraw / views << "\t" << ms / views << "\n";
+}
+
+// the dragon from close up to far away, with and without the small triangle
+// path. frame time, pixels that differ between the two and how the triangles
+// that reached the rasterizer spread over sizes
+void ExampleScene::benchmark_small_triangles() {
+	const int frames = 30;
+	const float distances[] = { 1.5f, 4, 10, 25 };
+
+	use_shadows = false;
+	pipeline.context.vertex_shader.shadow_map = nullptr;
+	draw_shadows_and_lights();
+
+	const GMesh<GObjVertex>& mesh = object->get_triangle_list();
+	GRenderTarget* target = pipeline.get_render_target();
+
+	std::cout << "distance\tms off\tms on\tsmall\tdiffering pixels";
+	for(int b = 0; b < GPipelineStats::size_buckets; b++)
+		std::cout << "\t" << GPipelineStats::size_bucket_name(b);
+	std::cout << "\n";
+
+	for(float distance : distances) {
+		vec3 center = mesh.bounds.center;
+
+		camera.eye = center + vec3(0.6f, 0.3f, 0.75f) * mesh.bounds.radius * distance;
+		camera.angle = normalize(center - camera.eye);
+		pipeline.context.vertex_shader.update();
+
+		float ms[2];
+		std::vector<std::uint32_t> reference;
+		std::size_t differing = 0;
+
+		for(int small = 0; small < 2; small++) {
+			pipeline.state.small_triangles = small;
+
+			u64 start = SDL_GetPerformanceCounter();
+			for(int i = 0; i < frames; i++) {
+				window.clear();
+				pipeline.stats.reset();
+				pipeline.process(mesh);
+			}
+
+			ms[small] = elapsed_ms(start) / frames;
+
+			if(!small)
+				reference = target->color;
+			else
+				differing = frame_difference(target->color, reference).pixels;
+		}
+
+		std::cout << distance << "\t" << ms[0] << "\t" << ms[1]
+			<< "\t" << pipeline.stats.triangles_small << "\t" << differing;
+		for(int b = 0; b < GPipelineStats::size_buckets; b++)
+			std::cout << "\t" << pipeline.stats.triangle_sizes[b];
+		std::cout << "\n";
+	}
+
+	pipeline.state.small_triangles = false;
+}
+
+// one frame of the scene through each post pass alone, then through the whole
+// chain with and without fusing and on one thread and on all of them
+void ExampleScene::benchmark_post() {
+	const int frames = 50;
+
+	draw_shadows_and_lights();
+	draw_scene();
+
+	const GRenderTarget& target = *pipeline.get_render_target();
+	std::cout << target.width << "x" << target.height << "\n"
+		<< "chain\tthreads\tsweeps\tms\n";
+
+	auto run = [&](const std::string& name, GPostChain& post) {
+		post.run(target);
+
+		u64 start = SDL_GetPerformanceCounter();
+		for(int i = 0; i < frames; i++)
+			post.run(target);
+
+		float ms = elapsed_ms(start) / frames;
+		std::cout << name << "\t" << (post.threads < 0 ? (int)std::thread::hardware_concurrency() : post.threads + 1)
+			<< "\t" << post.sweep_count() << "\t" << ms << "\n";
+	};
+
+	const std::pair<std::string, GPostPass> passes[] = {
+		{ "bloom", GPostPass::bloom() },
+		{ "tone map", GPostPass::tone_map(1.4f) },
+		{ "gamma", GPostPass::gamma(1.6f) },
+		{ "fxaa", GPostPass::fxaa() }
+	};
+
+	for(const auto& p : passes) {
+		GPostChain post;
+		post.add(p.second);
+		run(p.first, post);
+	}
+
+	for(int threads : { 0, -1 }) {
+		for(bool fuse : { false, true }) {
+			GPostChain post;
+			post.threads = threads;
+			post.fuse = fuse;
+			set_post_chain(post, true);
+			run(fuse ? "chain fused" : "chain unfused", post);
+		}
+	}
+}
+
+// the scene with one sample per pixel, with msaa and supersampled at twice the
+// resolution in both directions and box filtered down, which is what msaa is
+// compared against. frame time, fragments shaded, edge pixels, the memory the
+// target uses next to what storing every sample would take, and the mean and
+// largest channel difference from the supersampled frame
+void ExampleScene::benchmark_msaa() {
+	const int frames = 10;
+
+	// the light grid is built for the window's size
+	set_point_light_count(0);
+	draw_shadows_and_lights();
+
+	GRenderTarget* target = pipeline.get_render_target();
+	const int w = target->width, h = target->height;
+	const std::size_t depth_size = sizeof(GWindowDepthBuffer::value_type);
+
+	auto run = [&](GRenderTarget* t) {
+		pipeline.set_render_target(t);
+
+		u64 start = SDL_GetPerformanceCounter();
+		for(int i = 0; i < frames; i++) {
+			t->clear();
+			pipeline.stats.reset();
+			draw_scene();
+		}
+
+		pipeline.set_render_target(target);
+		return elapsed_ms(start) / frames;
+	};
+
+	GRenderTarget super(w * 2, h * 2);
+	float super_ms = run(&super);
+
+	std::vector<std::uint32_t> reference(w * h);
+	for(int y = 0; y < h; y++) {
+		for(int x = 0; x < w; x++) {
+			const std::uint32_t* row = &super.color[y * 2 * w * 2 + x * 2];
+			std::uint32_t c[4] = { row[0], row[1], row[w * 2], row[w * 2 + 1] };
+			std::uint32_t rb = 0, ag = 0;
+
+			for(std::uint32_t v : c) {
+				rb += v & 0x00ff00ff;
+				ag += (v >> 8) & 0x00ff00ff;
+			}
+
+			reference[y * w + x] = ((rb >> 2) & 0x00ff00ff) | (((ag >> 2) & 0x00ff00ff) << 8);
+		}
+	}
+
+	std::cout << w << "x" << h << "\n"
+		<< "mode\tms\tfragments\tedge pixels\tKB\tall samples KB\tmean error\tmax error\n"
+		<< "2x2 ssaa\t" << super_ms << "\t" << pipeline.stats.fragments_shaded << "\t-\t"
+		<< super.color.size() * (4 + depth_size) / 1024 << "\t-\t0\t0\n";
+
+	for(int samples : { 1, msaa_samples }) {
+		target->set_samples(samples);
+		float ms = run(target);
+
+		FrameDifference d = frame_difference(target->color, reference);
+
+		std::size_t bytes = target->color.size() * (4 + depth_size) + target->sample_store.size_in_bytes();
+
+		std::cout << samples << "x\t" << ms << "\t" << pipeline.stats.fragments_shaded
+			<< "\t" << target->sample_store.edge_count() << "\t" << bytes / 1024
+			<< "\t" << target->color.size() * samples * (4 + depth_size) / 1024
+			<< "\t" << d.mean << "\t" << d.max << "\n";
+	}
+
+	target->set_samples(1);
+}
+
+// the scene in every shading mode: frame time, fragment shader invocations,
+// pixels that took a block's color, and the mean and largest channel difference
+// from full rate shading. the tile mode's map follows the frame before, as in
+// the demo, and updating it is part of the frame time
+void ExampleScene::benchmark_shading_rate() {
+	const int frames = 10;
+
+	draw_shadows_and_lights();
+
+	GRenderTarget* target = pipeline.get_render_target();
+	std::vector<std::uint32_t> reference;
+
+	std::cout << "mode\tms\tinvocations\tbroadcast\tmean error\tmax error\n";
+
+	for(int m = 0; m < (int)ShadingMode::count; m++) {
+		set_shading_mode((ShadingMode)m);
+
+		auto frame = [&]() {
+			window.clear();
+			pipeline.stats.reset();
+			draw_scene();
+
+			if(shading_mode == ShadingMode::tiles)
+				rate_map.update(*target, rate_luma_step);
+		};
+
+		// the tile map starts at full rate and needs a frame to follow
+		frame();
+
+		u64 start = SDL_GetPerformanceCounter();
+		for(int i = 0; i < frames; i++)
+			frame();
+
+		float ms = elapsed_ms(start) / frames;
+
+		if(reference.empty())
+			reference = target->color;
+
+		FrameDifference d = frame_difference(target->color, reference);
+
+		std::cout << shading_mode_name(shading_mode) << "\t" << ms << "\t" << pipeline.stats.fragments_shaded
+			<< "\t" << pipeline.stats.fragments_broadcast << "\t" << d.mean << "\t" << d.max << "\n";
+	}
+
+	set_shading_mode(ShadingMode::full);
+}
+
+// each approximation against the standard library over a range of inputs: the
+// largest error, relative unless marked, the bound its comment states and the
+// time per value of both. then the dragon's vertices through the gouraud shader
+// with either math, in vertices per second, and the largest color difference
+// between the two, which has to stay below half a step. false if an error is
+// over its bound
+bool ExampleScene::benchmark_shader_math() {
+	const int n = 1 << 20;
+	std::vector<float> x(n), exact(n), fast(n);
+	int failed = 0;
+
+	auto fill = [&](float lo, float hi, bool log_spaced) {
+		for(int i = 0; i < n; i++) {
+			float t = (float)i / (n - 1);
+			x[i] = log_spaced ? lo * std::pow(hi / lo, t) : lo + (hi - lo) * t;
+		}
+	};
+
+	auto ns = [&](const std::function<void()>& f) {
+		u64 start = SDL_GetPerformanceCounter();
+		f();
+		return elapsed_ms(start) * 1e6f / n;
+	};
+
+	auto check = [&](double error, double bound) {
+		failed += error > bound;
+		return error > bound ? "\tFAILED" : "";
+	};
+
+	auto report = [&](const std::string& name, const std::string& range, bool relative, double bound,
+		float exact_ns, float fast_ns) {
+		double worst = 0;
+		for(int i = 0; i < n; i++) {
+			double e = std::abs((double)fast[i] - exact[i]);
+			worst = std::max(worst, relative ? e / std::abs(exact[i]) : e);
+		}
+
+		std::cout << name << "\t" << range << "\t" << worst << (relative ? "" : " abs") << "\t" << bound
+			<< "\t" << exact_ns << "\t" << fast_ns << check(worst, bound) << "\n";
+	};
+
+	auto row = [&](const std::string& name, const std::string& range, bool relative, double bound,
+		auto exact_f, auto fast_f) {
+		float exact_ns = ns([&]() { for(int i = 0; i < n; i++) exact[i] = exact_f(x[i]); });
+		float fast_ns = ns([&]() { for(int i = 0; i < n; i++) fast[i] = fast_f(x[i]); });
+		report(name, range, relative, bound, exact_ns, fast_ns);
+	};
+
+	auto row4 = [&](const std::string& name, const std::string& range, double bound, auto exact_f, auto fast_f) {
+		float exact_ns = ns([&]() { for(int i = 0; i < n; i++) exact[i] = exact_f(x[i]); });
+		float fast_ns = ns([&]() { for(int i = 0; i < n; i += 4) fast_f(f32x4::load(&x[i])).store(&fast[i]); });
+		report(name, range, true, bound, exact_ns, fast_ns);
+	};
+
+	std::cout << "function\trange\tmax error\tbound\texact ns\tfast ns\n";
+
+	// the f32x4 versions are good to about 22 bits, the same bounds hold for them.
+	// -ffast-math turns a float 1 / sqrt into an estimate too, rsqrt is measured
+	// against doubles
+	fill(1e-3f, 1e3f, true);
+	row("rcp", "1e-3..1e3", true, 3e-7, [](float v) { return 1 / v; }, [](float v) { return fast_rcp(v); });
+	row4("rcp x4", "1e-3..1e3", 3e-7, [](float v) { return 1 / v; }, [](f32x4 v) { return rcp(v); });
+	row("rsqrt", "1e-3..1e3", true, 5e-6, [](float v) { return (float)(1 / std::sqrt((double)v)); }, [](float v) { return fast_rsqrt(v); });
+	row4("rsqrt x4", "1e-3..1e3", 5e-6, [](float v) { return (float)(1 / std::sqrt((double)v)); }, [](f32x4 v) { return rsqrt(v); });
+
+	fill(1e-6f, 1e6f, true);
+	row("log2", "1e-6..1e6", false, 1e-5, [](float v) { return std::log2(v); }, [](float v) { return fast_log2(v); });
+
+	fill(-20, 20, false);
+	row("exp2", "-20..20", true, 1e-6, [](float v) { return std::exp2(v); }, [](float v) { return fast_exp2(v); });
+
+	// shininess is only known at run time in the shaders
+	volatile float shininess = 100;
+	float y = shininess;
+	const int table_size = 1024;
+	GSpecularTable table(y, table_size);
+
+	fill(0.5f, 1, false);
+	row("pow x^100", "0.5..1", true, 7e-6 * y + 1e-6,
+		[&](float v) { return std::pow(v, y); }, [&](float v) { return fast_pow(v, y); });
+
+	fill(0, 1, false);
+	row("specular x^100", "0..1", false, y * y / (8.0 * (table_size - 1) * (table_size - 1)),
+		[&](float v) { return std::pow(v, y); }, [&](float v) { return table(v); });
+
+	{
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> d(-100, 100);
+		std::vector<vec3> v(n / 4), exact_v(n / 4), fast_v(n / 4);
+
+		for(vec3& p : v)
+			p = vec3(d(rng), d(rng), d(rng));
+
+		float exact_ns = ns([&]() { for(std::size_t i = 0; i < v.size(); i++) exact_v[i] = GExactMath::normalize(v[i]); }) * 4;
+		float fast_ns = ns([&]() { for(std::size_t i = 0; i < v.size(); i++) fast_v[i] = GFastMath::normalize(v[i]); }) * 4;
+
+		float worst = 0;
+		for(std::size_t i = 0; i < v.size(); i++)
+			worst = std::max(worst, length(fast_v[i] - exact_v[i]));
+
+		// a unit vector scaled by rsqrt's relative error
+		std::cout << "normalize\t-100..100\t" << worst << " abs\t" << 5e-6 << "\t" << exact_ns << "\t" << fast_ns
+			<< check(worst, 5e-6) << "\n";
+	}
+
+	// the shader reads the global light and the camera
+	const GMesh<GObjVertex>& mesh = dragon_lods.levels[0];
+	const int frames = 10;
+
+	GouraudShader<GExactMath> exact_vs(window);
+	GouraudShader<GFastMath> fast_vs(window);
+	std::vector<GObjVertex> exact_out(mesh.vertices.size()), fast_out(mesh.vertices.size());
+
+	std::cout << "\nshader\texact Mvertices/s\tfast Mvertices/s\tmax color difference\n";
+
+	for(std::size_t lights : { 0, 64 }) {
+		set_point_light_count(lights);
+		draw_shadows_and_lights();
+
+		exact_vs.light_grid = fast_vs.light_grid = lights ? &light_grid : nullptr;
+
+		auto run = [&](auto& vs, std::vector<GObjVertex>& out) {
+			u64 start = SDL_GetPerformanceCounter();
+			for(int f = 0; f < frames; f++) {
+				for(std::size_t i = 0; i < mesh.vertices.size(); i++)
+					out[i] = vs(mesh.vertices[i]);
+			}
+
+			float s = elapsed_ms(start) / 1000;
+			return mesh.vertices.size() * frames / s / 1e6f;
+		};
+
+		// the best of a few alternating runs, other work on the machine only slows a run down
+		float exact_rate = 0, fast_rate = 0;
+		for(int r = 0; r < 5; r++) {
+			exact_rate = std::max(exact_rate, run(exact_vs, exact_out));
+			fast_rate = std::max(fast_rate, run(fast_vs, fast_out));
+		}
+
+		float worst = 0;
+		for(std::size_t i = 0; i < mesh.vertices.size(); i++) {
+			vec3 d = abs(fast_out[i].color - exact_out[i].color);
+			worst = std::max(worst, std::max(std::max(d.x, d.y), d.z));
+		}
+
+		std::cout << "sun + " << lights << " point lights\t" << exact_rate << "\t" << fast_rate
+			<< "\t" << worst * 255 << "/255" << check(worst * 255, 0.5) << "\n";
+	}
+
+	set_point_light_count(0);
+
+	if(failed)
+		std::cout << failed << " errors over their bound\n";
+	return failed == 0;
+}
+
+// the scene from several viewpoints, once as a pass per view and once as one
+// multi view draw: the six faces of a cube map around the camera and a stereo
+// pair. point lights are off, multi view shading leaves them out
+void ExampleScene::benchmark_multiview() {
+	set_point_light_count(0);
+	draw_shadows_and_lights();
+
+	GouraudVertShader& vs = pipeline.context.vertex_shader;
+	std::vector<std::pair<mat4x4, mat4x4>> cube, stereo;
+
+	const vec3 directions[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	const vec3 ups[6] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+
+	for(int i = 0; i < 6; i++) {
+		cube.push_back({ lookAt(camera.eye, camera.eye + directions[i], ups[i]),
+			perspective(radians(90.0f), 1.0f, vs.near, vs.far) });
+	}
+
+	// eyes 64 mm apart
+	vec3 right = normalize(cross(camera.angle, camera.up)) * 0.032f;
+	for(float side : { -1.0f, 1.0f }) {
+		vec3 eye = camera.eye + right * side;
+		stereo.push_back({ lookAt(eye, eye + camera.angle, camera.up), vs.get_projection() });
+	}
+
+	std::cout << "views	size	passes ms	multiview ms	speedup	differing pixels\n";
+
+	benchmark_multiview("cube", cube, 256, 256);
+	benchmark_multiview("stereo", stereo, window.width / 2, window.height / 2);
+
+	vs.update();
+}
+
+void ExampleScene::benchmark_multiview(const std::string& name, const std::vector<std::pair<mat4x4, mat4x4>>& views, int w, int h) {
+	const int frames = 5;
+	GouraudVertShader& vs = pipeline.context.vertex_shader;
+	GRenderTarget* main_target = pipeline.get_render_target();
+
+	std::vector<GRenderTarget> passes(views.size(), GRenderTarget(w, h)), shared(views.size(), GRenderTarget(w, h));
+	std::vector<GView> multiview;
+
+	for(std::size_t i = 0; i < views.size(); i++)
+		multiview.push_back(GView{ views[i].second * views[i].first, &shared[i] });
+
+	u64 start = SDL_GetPerformanceCounter();
+	for(int f = 0; f < frames; f++) {
+		for(std::size_t i = 0; i < views.size(); i++) {
+			passes[i].clear();
+			pipeline.set_render_target(&passes[i]);
+			vs.set_view(views[i].first, views[i].second);
+
+			pipeline.process(dragon_lods.levels[0]);
+			pipeline.process_instanced(mesh2, mesh2_instances);
+			vs.set_model(mat4x4(1));
+		}
+	}
+	float passes_ms = elapsed_ms(start) / frames;
+
+	// specular highlights are seen from the first view's eye
+	vs.set_view(views[0].first, views[0].second);
+
+	start = SDL_GetPerformanceCounter();
+	for(int f = 0; f < frames; f++) {
+		for(GRenderTarget& t : shared)
+			t.clear();
+
+		pipeline.process_multiview(dragon_lods.levels[0], multiview);
+		for(const mat4x4& model : mesh2_instances) {
+			vs.set_model(model);
+			pipeline.process_multiview(mesh2, multiview);
+		}
+		vs.set_model(mat4x4(1));
+	}
+	float multiview_ms = elapsed_ms(start) / frames;
+
+	pipeline.set_render_target(main_target);
+
+	// lighting is computed in another space, allow for rounding
+	std::size_t differing = 0;
+	for(std::size_t i = 0; i < views.size(); i++)
+		differing += frame_difference(passes[i].color, shared[i].color, 2).pixels;
+
+	std::cout << name << " x" << views.size() << "\t" << w << "x" << h
+		<< "\t" << passes_ms << "\t" << multiview_ms << "\t" << passes_ms / multiview_ms
+		<< "\t" << differing << "\n";
+}
+
+// a wall in front of a grid of suzannes, with the camera sliding past it so
+// objects keep coming into view at its edges. frame time and objects drawn with
+// and without occlusion culling, and pixels that differ between the two
+void ExampleScene::benchmark_occlusion() {
+	const int frames = 60;
+
+	use_shadows = false;
+	pipeline.context.vertex_shader.shadow_map = nullptr;
+	draw_shadows_and_lights();
+
+	GMesh<GObjVertex> wall = box_mesh(vec3(-6, -1, 0), vec3(6, 5, 0.5f));
+	std::vector<mat4x4> saved_instances = mesh2_instances;
+
+	mesh2_instances.clear();
+	for(int z = 0; z < 8; z++) {
+		for(int x = 0; x < 8; x++)
+			mesh2_instances.push_back(translate(mat4x4(1), vec3(x * 2.5f - 8.75f, 2, -2 - z * 2.5f)));
+	}
+
+	GRenderTarget* target = pipeline.get_render_target();
+	std::vector<std::vector<std::uint32_t>> reference;
+
+	std::cout << "occlusion	ms	drawn	skipped	revealed	differing pixels\n";
+
+	for(bool occlusion_culling : { false, true }) {
+		use_occlusion = occlusion_culling;
+		occlusion.reset();
+		occlusion.stats.reset();
+
+		float ms = 0;
+		std::size_t differing = 0;
+
+		for(int f = 0; f < frames; f++) {
+			camera.eye = vec3(-12 + 24.0f * f / (frames - 1), 2.5f, 8);
+			camera.angle = normalize(vec3(camera.eye.x * 0.5f, 2, 0) - camera.eye);
+			pipeline.context.vertex_shader.update();
+
+			u64 start = SDL_GetPerformanceCounter();
+
+			window.clear();
+			pipeline.process(wall);
+			draw_scene();
+
+			ms += elapsed_ms(start);
+
+			if(!occlusion_culling)
+				reference.push_back(target->color);
+			else
+				differing += frame_difference(target->color, reference[f]).pixels;
+		}
+
+		std::cout << (occlusion_culling ? "on" : "off") << "\t" << ms / frames
+			<< "\t" << (float)(occlusion_culling ? occlusion.stats.drawn : frames * object_count()) / frames
+			<< "\t" << (float)occlusion.stats.skipped / frames
+			<< "\t" << occlusion.stats.revealed << "\t" << differing << "\n";
+	}
+
+	mesh2_instances = saved_instances;
+	use_occlusion = false;
+}
+
+// peak signal to noise ratio of a sampler's texels against the original image
+template <class Source>
+static float texture_psnr(Source& s, const GImage& image, int channels) {
+	double error = 0;
+
+	for(int y = 0; y < image.height; y++) {
+		for(int x = 0; x < image.width; x++) {
+			GRgba a = s.texel(x, y), b = image.texel(x, y);
+
+			for(int c = 0; c < channels; c++) {
+				double d = (&a.r)[c] - (&b.r)[c];
+				error += d * d;
+			}
+		}
+	}
+
+	error /= (double)image.width * image.height * channels;
+	return error > 0 ? 10 * std::log10(255.0 * 255.0 / error) : INFINITY;
+}
+
+// bilinear samples per second over a rotated screen sized grid of coordinates,
+// `scale` texels per pixel
+template <class Source>
+static float texture_throughput(Source& s, float scale) {
+	const int w = 800, h = 600;
+	std::uint32_t sum = 0;
+
+	u64 start = SDL_GetPerformanceCounter();
+	for(int y = 0; y < h; y++) {
+		for(int x = 0; x < w; x++) {
+			vec2 uv((x * 0.9f + y * 0.3f) * scale / s.width, (y * 0.9f - x * 0.3f) * scale / s.height);
+			GRgba c = sample_bilinear(s, uv);
+			sum += c.r + c.a;
+		}
+	}
+
+	float seconds = elapsed_ms(start) / 1000;
+
+	// keep the loop from being optimized away
+	if(sum == 1)
+		std::cout << "";
+
+	return w * h / seconds / 1e6f;
+}
+
+// memory, quality and sampling speed of a texture uncompressed and block compressed
+void benchmark_textures(GWindow& window, const std::string& filename) {
+	GTexture texture(window.get_window_pixel_format(), filename);
+	GImage image(texture);
+
+	GCompressedTexture<GBC1> bc1(image);
+	GCompressedTexture<GBC3> bc3(image);
+	GCompressedSampler<GBC1> bc1_sampler(bc1);
+	GCompressedSampler<GBC3> bc3_sampler(bc3);
+
+	std::cout << filename << " " << image.width << "x" << image.height << "\n"
+		<< "format\tbytes\tpsnr db\tMsamples/s 1:1\tMsamples/s 4:1\n";
+
+	std::cout << "rgba8\t" << image.size_in_bytes() << "\t-\t"
+		<< texture_throughput(image, 1) << "\t" << texture_throughput(image, 4) << "\n";
+
+	std::cout << "bc1 uncached\t" << bc1.size_in_bytes() << "\t" << texture_psnr(bc1, image, 3) << "\t"
+		<< texture_throughput(bc1, 1) << "\t" << texture_throughput(bc1, 4) << "\n";
+
+	std::cout << "bc1\t" << bc1.size_in_bytes() << "\t" << texture_psnr(bc1_sampler, image, 3) << "\t"
+		<< texture_throughput(bc1_sampler, 1) << "\t" << texture_throughput(bc1_sampler, 4) << "\n";
+
+	std::cout << "bc3\t" << bc3.size_in_bytes() << "\t" << texture_psnr(bc3_sampler, image, 4) << "\t"
+		<< texture_throughput(bc3_sampler, 1) << "\t" << texture_throughput(bc3_sampler, 4) << "\n";
+}
+
+// skinned vertices per millisecond of the dragon on a chain of joints, one vertex
+// at a time with glm, with the simd kernel and with the simd kernel on teams of
+// threads, and how far the simd results are from the reference
+void benchmark_skinning(const std::string& filename, int joint_count) {
+	const int frames = 50;
+
+	GSkeleton skeleton;
+	GSkinnedMesh<GObjVertex> skinned = rig_chain(GObj(filename).get_triangle_list(), joint_count, skeleton);
+	GAnimationClip clip = swim_clip(skeleton, 2.0f, 0.25f);
+	GPose pose;
+
+	std::size_t vertices = skinned.vertex_count();
+	std::cout << filename << " " << vertices << " vertices, " << joint_count << " joints\n";
+
+	{
+		u64 start = SDL_GetPerformanceCounter();
+		for(int f = 0; f < frames; f++)
+			pose.evaluate(skeleton, clip, f * 0.04f);
+
+		std::cout << "pose evaluation " << elapsed_ms(start) * 1000 / frames << " us\n";
+	}
+
+	std::cout << "kernel\tthreads\tvertices/ms\tmax error\n";
+
+	auto run = [&](const std::string& name, int threads, auto skin) {
+		float error = 0;
+		u64 ticks = 0;
+
+		for(int f = 0; f < frames; f++) {
+			pose.evaluate(skeleton, clip, f * 0.04f);
+
+			u64 start = SDL_GetPerformanceCounter();
+			skin();
+			ticks += SDL_GetPerformanceCounter() - start;
+
+			// against the reference, outside the timing
+			if(f % 10 == 0) {
+				std::vector<GObjVertex> result = skinned.mesh.vertices;
+				skinned.skin_reference(pose.skinning);
+
+				for(std::size_t i = 0; i < vertices; i++)
+					error = std::max(error, length(vec3(result[i].pos) - vec3(skinned.mesh.vertices[i].pos)));
+			}
+		}
+
+		float ms = ticks * 1000.0f / SDL_GetPerformanceFrequency();
+		std::cout << name << "\t" << threads << "\t" << vertices * frames / ms << "\t" << error << "\n";
+	};
+
+	run("reference", 1, [&]() { skinned.skin_reference(pose.skinning); });
+	run("simd", 1, [&]() { skinned.skin(pose.skinning); });
+
+	int cores = std::max(1u, std::thread::hardware_concurrency());
+	for(int threads = 2; threads <= std::max(cores, 2); threads *= 2) {
+		GThreadTeam team(threads - 1);
+		run("simd", threads, [&]() { skinned.skin(pose.skinning, &team); });
+	}
+}
@@ -0,0 +1,55 @@
+// this file describes what the demo's modes share: the helpers they time and
+// compare frames with, and the modes main dispatches to outside of ExampleScene
+
+#pragma once
+
+#include "gfx.hpp"
+
+using namespace demo;
+
+// milliseconds since a SDL_GetPerformanceCounter reading
+inline float elapsed_ms(u64 start) {
+	return (SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency();
+}
+
+// how far an ARGB8888 frame is from another of the same size, by color channel
+struct FrameDifference {
+	double mean = 0; // over every channel of every pixel
+	int max = 0;
+	std::size_t pixels = 0; // with a channel more than the tolerance apart
+};
+
+inline FrameDifference frame_difference(const std::vector<std::uint32_t>& a, const std::vector<std::uint32_t>& b,
+	int tolerance = 0) {
+	FrameDifference d;
+
+	for(std::size_t i = 0; i < a.size(); i++) {
+		int worst = 0;
+		for(int shift = 0; shift < 24; shift += 8) {
+			int c = std::abs((int)((a[i] >> shift) & 0xff) - (int)((b[i] >> shift) & 0xff));
+			d.mean += c;
+			worst = std::max(worst, c);
+		}
+
+		d.max = std::max(d.max, worst);
+		d.pixels += worst > tolerance;
+	}
+
+	if(!a.empty())
+		d.mean /= a.size() * 3;
+	return d;
+}
+
+// bench.cpp
+void benchmark_textures(GWindow& window, const std::string& filename);
+void benchmark_skinning(const std::string& filename, int joint_count);
+
+// split.cpp
+void split_worker(GSplitFrame& frame, const std::string& dragon_file, const std::string& suzanne_file,
+	int index, int in, int out);
+float split_frames(int workers, int width, int height, GRenderTarget& image);
+void benchmark_split(int max_workers, int width, int height);
+
+// server.cpp
+void serve(const std::string& path, int threads, const std::vector<std::string>& scenes);
+void send_requests(const std::string& path, const std::string& request, int count, const std::string& out);
@@ -0,0 +1,1085 @@
+// this file describes the demo's scene: the camera and light, the shaders, and the
+// scene the window shows and the replays and benchmarks draw
+
+#pragma once
+
+#include "demo.hpp"
+
+struct Light {
+	vec3 pos;
+	vec3 diffuse;
+	vec3 ambient;
+	vec3 specular;
+	vec3 color;
+	float shinyness;
+};
+
+inline Light light{
+	{ 0, 0, 10 }, 
+	{1.f, 1.f, 1.f}, 
+	{0.1f, 0.1f, 0.1f}, 
+	{1.f, 1.f, 1.f}, 
+	{1.f, 1.f, 1.f}, 
+	100.f
+};
+
+struct Camera {
+	vec3 eye;
+	vec3 angle;
+	vec3 up;
+
+	float pitch;
+	float yaw;
+	
+	float speed = 4.f; // units per second
+	float turn_speed = 90.f; // degrees per second
+
+	Camera() :
+		eye(0, 0, 0),
+		angle(0, 0, -1),
+		up(0, 1, 0) { }
+
+	void update() {
+		float pitch_rad = radians(pitch), 
+            yaw_rad = radians(yaw);
+
+        angle = normalize(vec3(
+            cos(yaw_rad) * cos(pitch_rad), 
+            sin(pitch_rad), 
+            sin(yaw_rad) * cos(pitch_rad)));
+	}
+};
+
+inline Camera camera;
+
+// everything the simulation thread owns. the render loop copies it into the camera
+// and light above before drawing
+struct SimState {
+	Camera camera;
+	vec3 light_pos;
+	float instance_angle = 0;
+	float animation_time = 0;
+
+	bool animate_light = true;
+	bool spin_instance = false;
+	bool animate_dragon = false;
+
+	// keys held down
+	bool forward = false;
+	bool backward = false;
+	bool turn_left = false;
+	bool turn_right = false;
+	bool look_up = false;
+	bool look_down = false;
+};
+
+// Math is GExactMath or GFastMath
+template <class Math>
+class GouraudShader : public GShader<GObjVertex, GObjVertex> {
+public:
+	GouraudShader(GWindow& win) :
+		GShader(win),
+		aspect_ratio((float)win.width / win.height),
+		fov(45),
+		far(10000.0f), near(0.1f) { 
+		update();
+	}
+
+	OutputType operator()(const InputType& v) {
+		vec3 pos = model_view * v.pos;
+		vec3 light_pos = view * vec4(light.pos, 1);
+
+		vec3 N = Math::normalize(normal_matrix * v.normal);
+		vec3 L = Math::normalize(light_pos - pos);
+		vec3 V = Math::normalize(-pos);
+
+		vec3 diffuse, specular;
+		sun_light(v, N, L, V, diffuse, specular);
+
+		vec4 clip = model_view_projection * v.pos;
+
+		// point lights binned into the screen tile this vertex lands in
+		if(light_grid && clip.w > 0) {
+			float inv_w = Math::rcp(clip.w);
+			float sx = (clip.x * inv_w + 1) * 0.5f * light_grid->width,
+				sy = (-clip.y * inv_w + 1) * 0.5f * light_grid->height;
+			auto tile = light_grid->lights_at(sx, sy);
+
+			for(const std::uint32_t* i = tile.first; i != tile.second; i++) {
+				const GPointLight& p = light_grid->view_lights[*i];
+				vec3 to_light = p.pos - pos;
+				float d2 = dot(to_light, to_light);
+
+				if(d2 >= p.radius * p.radius)
+					continue;
+
+				float inv_d = Math::rsqrt(d2);
+				float falloff = 1 - d2 * inv_d / p.radius;
+				diffuse += max(dot(to_light, N) * inv_d, 0.0f) * falloff * falloff * p.color;
+			}
+		}
+
+		vec3 color = saturate(light.color * (light.ambient + diffuse + specular));
+
+		return OutputType(clip, v.uv, N, color);
+	}
+
+	// the same lighting in world space without the projection, for multi view
+	// draws. specular highlights are seen from the eye of the current view, so
+	// views around one point (cube map faces) light exactly like separate draws.
+	// point lights are binned per tile of the main view and are left out
+	OutputType shade_world(const InputType& v) {
+		vec4 pos = model * v.pos;
+
+		vec3 N = Math::normalize(world_normal_matrix * v.normal);
+		vec3 L = Math::normalize(light.pos - vec3(pos));
+		vec3 V = Math::normalize(eye - vec3(pos));
+
+		vec3 diffuse, specular;
+		sun_light(v, N, L, V, diffuse, specular);
+
+		vec3 color = saturate(light.color * (light.ambient + diffuse + specular));
+
+		return OutputType(pos, v.uv, N, color);
+	}
+
+	void update() {
+		set_view(lookAt(camera.eye, camera.eye + camera.angle, camera.up), perspective(fov, aspect_ratio, near, far));
+
+		if(specular_table.shininess != light.shinyness)
+			specular_table = GSpecularTable(light.shinyness);
+	}
+
+	// look from somewhere else than the camera, until the next update
+	void set_view(const mat4x4& v, const mat4x4& p) {
+		view = v;
+		projection = p;
+		eye = vec3(inverse(view)[3]);
+		set_model(model);
+	}
+
+	void set_model(const mat4x4& m) {
+		model = m;
+		model_view = view * model;
+		model_view_projection = projection * model_view;
+		normal_matrix = transpose(inverse(mat3x3(model_view)));
+		world_normal_matrix = transpose(inverse(mat3x3(model)));
+	}
+
+	const mat4x4& get_model() const {
+		return model;
+	}
+
+	mat4x4 clip_matrix() {
+		return model_view_projection;
+	}
+
+	const mat4x4& get_view() const {
+		return view;
+	}
+
+	const mat4x4& get_projection() const {
+		return projection;
+	}
+
+	float aspect_ratio;
+	float fov;
+	float far;
+	float near;
+
+	// optional, shadows are looked up per vertex
+	const GShadowMap* shadow_map = nullptr;
+
+	// optional, point lights binned for this frame
+	const GLightGrid* light_grid = nullptr;
+
+private:
+	// diffuse and specular of the main light, shadowed. N, L and V in any space
+	void sun_light(const InputType& v, const vec3& N, const vec3& L, const vec3& V, vec3& diffuse, vec3& specular) {
+		vec3 H = Math::normalize(L + V);
+
+		diffuse = max(dot(L, N), 0.0f) * light.diffuse;
+		specular = Math::specular(specular_table, max(dot(N, H), 0.0f)) * light.specular;
+
+		if(shadow_map) {
+			float lit = shadow_map->visibility(model * v.pos, Math::normalize(mat3x3(model) * v.normal));
+			diffuse *= lit;
+			specular *= lit;
+		}
+	}
+
+	mat4x4 projection;
+	mat4x4 view;
+	mat4x4 model{ 1 };
+	mat4x4 model_view;
+	mat4x4 model_view_projection;
+	mat3x3 normal_matrix;
+	mat3x3 world_normal_matrix;
+	vec3 eye;
+
+	// pow(n.h, light.shinyness), rebuilt when the shininess changes
+	GSpecularTable specular_table;
+};
+
+using GouraudVertShader = GouraudShader<DEMO_SHADER_MATH>;
+
+class GeoShader : public GShader<GTriangle<GObjVertex>, GTriangle<GObjVertex>> {
+public:
+	GeoShader(GWindow& win) : GShader(win) { }
+	
+	OutputType operator()(const InputType& tri) {
+		return tri;
+	}
+
+	void update() { }
+};
+
+class ColorFragShader : public GShader<GObjVertex, GRgba> {
+public:
+	ColorFragShader(GWindow& win) : 
+		GShader(win) { }
+
+	GRgba operator()(const GObjVertex& v) {
+		return GRgba{ 
+			(u8)(v.color.x * 255), 
+			(u8)(v.color.y * 255), 
+			(u8)(v.color.z * 255), 
+			255
+		};
+	}
+
+	void update() { }
+};
+
+// a chain of joints through the middle of the mesh along its longest side. each
+// vertex is weighted between the two joints it lies between. joint indices are
+// bytes, so 2 to 256 joints
+inline GSkinnedMesh<GObjVertex> rig_chain(const GMesh<GObjVertex>& mesh, int joint_count, GSkeleton& skeleton) {
+	if(joint_count < 2 || joint_count > 256)
+		throw std::runtime_error("a chain needs 2 to 256 joints");
+
+	const GBounds& b = mesh.bounds;
+	vec3 extent = b.max - b.min;
+	int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+	vec3 start = b.center, step(0);
+	start[axis] = b.min[axis];
+	step[axis] = extent[axis] / (joint_count - 1);
+
+	skeleton = GSkeleton();
+	for(int j = 0; j < joint_count; j++)
+		skeleton.add_joint(j - 1, translate(mat4x4(1), start + step * (float)j));
+
+	std::vector<GSkinVertex> bind(mesh.vertices.size());
+
+	for(std::size_t i = 0; i < bind.size(); i++) {
+		const GObjVertex& v = mesh.vertices[i];
+		float t = (v.pos[axis] - b.min[axis]) / extent[axis] * (joint_count - 1);
+		int j = clamp((int)t, 0, joint_count - 2);
+		float w = smoothstep(0.0f, 1.0f, t - j);
+
+		bind[i] = GSkinVertex{ vec3(v.pos), v.normal, { (std::uint8_t)j, (std::uint8_t)(j + 1), 0, 0 }, { 1 - w, w, 0, 0 } };
+	}
+
+	return GSkinnedMesh<GObjVertex>(mesh, bind);
+}
+
+// a wave running down a chain from rig_chain, each joint turning about the up
+// axis (or x for an upright chain) a little after its parent
+inline GAnimationClip swim_clip(const GSkeleton& skeleton, float duration, float amplitude) {
+	const int keys = 16;
+	GAnimationClip clip(duration, skeleton.joints.size());
+
+	vec3 chain = vec3(skeleton.joints.back().local[3]);
+	vec3 bend_axis = std::abs(chain.y) > std::abs(chain.x) + std::abs(chain.z) ? vec3(1, 0, 0) : vec3(0, 1, 0);
+
+	for(std::size_t j = 0; j < skeleton.joints.size(); j++) {
+		vec3 offset = vec3(skeleton.joints[j].local[3]);
+
+		for(int k = 0; k <= keys; k++) {
+			float phase = 2 * M_PI * k / keys - j * 0.8f;
+			float angle = j == 0 ? 0 : amplitude * std::sin(phase);
+
+			clip.add_key(j, GJointKey{ duration * k / keys, offset, angleAxis(angle, bend_axis), vec3(1) });
+		}
+	}
+
+	return clip;
+}
+
+// bloom, then tone mapping and gamma in the same sweep, then fxaa
+inline void set_post_chain(GPostChain& post, bool enabled) {
+	post.clear();
+
+	if(!enabled)
+		return;
+
+	post.add(GPostPass::bloom());
+	post.add(GPostPass::tone_map(1.4f));
+	post.add(GPostPass::gamma(1.6f));
+	post.add(GPostPass::fxaa());
+}
+
+// how the demo picks coarse shading rates
+enum class ShadingMode {
+	full,
+	blocks_2x2,
+	blocks_4x4,
+	tiles, // per screen tile, from the last frame
+	gradients, // per triangle, from its varyings
+	count
+};
+
+inline const char* shading_mode_name(ShadingMode m) {
+	static const char* names[] = { "full", "2x2", "4x4", "tiles", "gradients" };
+	return names[(int)m];
+}
+
+class ExampleScene : public GScene {
+public:
+	using EContext = GContext<
+		GouraudVertShader, 
+		GeoShader, 
+		ColorFragShader>;
+
+	// without the dragon, for a scene that streams a mesh in its place
+	ExampleScene(GWindow& win, bool with_dragon = true) :
+		pipeline(win),
+		shadow_pipeline(win),
+		shadow_map(1024),
+		window(win),
+		object2("../assets/suzanne.obj") {
+		win.register_scene(this);
+		
+		// init camera
+		camera.up = { 0, 1, 0 };
+		camera.eye = { 0, 2, 5 };
+		camera.angle = { 0, 0, -1 };
+		camera.yaw = -90.0f;
+		camera.pitch = 0.0f;
+
+		camera.update();
+		pipeline.context.vertex_shader.update();
+
+		if(with_dragon)
+			load_dragon();
+		mesh2 = object2.get_triangle_list();
+
+		mesh2_instances.push_back(translate(mat4x4(1), vec3(0, 10, 0)));
+
+		shadow_pipeline.set_render_target(&shadow_map.target);
+		shadow_pipeline.state = GRasterState::depth_prepass();
+		pipeline.context.vertex_shader.shadow_map = &shadow_map;
+		pipeline.context.vertex_shader.light_grid = &light_grid;
+
+		SimState initial;
+		initial.camera = camera;
+		initial.light_pos = light.pos;
+
+		// wake the window if it is sleeping on an unchanged frame
+		simulation.on_publish = []() {
+			SDL_Event e{};
+			e.type = SDL_USEREVENT;
+			SDL_PushEvent(&e);
+		};
+
+		simulation.start(initial, simulate);
+
+		// captures refer to meshes by these names
+		capture.add_mesh("suzanne.obj", &mesh2);
+	}
+
+	// the dragon's lod chain and its skinned copy
+	void load_dragon() {
+		object.reset(new GObj("../assets/dragon.obj"));
+		dragon_lods = object->get_lod_chain(6);
+
+		skinned_dragon.reset(new GSkinnedMesh<GObjVertex>(rig_chain(dragon_lods.levels[0], 8, dragon_skeleton)));
+		dragon_clip = swim_clip(dragon_skeleton, 2.0f, 0.25f);
+
+		for(std::size_t i = 0; i < dragon_lods.levels.size(); i++)
+			capture.add_mesh("dragon.obj/lod" + std::to_string(i), &dragon_lods.levels[i]);
+	}
+
+	// one fixed time step on the simulation thread, touches nothing but the state
+	static bool simulate(SimState& s, const std::vector<SDL_Event>& events, float dt) {
+		for(const SDL_Event& e : events) {
+			if(e.type != SDL_KEYDOWN && e.type != SDL_KEYUP)
+				continue;
+
+			bool down = e.type == SDL_KEYDOWN;
+			bool pressed = down && !e.key.repeat;
+
+			switch(e.key.keysym.sym) {
+			case SDLK_w: s.forward = down; break; // move forward
+			case SDLK_s: s.backward = down; break; // move backward
+			case SDLK_RIGHT: s.turn_right = down; break; // turn right
+			case SDLK_LEFT: s.turn_left = down; break; // turn left
+			case SDLK_UP: s.look_up = down; break; // look up
+			case SDLK_DOWN: s.look_down = down; break; // look down
+			case SDLK_p: // pause the light
+				if(pressed)
+					s.animate_light = !s.animate_light;
+				break;
+			case SDLK_r: // spin the instanced mesh
+				if(pressed)
+					s.spin_instance = !s.spin_instance;
+				break;
+			case SDLK_b: // animate the dragon
+				if(pressed)
+					s.animate_dragon = !s.animate_dragon;
+				break;
+			}
+		}
+
+		Camera& c = s.camera;
+		bool changed = false;
+
+		if(s.turn_right != s.turn_left) {
+			c.yaw = std::fmod(c.yaw + (s.turn_right ? 1 : -1) * c.turn_speed * dt + 360, 360.0f);
+			changed = true;
+		}
+
+		if(s.look_up != s.look_down) {
+			c.pitch = std::fmod(c.pitch + (s.look_up ? 1 : -1) * c.turn_speed * dt + 360, 360.0f);
+			changed = true;
+		}
+
+		if(changed)
+			c.update();
+
+		if(s.forward != s.backward) {
+			c.eye += c.angle * ((s.forward ? 1 : -1) * c.speed * dt);
+			changed = true;
+		}
+
+		if(s.animate_light) {
+			const float t = 0.6f * dt;
+			mat3x3 angle(
+				vec3(cos(t), 0, sin(t)),
+				vec3(0, 1, 0),
+				vec3(-sin(t), 0, cos(t))
+			);
+
+			s.light_pos = angle * s.light_pos;
+			changed = true;
+		}
+
+		if(s.spin_instance) {
+			s.instance_angle += 2.4f * dt;
+			changed = true;
+		}
+
+		if(s.animate_dragon) {
+			s.animation_time += dt;
+			changed = true;
+		}
+
+		return changed;
+	}
+
+	// scatter lights around the dragon, the same ones for the same count
+	void set_point_light_count(std::size_t count) {
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> pos(-8, 8), height(0, 6), radius(1, 3), color(0.2f, 1);
+
+		point_lights.clear();
+
+		for(std::size_t i = 0; i < count; i++) {
+			point_lights.push_back(GPointLight{ 
+				vec3(pos(rng), height(rng), pos(rng)), 
+				radius(rng), 
+				vec3(color(rng), color(rng), color(rng)) 
+			});
+		}
+	}
+
+	// the benchmarks, in bench.cpp
+	void benchmark_lod();
+	void benchmark_prepass(const std::string& filename);
+	void benchmark_lights();
+	void benchmark_vertex_formats();
+	template <class Format>
+	void benchmark_vertex_format(const std::string& name, const GPackedMesh<Format>& packed, const GMesh<GObjVertex>& mesh);
+	template <class Mesh>
+	void benchmark_vertex_format(const std::string& name, const Mesh& mesh, float pos_error, float normal_error);
+	void benchmark_mesh_order();
+	void benchmark_mesh_order(const std::string& name, const GMesh<GObjVertex>& mesh);
+	void benchmark_small_triangles();
+	void benchmark_post();
+	void benchmark_msaa();
+	void benchmark_shading_rate();
+	bool benchmark_shader_math();
+	void benchmark_multiview();
+	void benchmark_multiview(const std::string& name, const std::vector<std::pair<mat4x4, mat4x4>>& views, int w, int h);
+	void benchmark_occlusion();
+
+	void process(const SDL_Event& event) {
+		switch(event.type) {
+		case SDL_QUIT: window.quit = true; break;
+		case SDL_KEYDOWN: 
+		case SDL_KEYUP:
+			// movement and animation belong to the simulation thread
+			simulation.push(event);
+
+			if(event.type != SDL_KEYDOWN)
+				break;
+
+			switch(event.key.keysym.sym) {
+			case SDLK_z: // toggle depth prepass
+				use_prepass = !use_prepass;
+				break;
+			case SDLK_x: // toggle shadows
+				use_shadows = !use_shadows;
+				pipeline.context.vertex_shader.shadow_map = use_shadows ? &shadow_map : nullptr;
+				break;
+			case SDLK_l: // cycle point light count
+				set_point_light_count(point_lights.empty() ? 16 : (point_lights.size() * 4) % 4096);
+				break;
+			case SDLK_k: // toggle tiled light culling
+				tiled_lights = !tiled_lights;
+				break;
+			case SDLK_f: // toggle post processing
+				use_post = !use_post;
+				set_post_chain(window.post, use_post);
+				break;
+			case SDLK_m: // toggle multisampling
+				use_msaa = !use_msaa;
+				pipeline.get_render_target()->set_samples(use_msaa ? msaa_samples : 1);
+				break;
+			case SDLK_v: // cycle coarse shading modes
+				set_shading_mode((ShadingMode)(((int)shading_mode + 1) % (int)ShadingMode::count));
+				break;
+			case SDLK_o: // toggle occlusion culling
+				use_occlusion = !use_occlusion;
+				occlusion.reset();
+				break;
+			case SDLK_c: // capture the next frame
+				if(streamed)
+					std::cout << "streamed meshes can not be captured\n";
+				else if(animate_dragon)
+					std::cout << "animated meshes can not be captured\n";
+				else
+					capture_requested = true;
+				break;
+			}
+			break;
+		}
+	}
+
+	// pick up the newest simulation state, then find out what changed since the
+	// last frame. this is the last moment before vertex shading
+	bool needs_redraw() {
+		frame_snapshot = simulation.latest();
+		const SimState& state = frame_snapshot->state;
+
+		camera = state.camera;
+		light.pos = state.light_pos;
+		mesh2_instances[0] = rotate(translate(mat4x4(1), vec3(0, 10, 0)), state.instance_angle, vec3(0, 1, 0));
+		pipeline.context.vertex_shader.update();
+
+		if(streamed)
+			streamed->update();
+
+		animate_dragon = state.animate_dragon && skinned_dragon;
+		if(animate_dragon && state.animation_time != dragon_time) {
+			u64 start = SDL_GetPerformanceCounter();
+
+			dragon_time = state.animation_time;
+			dragon_pose.evaluate(dragon_skeleton, dragon_clip, dragon_time);
+			skinned_dragon->skin(dragon_pose.skinning, &skin_threads);
+
+			skin_ms = elapsed_ms(start);
+		}
+
+		GRenderTarget* target = pipeline.get_render_target();
+		GouraudVertShader& vs = pipeline.context.vertex_shader;
+
+		// everything every pixel depends on
+		GStateKey global;
+		global.add(vs.get_view()).add(vs.get_projection()).add(light.pos)
+			.add(point_lights).add(tiled_lights).add(use_prepass).add(use_shadows).add(use_occlusion).add(use_post).add(use_msaa)
+			.add((int)shading_mode);
+
+		// clusters coming and going change the geometry anywhere
+		if(streamed)
+			global.add(streamed->version);
+
+		std::vector<GDamageObject> objects(2);
+		objects[0].key.add(animate_dragon).add(animate_dragon ? dragon_time : 0.0f);
+		if(!dragon_lods.levels.empty())
+			objects[0].rect = pipeline.screen_rect(dragon_bounds());
+		objects[1].key.add(mesh2_instances);
+		objects[1].rect = pipeline.screen_rect(mesh2, mesh2_instances);
+
+		redraw = damage.update(target->width, target->height, global, objects);
+
+		// a moving object moves its shadow too, which can land anywhere
+		if(redraw == GRedraw::partial && use_shadows)
+			redraw = GRedraw::full;
+
+		// captures are always complete frames
+		if(capture_requested)
+			redraw = GRedraw::full;
+
+		return redraw != GRedraw::none;
+	}
+
+	// redraws what needs_redraw found changed, everything if it was not called
+	void draw() {
+		pipeline.stats.reset();
+		occlusion.stats.reset();
+
+		if(redraw == GRedraw::partial) {
+			GRenderTarget* target = pipeline.get_render_target();
+
+			// the light grid and shadow map from the last full frame are still valid
+			for(const GRect& r : damage.dirty) {
+				target->clear(r);
+				pipeline.scissor = r;
+				draw_scene();
+			}
+
+			pipeline.scissor = GRect::all();
+		} else {
+			if(capture_requested)
+				begin_capture();
+
+			window.clear();
+			draw_shadows_and_lights();
+			draw_scene();
+
+			if(capture_requested)
+				end_capture();
+
+			// partial redraws keep the map of the last full frame
+			if(shading_mode == ShadingMode::tiles)
+				rate_map.update(*pipeline.get_render_target(), rate_luma_step);
+		}
+
+		redraw = GRedraw::full;
+
+		{
+			std::stringstream ss;
+			ss << to_string(camera.eye);
+			window.print(0, 20, ss.str());
+		}
+
+		{
+			std::stringstream ss;
+			ss << "draws " << pipeline.stats.draws 
+				<< " culled " << pipeline.stats.instances_culled;
+			window.print(0, 40, ss.str());
+		}
+
+		{
+			std::stringstream ss;
+			ss << "lod " << dragon_lod
+				<< " tris " << pipeline.stats.triangles_submitted;
+			window.print(0, 60, ss.str());
+		}
+
+		{
+			std::stringstream ss;
+			ss << "fragments " << pipeline.stats.fragments_shaded
+				<< (use_prepass ? " prepass" : "")
+				<< (use_shadows ? " shadows" : "")
+				<< (use_post ? " post" : "");
+
+			if(shading_mode != ShadingMode::full)
+				ss << " shading " << shading_mode_name(shading_mode) << " broadcast " << pipeline.stats.fragments_broadcast;
+
+			window.print(0, 80, ss.str());
+		}
+
+		{
+			std::stringstream ss;
+			ss << "point lights " << point_lights.size()
+				<< (tiled_lights ? " tiled " : " brute ") << light_grid.average_lights() << "/tile";
+			window.print(0, 100, ss.str());
+		}
+
+		{
+			std::stringstream ss;
+			ss << "input latency " << (int)latency_ms
+				<< " ms avg " << (int)latency_average_ms
+				<< " worst " << (int)latency_worst_ms;
+			window.print(0, 140, ss.str());
+		}
+
+		{
+			std::stringstream ss;
+			ss << "frames reused " << damage.frames_reused
+				<< " partial " << damage.frames_partial
+				<< " full " << damage.frames_full
+				<< " dirty " << damage.dirty_area() << "px";
+			window.print(0, 120, ss.str());
+		}
+
+		if(streamed) {
+			std::stringstream ss;
+			ss << "clusters " << streamed->resident_count() << "/" << streamed->cluster_count()
+				<< " resident " << streamed->resident_bytes / (1024 * 1024)
+				<< "/" << streamed->budget_bytes / (1024 * 1024) << " MB"
+				<< " loads " << streamed->stats.loads
+				<< " evictions " << streamed->stats.evictions;
+			window.print(0, 160, ss.str());
+		}
+
+		if(use_occlusion) {
+			std::stringstream ss;
+			ss << "occlusion drawn " << occlusion.stats.drawn
+				<< " skipped " << occlusion.stats.skipped
+				<< " revealed " << occlusion.stats.revealed
+				<< " boxes " << pipeline.stats.bounds_tested;
+			window.print(0, 180, ss.str());
+		}
+
+		if(animate_dragon) {
+			std::stringstream ss;
+			ss << "skinned " << skinned_dragon->vertex_count() << " vertices in " << skin_ms
+				<< " ms on " << skin_threads.size() << " threads";
+			window.print(0, 200, ss.str());
+		}
+
+		if(use_msaa) {
+			GRenderTarget* target = pipeline.get_render_target();
+			std::stringstream ss;
+			ss << "msaa " << target->samples << "x edge pixels " << target->sample_store.edge_count()
+				<< " " << target->sample_store.size_in_bytes() / 1024 << " KB";
+			window.print(0, 220, ss.str());
+		}
+	}
+
+	// draw a clustered mesh file in place of the dragon, keeping at most budget
+	// bytes of full detail clusters in memory
+	void stream(const std::string& filename, std::size_t budget) {
+		streamed.reset(new GStreamingMesh<GObjVertex>(filename, budget));
+
+		// finished loads need a frame to show up in
+		streamed->on_load = []() {
+			SDL_Event e{};
+			e.type = SDL_USEREVENT;
+			SDL_PushEvent(&e);
+		};
+
+		damage.invalidate();
+	}
+
+	// time from the input event to the first frame showing its effect
+	void presented() {
+		if(!frame_snapshot || frame_snapshot->input_id == measured_input)
+			return;
+
+		measured_input = frame_snapshot->input_id;
+		simulation.presented(measured_input);
+
+		latency_ms = (float)(SDL_GetTicks() - frame_snapshot->input_time);
+		latency_average_ms = latency_average_ms <= 0 ? latency_ms : l_interpolate(latency_average_ms, latency_ms, 0.1f);
+		latency_worst_ms = std::max(latency_worst_ms, latency_ms);
+	}
+
+	void draw_shadows_and_lights() {
+		update_shadows_and_lights();
+
+		if(use_shadows) {
+			shadow_map.clear();
+			draw_geometry(shadow_pipeline, shadow_lod);
+		}
+	}
+
+	// constants derived from the camera and lights
+	void update_shadows_and_lights() {
+		if(use_shadows) {
+			shadow_map.look_at(light.pos, vec3(0, 2, 0), radians(90.0f), 1.0f, 100.0f);
+			shadow_pipeline.context.vertex_shader.set_view_projection(shadow_map.view_projection);
+		}
+
+		{
+			GRenderTarget* target = pipeline.get_render_target();
+			GouraudVertShader& vs = pipeline.context.vertex_shader;
+
+			light_grid.build(point_lights, vs.get_view(), vs.get_projection(), 
+				target->width, target->height, vs.near, tiled_lights);
+		}
+	}
+
+	// everything the shaders read goes into the capture's constants, the draws are
+	// recorded by the pipelines
+	void begin_capture() {
+		GRenderTarget* target = pipeline.get_render_target();
+
+		capture.reset();
+		capture.window_width = window.width;
+		capture.window_height = window.height;
+		capture.width = target->width;
+		capture.height = target->height;
+
+		capture.put(camera);
+		capture.put(light);
+		capture.put(point_lights);
+		capture.put(tiled_lights);
+		capture.put(use_shadows);
+
+		capture.attach(pipeline, 0);
+		capture.attach(shadow_pipeline, 1);
+	}
+
+	void end_capture() {
+		capture.detach(pipeline);
+		capture.detach(shadow_pipeline);
+		capture_requested = false;
+
+		std::string filename = "frame" + std::to_string(capture_count++) + ".dcap";
+		capture.save(filename);
+
+		std::cout << "captured " << capture.draws.size() << " draws to " << filename << "\n";
+	}
+
+	// run a captured frame `frames` times and report the frame times. the last
+	// frame is written to image if it is not empty
+	void replay(const std::string& filename, int frames, const std::string& image) {
+		capture.load(filename);
+
+		capture.get(camera);
+		capture.get(light);
+		capture.get(point_lights);
+		capture.get(tiled_lights);
+		capture.get(use_shadows);
+
+		// every draw must name a registered mesh and a pipeline this scene has,
+		// checked before the first frame so a bad capture fails with a message
+		for(const GCaptureDraw& d : capture.draws) {
+			capture.mesh(d);
+			if(d.pass > 1)
+				throw std::runtime_error("capture uses unknown pass " + std::to_string(d.pass));
+		}
+
+		GRenderTarget* target = pipeline.get_render_target();
+		target->resize(capture.width, capture.height);
+
+		pipeline.context.vertex_shader.update();
+		pipeline.context.vertex_shader.shadow_map = use_shadows ? &shadow_map : nullptr;
+		update_shadows_and_lights();
+
+		std::vector<float> times;
+
+		for(int i = 0; i < frames; i++) {
+			u64 start = SDL_GetPerformanceCounter();
+
+			window.clear();
+			shadow_map.clear();
+			pipeline.stats.reset();
+
+			for(const GCaptureDraw& d : capture.draws) {
+				if(d.pass == 1)
+					replay_draw(shadow_pipeline, d);
+				else
+					replay_draw(pipeline, d);
+			}
+
+			times.push_back(elapsed_ms(start));
+		}
+
+		std::sort(times.begin(), times.end());
+
+		float total = 0;
+		for(float t : times)
+			total += t;
+
+		std::cout << filename << ": " << capture.draws.size() << " draws, "
+			<< capture.width << "x" << capture.height << ", "
+			<< pipeline.stats.triangles_submitted << " triangles, "
+			<< pipeline.stats.fragments_shaded << " fragments\n"
+			<< frames << " frames: min " << times.front() 
+			<< " ms median " << times[times.size() / 2] 
+			<< " ms mean " << total / frames 
+			<< " ms max " << times.back() << " ms\n";
+
+		if(!image.empty())
+			target->save_ppm(image);
+	}
+
+	template <class Pipeline>
+	void replay_draw(Pipeline& p, const GCaptureDraw& d) {
+		const GMesh<GObjVertex>& mesh = *(const GMesh<GObjVertex>*)capture.mesh(d);
+
+		p.state = d.state;
+		p.scissor = d.scissor;
+
+		if(d.instances.empty())
+			p.process(mesh);
+		else
+			p.process_instanced(mesh, d.instances);
+
+		p.state = GRasterState{};
+		p.scissor = GRect::all();
+	}
+
+	// multisampled pixels keep one depth for depth only draws, which an equal
+	// test against their samples would not match, so msaa goes without a prepass
+	void draw_scene() {
+		if(use_prepass && !use_msaa) {
+			// depth only, then shade each visible pixel once
+			pipeline.state = GRasterState::depth_prepass();
+			draw_camera_geometry(true);
+			pipeline.state = with_shading_rate(GRasterState::after_prepass());
+			draw_camera_geometry(false);
+		} else {
+			pipeline.state = with_shading_rate(GRasterState{});
+			draw_camera_geometry(true);
+		}
+
+		pipeline.state = GRasterState{};
+	}
+
+	void set_shading_mode(ShadingMode mode) {
+		GRenderTarget* target = pipeline.get_render_target();
+
+		shading_mode = mode;
+		rate_map.resize(target->width, target->height);
+		pipeline.rate_map = mode == ShadingMode::tiles ? &rate_map : nullptr;
+	}
+
+	// s with the shading rate of the current mode
+	GRasterState with_shading_rate(GRasterState s) const {
+		switch(shading_mode) {
+		case ShadingMode::blocks_2x2: s.shading_rate = 2; break;
+		case ShadingMode::blocks_4x4: s.shading_rate = 4; break;
+		case ShadingMode::gradients: s.rate_threshold = rate_varying_step; break;
+		default: break;
+		}
+		return s;
+	}
+
+	// with occlusion culling the first pass decides which objects to draw and
+	// the prepass' shading pass draws the same ones
+	void draw_camera_geometry(bool first_pass) {
+		if(!use_occlusion) {
+			draw_geometry(pipeline, dragon_lod);
+			return;
+		}
+
+		if(first_pass) {
+			occlusion.draw(pipeline, object_count(),
+				[this](std::size_t i) { return test_object(i); },
+				[this](std::size_t i) { draw_object(pipeline, i, dragon_lod); });
+			return;
+		}
+
+		for(std::size_t i = 0; i < object_count(); i++) {
+			if(occlusion.drawn[i])
+				draw_object(pipeline, i, dragon_lod);
+		}
+	}
+
+	template <class Pipeline>
+	void draw_geometry(Pipeline& p, std::size_t& lod) {
+		if(streamed)
+			streamed->draw(p);
+		else if(animate_dragon)
+			p.process(skinned_dragon->mesh);
+		else
+			p.process_lod(dragon_lods, lod);
+		p.process_instanced(mesh2, mesh2_instances);
+	}
+
+	// the dragon is object 0, the suzanne instances follow
+	std::size_t object_count() const {
+		return 1 + mesh2_instances.size();
+	}
+
+	template <class Pipeline>
+	void draw_object(Pipeline& p, std::size_t i, std::size_t& lod) {
+		if(i > 0) {
+			p.process_instanced(mesh2, std::vector<mat4x4>{ mesh2_instances[i - 1] });
+		} else if(streamed) {
+			streamed->draw(p);
+		} else if(animate_dragon) {
+			p.process(skinned_dragon->mesh);
+		} else {
+			p.process_lod(dragon_lods, lod);
+		}
+	}
+
+	// bounding box samples of an object, streamed meshes are always drawn
+	std::size_t test_object(std::size_t i) {
+		if(i == 0) {
+			if(streamed)
+				return std::numeric_limits<std::size_t>::max();
+			return pipeline.query_bounds(dragon_bounds());
+		}
+
+		GouraudVertShader& vs = pipeline.context.vertex_shader;
+		vs.set_model(mesh2_instances[i - 1]);
+		std::size_t samples = pipeline.query_bounds(mesh2.bounds);
+		vs.set_model(mat4x4(1));
+
+		return samples;
+	}
+
+	// the posed dragon's bounds while it is animated
+	const GBounds& dragon_bounds() const {
+		return animate_dragon ? skinned_dragon->mesh.bounds : dragon_lods.levels[0].bounds;
+	}
+
+	GPipeline<EContext> pipeline;
+	GPipeline<GShadowContext<GObjVertex>> shadow_pipeline;
+	GShadowMap shadow_map;
+	GWindow& window;
+
+	bool use_prepass = false;
+	bool use_shadows = true;
+
+	bool use_occlusion = false;
+	GOcclusionCuller occlusion;
+
+	bool use_post = false;
+	bool use_msaa = false;
+
+	// the largest change across a coarse block the tile mode allows in luma (0..255)
+	// and the gradient mode in any varying
+	static constexpr float rate_luma_step = 4;
+	static constexpr float rate_varying_step = 0.05f;
+
+	ShadingMode shading_mode = ShadingMode::full;
+	GShadingRateMap rate_map;
+
+	std::vector<GPointLight> point_lights;
+	GLightGrid light_grid;
+	bool tiled_lights = true;
+
+	GSimulation<SimState> simulation;
+	std::shared_ptr<const GSimulation<SimState>::SnapshotType> frame_snapshot;
+
+	std::uint64_t measured_input = 0;
+	float latency_ms = 0;
+	float latency_average_ms = 0;
+	float latency_worst_ms = 0;
+
+	GDamageTracker damage;
+	GRedraw redraw = GRedraw::full;
+
+	GCapture capture;
+	bool capture_requested = false;
+	int capture_count = 0;
+	
+	std::unique_ptr<GObj> object;
+	GObj object2;
+	GLodChain<GObjVertex> dragon_lods;
+	std::size_t dragon_lod = 0;
+	std::unique_ptr<GStreamingMesh<GObjVertex>> streamed;
+	std::size_t shadow_lod = 0;
+	GMesh<GObjVertex> mesh2;
+	std::vector<mat4x4> mesh2_instances;
+
+	// the full detail dragon bent by a wave down a chain of joints
+	GSkeleton dragon_skeleton;
+	GAnimationClip dragon_clip;
+	GPose dragon_pose;
+	std::unique_ptr<GSkinnedMesh<GObjVertex>> skinned_dragon;
+	GThreadTeam skin_threads;
+	bool animate_dragon = false;
+	float dragon_time = -1;
+	float skin_ms = 0;
+};
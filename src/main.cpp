@@ -1,238 +1,222 @@
-#include "gfx.hpp"
-
-using namespace demo;
-
-struct Light {
-	vec3 pos;
-	vec3 diffuse;
-	vec3 ambient;
-	vec3 specular;
-	vec3 color;
-	float shinyness;
-} static light{
-	{ 0, 0, 10 }, 
-	{1.f, 1.f, 1.f}, 
-	{0.1f, 0.1f, 0.1f}, 
-	{1.f, 1.f, 1.f}, 
-	{1.f, 1.f, 1.f}, 
-	100.f
-};
-
-struct Camera {
-	vec3 eye;
-	vec3 angle;
-	vec3 up;
-
-	float pitch;
-	float yaw;
-	
-	float speed = 1.f;
-
-	Camera() :
-		eye(0, 0, 0),
-		angle(0, 0, -1),
-		up(0, 1, 0) { }
-
-	void update() {
-		float pitch_rad = radians(pitch), 
-            yaw_rad = radians(yaw);
-
-        angle = normalize(vec3(
-            cos(yaw_rad) * cos(pitch_rad), 
-            sin(pitch_rad), 
-            sin(yaw_rad) * cos(pitch_rad)));
-	}
-} static camera;
-
-class GouraudVertShader : public GShader<GObjVertex, GObjVertex> {
-public:
-	GouraudVertShader(GWindow& win) :
-		GShader(win),
-		aspect_ratio((float)win.width / win.height),
-		fov(45),
-		far(10000.0f), near(0.1f) { 
-		update();
-	}
-
-	OutputType operator()(const InputType& v) {
-		vec3 pos = model_view * v.pos;
-		vec3 light_pos = model_view * vec4(light.pos, 1);
-
-		vec3 N = normalize(normal_matrix * v.normal);
-		vec3 L = normalize(light_pos - pos);
-		vec3 V = normalize(-pos);
-		vec3 H = normalize(L + V);
-
-		vec3 ambient = light.ambient;
-
-		vec3 diffuse = max(dot(L, N), 0.0f) * light.diffuse;
-		vec3 specular = pow(max(dot(N, H), 0.0f), light.shinyness) * light.specular;
-
-		vec3 color = saturate(light.color * (ambient + diffuse + specular));
-
-		return OutputType(projection * model_view * v.pos, v.uv, N, color);
-	}
-
-	void update() {
-		projection = perspective(fov, aspect_ratio, near, far);
-		model_view = lookAt(camera.eye, camera.eye + camera.angle, camera.up);
-		normal_matrix = mat3x3(transpose(inverse(model_view)));
-	}
-
-	float aspect_ratio;
-	float fov;
-	float far;
-	float near;
-
-private:
-	mat4x4 projection;
-	mat4x4 model_view;
-	mat3x3 normal_matrix;
-};
-
-class GeoShader : public GShader<GTriangle<GObjVertex>, GTriangle<GObjVertex>> {
-public:
-	GeoShader(GWindow& win) : GShader(win) { }
-	
-	OutputType operator()(const InputType& tri) {
-		return tri;
-	}
-
-	void update() { }
-};
-
-class ColorFragShader : public GShader<GObjVertex, GRgba> {
-public:
-	ColorFragShader(GWindow& win) : 
-		GShader(win) { }
-
-	GRgba operator()(const GObjVertex& v) {
-		return GRgba{ 
-			(u8)(v.color.x * 255), 
-			(u8)(v.color.y * 255), 
-			(u8)(v.color.z * 255), 
-			255
-		};
-	}
-
-	void update() { }
-};
-
-class ExampleScene : public GScene {
-public:
-	using EContext = GContext<
-		GouraudVertShader, 
-		GeoShader, 
-		ColorFragShader>;
-
-	ExampleScene(GWindow& win) :
-		pipeline(win),
-		window(win),
-		object("../assets/dragon.obj"),
-		object2("../assets/suzanne.obj") {
-		win.register_scene(this);
-		
-		// init camera
-		camera.up = { 0, 1, 0 };
-		camera.eye = { 0, 2, 5 };
-		camera.angle = { 0, 0, -1 };
-		camera.yaw = -90.0f;
-		camera.pitch = 0.0f;
-
-		camera.update();
-		pipeline.context.vertex_shader.update();
+#include "example.hpp"
+
+int main(int argc, char** argv) {
+	// started by a --split coordinator, the pipe descriptors come last
+	// demo3d --split-worker frame dragon.mesh suzanne.mesh index in out
+	if(argc == 8 && std::string(argv[1]) == "--split-worker") {
+		GSplitFrame frame;
+		frame.open(argv[2]);
+
+		int index = std::atoi(argv[5]), in = std::atoi(argv[6]), out = std::atoi(argv[7]);
+		if(index < 0 || index >= frame.header().worker_count || in < 0 || out < 0) {
+			std::cerr << "usage: demo3d --split-worker frame dragon.mesh suzanne.mesh index in out, "
+				"index is below the frame's worker count\n";
+			return 1;
+		}
+
+		split_worker(frame, argv[3], argv[4], index, in, out);
+		return 0;
+	}
+
+	// demo3d --split workers [width height [image.ppm]]
+	if(argc > 2 && std::string(argv[1]) == "--split") {
+		int workers = std::atoi(argv[2]);
+		int width = argc > 4 ? std::atoi(argv[3]) : 800, height = argc > 4 ? std::atoi(argv[4]) : 600;
 
-		mesh = object.get_triangle_list();
-		mesh2 = object2.get_triangle_list();
-
-		for(auto& e : mesh2.vertices) {
-			e.pos.y += 10;
+		if(workers < 1 || workers > GSplitFrame::max_workers || width < 1 || height < workers) {
+			std::cerr << "usage: demo3d --split workers [width height [image.ppm]], 1 to "
+				<< GSplitFrame::max_workers << " workers and at least one row each\n";
+			return 1;
 		}
+
+		GRenderTarget image;
+
+		try {
+			float ms = split_frames(workers, width, height, image);
+			std::cout << ms << " ms per frame\n";
+		} catch(const std::exception& e) {
+			std::cerr << e.what() << "\n";
+			return 1;
+		}
+
+		if(argc > 5)
+			image.save_ppm(argv[5]);
+		return 0;
 	}
 
-	void process(const SDL_Event& event) {
-		switch(event.type) {
-		case SDL_QUIT: window.quit = true; break;
-		case SDL_KEYDOWN: 
-			switch(event.key.keysym.sym) {
-			case SDLK_w: // move forward
-				camera.eye += camera.angle * camera.speed; 
-				break;
-			case SDLK_s: // move backward
-				camera.eye -= camera.angle * camera.speed; 
-				break;
-			case SDLK_RIGHT: // turn right
-				camera.yaw += 4;
-				if(camera.yaw > 359)
-					camera.yaw -= 360;
-				break;
-			case SDLK_LEFT: // turn left
-				camera.yaw -= 4;
-				if(camera.yaw < 0)
-					camera.yaw += 360;
-				break;
-			case SDLK_UP: // look up
-				camera.pitch += 4;
-				if(camera.pitch > 359)
-					camera.pitch -= 360;
-				break;
-			case SDLK_DOWN: // look down
-				camera.pitch -= 4;
-				if(camera.pitch < 0)
-					camera.pitch += 360;
-				break;
-			}
-
-			switch(event.key.keysym.sym) {
-			case SDLK_w: case SDLK_a: case SDLK_s: case SDLK_d:
-			case SDLK_RIGHT: case SDLK_LEFT: case SDLK_UP: case SDLK_DOWN: {
-				camera.update();
-				pipeline.context.vertex_shader.update();
-				break;
-			}
+	// demo3d --serve socket [threads [scenes to load up front...]]
+	if(argc > 2 && std::string(argv[1]) == "--serve") {
+		int threads = argc > 3 ? std::atoi(argv[3]) : 4;
+		if(threads < 1) {
+			std::cerr << "usage: demo3d --serve socket [threads [scenes...]], threads is at least 1\n";
+			return 1;
 		}
+
+		serve(argv[2], threads, std::vector<std::string>(argv + 4, argv + argc));
+		return 0;
+	}
+
+	// demo3d --request socket out scene width height format [count]
+	if(argc > 7 && std::string(argv[1]) == "--request") {
+		std::string request = std::string("render ") + argv[4] + " " + argv[5] + " " + argv[6] + " " + argv[7] + " 0 2 5 0 1 0";
+		send_requests(argv[2], request, argc > 8 ? std::atoi(argv[8]) : 1, argv[3]);
+		return 0;
+	}
+
+	// demo3d --bench-split [max workers [width height]]
+	if(argc > 1 && std::string(argv[1]) == "--bench-split") {
+		int workers = argc > 2 ? std::atoi(argv[2]) : 8;
+		int width = argc > 4 ? std::atoi(argv[3]) : 1920, height = argc > 4 ? std::atoi(argv[4]) : 1080;
+
+		if(workers < 1 || workers > GSplitFrame::max_workers || width < 1 || height < workers) {
+			std::cerr << "usage: demo3d --bench-split [max workers [width height]], 1 to "
+				<< GSplitFrame::max_workers << " workers and at least one row each\n";
+			return 1;
 		}
+
+		try {
+			benchmark_split(workers, width, height);
+		} catch(const std::exception& e) {
+			std::cerr << e.what() << "\n";
+			return 1;
+		}
+		return 0;
+	}
+
+	// demo3d --replay file [frames] [image.ppm]
+	if(argc > 2 && std::string(argv[1]) == "--replay") {
+		int frames = argc > 3 ? std::atoi(argv[3]) : 100;
+		if(frames < 1) {
+			std::cerr << "usage: demo3d --replay file [frames] [image.ppm], frames is at least 1\n";
+			return 1;
+		}
+
+		try {
+			GCapture header;
+			header.load(argv[2]);
+
+			GWindow window("replay", header.window_width, header.window_height, 0, true);
+			ExampleScene es(window);
+			es.replay(argv[2], frames, argc > 4 ? argv[4] : "");
+		} catch(const std::exception& e) {
+			std::cerr << e.what() << "\n";
+			return 1;
+		}
+		return 0;
 	}
 
-	void draw() {
-		window.clear();
-
-		const float t = 0.01;
-		mat3x3 angle(
-			vec3(cos(t), 0, sin(t)),
-			vec3(0, 1, 0),
-			vec3(-sin(t), 0, cos(t))
-		);
-
-		// for(auto& tri : mesh.vertices) {
-		// 	vec3 pos(tri.pos);
-		// 	pos = angle * pos;
-		// 	tri.pos = vec4(pos, 1);
-		// }
-
-		light.pos = angle * light.pos;
-		
-		{
-			std::stringstream ss;
-			ss << to_string(camera.eye);
-			window.print(0, 20, ss.str());
+	// demo3d --build-clusters in.obj out.dcl [triangles per cluster]
+	if(argc > 3 && std::string(argv[1]) == "--build-clusters") {
+		int cluster_triangles = argc > 4 ? std::atoi(argv[4]) : 4096;
+		if(cluster_triangles < 1) {
+			std::cerr << "usage: demo3d --build-clusters in.obj out.dcl [triangles per cluster], at least 1 triangle\n";
+			return 1;
 		}
-		pipeline.process(mesh);
-		pipeline.process(mesh2);
+
+		GObj obj(argv[2]);
+		GClusterWriter<GObjVertex>::write(argv[3], obj.get_triangle_list(false), cluster_triangles);
+		return 0;
 	}
 
-	GPipeline<EContext> pipeline;
-	GWindow& window;
-	
-	GObj object;
-	GObj object2;
-	GMesh<GObjVertex> mesh;
-	GMesh<GObjVertex> mesh2;
-};
+	// demo3d --bench-skinning [obj [joints]]
+	if(argc > 1 && std::string(argv[1]) == "--bench-skinning") {
+		int joints = argc > 3 ? std::atoi(argv[3]) : 16;
+		if(joints < 2 || joints > 256) {
+			std::cerr << "usage: demo3d --bench-skinning [obj [joints]], joints is 2 to 256\n";
+			return 1;
+		}
+
+		benchmark_skinning(argc > 2 ? argv[2] : "../assets/dragon.obj", joints);
+		return 0;
+	}
 
-int main() {
 	GWindow window("hello", 800, 600, 0);
-	ExampleScene es(window);
+
+	// demo3d --bench-textures [image]
+	if(argc > 1 && std::string(argv[1]) == "--bench-textures") {
+		benchmark_textures(window, argc > 2 ? argv[2] : "../assets/image.png");
+		return 0;
+	}
+
+	// a streamed mesh replaces the dragon, which is then never loaded
+	bool streaming = argc > 2 && std::string(argv[1]) == "--stream";
+	int stream_budget = argc > 3 && streaming ? std::atoi(argv[3]) : 64;
+	if(stream_budget < 1) {
+		std::cerr << "usage: demo3d --stream file.dcl [budget in MB], at least 1 MB\n";
+		return 1;
+	}
+
+	ExampleScene es(window, !streaming);
+
+	if(argc > 1 && std::string(argv[1]) == "--bench-lod") {
+		es.benchmark_lod();
+		return 0;
+	}
+
+	// demo3d --bench-prepass [obj]
+	if(argc > 1 && std::string(argv[1]) == "--bench-prepass") {
+		es.benchmark_prepass(argc > 2 ? argv[2] : "../assets/dragon.obj");
+		return 0;
+	}
+
+	if(argc > 1 && std::string(argv[1]) == "--bench-lights") {
+		es.benchmark_lights();
+		return 0;
+	}
+
+	if(argc > 1 && std::string(argv[1]) == "--bench-vertex-formats") {
+		es.benchmark_vertex_formats();
+		return 0;
+	}
+
+	if(argc > 1 && std::string(argv[1]) == "--bench-mesh-order") {
+		es.benchmark_mesh_order();
+		return 0;
+	}
+
+	if(argc > 1 && std::string(argv[1]) == "--bench-small-triangles") {
+		es.benchmark_small_triangles();
+		return 0;
+	}
+
+	if(argc > 1 && std::string(argv[1]) == "--bench-shading-rate") {
+		es.benchmark_shading_rate();
+		return 0;
+	}
+
+	if(argc > 1 && std::string(argv[1]) == "--bench-shader-math") {
+		return es.benchmark_shader_math() ? 0 : 1;
+	}
+
+	if(argc > 1 && std::string(argv[1]) == "--bench-msaa") {
+		es.benchmark_msaa();
+		return 0;
+	}
+
+	if(argc > 1 && std::string(argv[1]) == "--bench-post") {
+		es.benchmark_post();
+		return 0;
+	}
+
+	if(argc > 1 && std::string(argv[1]) == "--bench-occlusion") {
+		es.benchmark_occlusion();
+		return 0;
+	}
+
+	if(argc > 1 && std::string(argv[1]) == "--bench-multiview") {
+		es.benchmark_multiview();
+		return 0;
+	}
+
+	// demo3d --stream file.dcl [budget in MB]
+	if(streaming) {
+		try {
+			es.stream(argv[2], (std::size_t)stream_budget * 1024 * 1024);
+		} catch(const std::exception& e) {
+			std::cerr << e.what() << "\n";
+			return 1;
+		}
+	}
 
 	window.run();
 
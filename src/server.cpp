@@ -0,0 +1,362 @@
+// this file describes the demo's --serve and --request modes: a render server on
+// a unix socket and a client that times its requests
+
+#include "example.hpp"
+
+// lit from the eye, everything it reads is set per request so every server
+// thread can render on its own
+class HeadlightVertShader : public GShader<GObjVertex, GObjVertex> {
+public:
+	HeadlightVertShader(GWindow& win) : GShader(win) { }
+
+	OutputType operator()(const InputType& v) {
+		vec3 pos = model_view * v.pos;
+		vec3 N = normalize(normal_matrix * v.normal);
+		vec3 L = normalize(-pos);
+
+		float diffuse = max(dot(L, N), 0.0f);
+		float specular = pow(diffuse, 50.0f);
+		vec3 color = saturate(vec3(0.1f) + diffuse * vec3(0.8f) + specular * vec3(0.3f));
+
+		return OutputType(model_view_projection * v.pos, v.uv, N, color);
+	}
+
+	void update() { }
+
+	void look_at(const vec3& eye, const vec3& center, float aspect_ratio) {
+		view = lookAt(eye, center, vec3(0, 1, 0));
+		projection = perspective(radians(45.0f), aspect_ratio, 0.1f, 1000.0f);
+		set_model(model);
+	}
+
+	void set_model(const mat4x4& m) {
+		model = m;
+		model_view = view * model;
+		model_view_projection = projection * model_view;
+		normal_matrix = transpose(inverse(mat3x3(model_view)));
+	}
+
+	mat4x4 clip_matrix() {
+		return model_view_projection;
+	}
+
+private:
+	mat4x4 projection;
+	mat4x4 view;
+	mat4x4 model{ 1 };
+	mat4x4 model_view;
+	mat4x4 model_view_projection;
+	mat3x3 normal_matrix;
+};
+
+// --serve: renders frames for clients of a unix socket without a window. scenes
+// are the meshes in ../assets, loaded by the first request for them and kept.
+// every pool thread has its own pipeline and target. the main thread polls the
+// connections and queues each request on its own, so a thread is only taken
+// while a frame is rendered and sent. a connection has one request with the
+// pool at a time, later ones wait in its buffer. connections idle for a minute
+// are closed
+//
+// request:  render <scene> <width> <height> <ppm|raw> <eye x y z> <center x y z>
+// response: ok <bytes> <width> <height> <ms>, a newline and the frame, or
+//           error <message>
+//
+// raw frames are the ARGB8888 pixels row by row. ms is the server's latency for
+// the request from when it was taken off the connection, including the wait
+// for a free thread
+class RenderServer {
+public:
+	static constexpr std::uint32_t idle_timeout_ms = 60000;
+
+	// longer lines are not requests, the connection is closed
+	static constexpr std::size_t max_request = 1024;
+
+	RenderServer(const std::string& path, int threads) :
+		meshes(load_scene),
+		listener(path) {
+		for(int i = 0; i < threads; i++)
+			renderers.emplace_back(new Renderer());
+
+		// finished requests wake the poll loop through this pipe
+		if(pipe2(wake, O_CLOEXEC | O_NONBLOCK) != 0)
+			throw std::runtime_error("could not create server pipe");
+
+		// a few requests wait for a thread, more are turned away
+		pool.reset(new GWorkerPool<Request>(threads, threads * 2,
+			[this](int worker, Request& q) { serve(*renderers[worker], q); }));
+	}
+
+	RenderServer(const RenderServer&) = delete;
+	RenderServer& operator=(const RenderServer&) = delete;
+
+	// the pool threads use everything else, they are joined first
+	~RenderServer() {
+		pool.reset();
+		::close(wake[0]);
+		::close(wake[1]);
+	}
+
+	// load a scene before the first request needs it
+	void warm(const std::string& scene) {
+		meshes.get(scene);
+	}
+
+	void run() {
+		std::vector<pollfd> fds;
+		std::vector<std::shared_ptr<Client>> polled;
+
+		while(true) {
+			fds.assign({ { listener.descriptor(), POLLIN, 0 }, { wake[0], POLLIN, 0 } });
+			polled.clear();
+
+			// connections with a request at the pool belong to its thread until it finishes
+			for(const std::shared_ptr<Client>& c : clients) {
+				if(!c->busy && !c->closed) {
+					fds.push_back({ c->connection->descriptor(), POLLIN, 0 });
+					polled.push_back(c);
+				}
+			}
+
+			// wakes up now and then to close idle connections
+			if(poll(fds.data(), fds.size(), 1000) < 0 && errno != EINTR)
+				throw std::runtime_error("could not poll server connections");
+
+			std::uint32_t now = SDL_GetTicks();
+
+			if(fds[1].revents) {
+				char drain[64];
+				while(::read(wake[0], drain, sizeof(drain)) > 0) { }
+
+				std::vector<std::pair<std::shared_ptr<Client>, bool>> done;
+				{
+					std::lock_guard<std::mutex> lock(finished_mutex);
+					done.swap(finished);
+				}
+
+				for(auto& d : done) {
+					d.first->busy = false;
+					d.first->active = now;
+					d.first->dropped = !d.second || !advance(d.first);
+				}
+			}
+
+			for(std::size_t i = 0; i < polled.size(); i++) {
+				Client& c = *polled[i];
+
+				if(fds[i + 2].revents) {
+					// whatever is still buffered is answered before a closed connection goes
+					c.closed = !c.connection->receive();
+					c.active = now;
+					c.dropped = !advance(polled[i]);
+				} else if(now - c.active > idle_timeout_ms) {
+					c.dropped = true;
+				}
+			}
+
+			clients.erase(std::remove_if(clients.begin(), clients.end(),
+				[](const std::shared_ptr<Client>& c) { return c->dropped; }), clients.end());
+
+			if(fds[0].revents & POLLIN) {
+				clients.emplace_back(new Client{ std::unique_ptr<GConnection>(new GConnection(listener.accept())), now });
+			}
+		}
+	}
+
+private:
+	struct Client {
+		std::unique_ptr<GConnection> connection;
+		std::uint32_t active; // SDL_GetTicks of the last request or response
+
+		bool busy = false; // a request is at the pool
+		bool closed = false; // the client will send nothing more
+		bool dropped = false;
+	};
+
+	struct Request {
+		std::shared_ptr<Client> client;
+		std::string line;
+		u64 taken;
+	};
+
+	struct Renderer {
+		Renderer() :
+			window("server", 1, 1, 0, true),
+			pipeline(window) {
+			pipeline.set_render_target(&target);
+		}
+
+		void render(const GMesh<GObjVertex>& mesh, int width, int height, const vec3& eye, const vec3& center) {
+			if(width != target.width || height != target.height)
+				target.resize(width, height);
+			else
+				target.clear();
+
+			pipeline.context.vertex_shader.look_at(eye, center, (float)width / height);
+			pipeline.process(mesh);
+		}
+
+		GWindow window;
+		GRenderTarget target;
+		GPipeline<GContext<HeadlightVertShader, GeoShader, ColorFragShader>> pipeline;
+	};
+
+	static std::shared_ptr<const GMesh<GObjVertex>> load_scene(const std::string& name) {
+		bool valid = !name.empty();
+		for(char c : name)
+			valid &= std::isalnum((unsigned char)c) || c == '_' || c == '-';
+
+		std::string path = "../assets/" + name + ".obj";
+		if(!valid || !std::ifstream(path))
+			throw std::runtime_error("unknown scene " + name);
+
+		return std::make_shared<const GMesh<GObjVertex>>(GObj(path).get_triangle_list());
+	}
+
+	// queues the client's next buffered request unless one is at the pool already.
+	// false once the connection should be closed
+	bool advance(const std::shared_ptr<Client>& client) {
+		Client& c = *client;
+		std::string line;
+
+		while(!c.busy && c.connection->buffered_line(line)) {
+			Request q{ client, line, SDL_GetPerformanceCounter() };
+
+			if(pool->try_push(q))
+				c.busy = true;
+			else if(!c.connection->write(std::string("error busy\n")))
+				return false;
+		}
+
+		if(c.busy)
+			return true;
+
+		if(c.connection->buffered() > max_request) {
+			c.connection->write(std::string("error bad request\n"));
+			return false;
+		}
+
+		return !c.closed;
+	}
+
+	// on a pool thread, hands the connection back to the poll loop when done
+	void serve(Renderer& r, Request& q) {
+		bool ok = respond(r, *q.client->connection, q.line, q.taken);
+
+		{
+			std::lock_guard<std::mutex> lock(finished_mutex);
+			finished.emplace_back(q.client, ok);
+		}
+
+		// a full pipe wakes the loop all the same
+		char b = 0;
+		while(::write(wake[1], &b, 1) < 0 && errno == EINTR) { }
+	}
+
+	// false if the client went away
+	bool respond(Renderer& r, GConnection& connection, const std::string& line, u64 start) {
+		std::stringstream in(line);
+		std::string command, scene, format;
+		int width = 0, height = 0;
+		vec3 eye, center;
+
+		in >> command >> scene >> width >> height >> format
+			>> eye.x >> eye.y >> eye.z >> center.x >> center.y >> center.z;
+
+		if(!in || command != "render" || width < 1 || height < 1 || width > 8192 || height > 8192 ||
+			(format != "ppm" && format != "raw")) {
+			return connection.write(std::string("error bad request\n"));
+		}
+
+		try {
+			std::shared_ptr<const GMesh<GObjVertex>> mesh = meshes.get(scene);
+			r.render(*mesh, width, height, eye, center);
+
+			std::vector<char> frame;
+			if(format == "ppm") {
+				frame = r.target.encode_ppm();
+			} else {
+				const char* p = (const char*)r.target.color.data();
+				frame.assign(p, p + r.target.color.size() * sizeof(std::uint32_t));
+			}
+
+			float ms = elapsed_ms(start);
+
+			std::stringstream header;
+			header << "ok " << frame.size() << " " << width << " " << height << " " << ms << "\n";
+
+			if(!connection.write(header.str()) || !connection.write(frame.data(), frame.size()))
+				return false;
+
+			std::lock_guard<std::mutex> lock(log_mutex);
+			std::cout << "request " << ++requests << " " << scene << " " << width << "x" << height
+				<< " " << format << " " << ms << " ms" << std::endl;
+			return true;
+		} catch(const std::exception& e) {
+			return connection.write(std::string("error ") + e.what() + "\n");
+		}
+	}
+
+	GAssetCache<GMesh<GObjVertex>> meshes;
+	std::vector<std::unique_ptr<Renderer>> renderers;
+	GUnixListener listener;
+	std::vector<std::shared_ptr<Client>> clients;
+
+	// connections whose request finished and whether it was answered
+	std::mutex finished_mutex;
+	std::vector<std::pair<std::shared_ptr<Client>, bool>> finished;
+	int wake[2];
+
+	std::mutex log_mutex;
+	std::size_t requests = 0;
+
+	std::unique_ptr<GWorkerPool<Request>> pool;
+};
+
+// --request: sends the same request `count` times over one connection and
+// prints the server's latency and the round trip of each. the last frame is
+// written to out
+void send_requests(const std::string& path, const std::string& request, int count, const std::string& out) {
+	GConnection connection(path);
+	std::vector<char> frame;
+
+	for(int i = 0; i < count; i++) {
+		u64 start = SDL_GetPerformanceCounter();
+
+		if(!connection.write(request + "\n"))
+			throw std::runtime_error("server closed the connection");
+
+		std::string line, status;
+		if(!connection.read_line(line))
+			throw std::runtime_error("server closed the connection");
+
+		std::stringstream in(line);
+		std::size_t bytes = 0;
+		int width, height;
+		float server_ms = 0;
+
+		in >> status >> bytes >> width >> height >> server_ms;
+		if(status != "ok")
+			throw std::runtime_error("server replied: " + line);
+
+		frame.resize(bytes);
+		if(!connection.read(frame.data(), bytes))
+			throw std::runtime_error("server closed the connection");
+
+		float ms = elapsed_ms(start);
+		std::cout << "request " << i << " server " << server_ms << " ms round trip " << ms << " ms\n";
+	}
+
+	std::ofstream f(out, std::ios::binary);
+	f.write(frame.data(), frame.size());
+}
+
+// --serve: loads the given scenes up front, then serves until killed
+void serve(const std::string& path, int threads, const std::vector<std::string>& scenes) {
+	RenderServer server(path, threads);
+
+	for(const std::string& scene : scenes)
+		server.warm(scene);
+
+	std::cout << "listening on " << path << std::endl;
+	server.run();
+}
@@ -0,0 +1,179 @@
+// this file describes the demo's --split modes: a coordinator that hands out
+// bands of each frame and the worker processes that render them
+
+#include "example.hpp"
+
+// the demo scene for --split: written to mesh files once by the coordinator and
+// mapped by every worker
+struct SplitScene {
+	SplitScene() :
+		dragon_file("/tmp/demo3d-" + std::to_string(getpid()) + "-dragon.mesh"),
+		suzanne_file("/tmp/demo3d-" + std::to_string(getpid()) + "-suzanne.mesh") {
+		write_mesh_file(dragon_file, GObj("../assets/dragon.obj").get_triangle_list());
+		write_mesh_file(suzanne_file, GObj("../assets/suzanne.obj").get_triangle_list());
+	}
+
+	~SplitScene() {
+		std::remove(dragon_file.c_str());
+		std::remove(suzanne_file.c_str());
+	}
+
+	std::string dragon_file;
+	std::string suzanne_file;
+};
+
+// renders bands of the frames a --split coordinator hands out
+class SplitWorker {
+public:
+	SplitWorker(GWindow& win, const std::string& dragon_file, const std::string& suzanne_file) :
+		pipeline(win),
+		shadow_pipeline(win),
+		shadow_map(1024),
+		window(win),
+		dragon(dragon_file),
+		suzanne(suzanne_file) {
+		shadow_pipeline.set_render_target(&shadow_map.target);
+		shadow_pipeline.state = GRasterState::depth_prepass();
+	}
+
+	// every worker renders the whole shadow map, only the camera's view is split
+	void render(GSplitFrame& frame, int index) {
+		std::vector<mat4x4> instances(1);
+		bool use_shadows;
+
+		frame.rewind();
+		frame.get(camera);
+		frame.get(light);
+		frame.get(instances[0]);
+		frame.get(use_shadows);
+
+		GouraudVertShader& vs = pipeline.context.vertex_shader;
+		vs.update();
+		vs.shadow_map = use_shadows ? &shadow_map : nullptr;
+
+		if(use_shadows) {
+			shadow_map.look_at(light.pos, vec3(0, 2, 0), radians(90.0f), 1.0f, 100.0f);
+			shadow_pipeline.context.vertex_shader.set_view_projection(shadow_map.view_projection);
+			shadow_map.clear();
+			shadow_pipeline.process(dragon);
+			shadow_pipeline.process_instanced(suzanne, instances);
+		}
+
+		const GRect band = frame.header().bands[index];
+		GRenderTarget& target = window.get_render_target();
+
+		target.clear(band);
+		pipeline.scissor = band;
+		pipeline.process(dragon);
+		pipeline.process_instanced(suzanne, instances);
+
+		for(int y = band.y0; y <= band.y1; y++)
+			std::memcpy(frame.pixels() + y * target.width, &target.color[y * target.width], target.width * sizeof(std::uint32_t));
+	}
+
+private:
+	GPipeline<ExampleScene::EContext> pipeline;
+	GPipeline<GShadowContext<GObjVertex>> shadow_pipeline;
+	GShadowMap shadow_map;
+	GWindow& window;
+
+	GMappedMesh<GObjVertex> dragon;
+	GMappedMesh<GObjVertex> suzanne;
+};
+
+// render `frames` frames of the split scene with the camera circling the dragon,
+// one band per worker process. returns the average frame time in ms and leaves
+// the last frame in image
+static float split_render(const SplitScene& scene, int workers, int width, int height,
+	int frames, bool use_shadows, GRenderTarget& image) {
+	const std::string name = "/demo3d-" + std::to_string(getpid());
+
+	GSplitFrame frame;
+	frame.create(name, width, height, workers);
+
+	std::vector<std::unique_ptr<GWorkerProcess>> processes;
+	for(int i = 0; i < workers; i++) {
+		processes.emplace_back(new GWorkerProcess("/proc/self/exe", { "--split-worker", name,
+			scene.dragon_file, scene.suzanne_file, std::to_string(i) }));
+	}
+
+	std::vector<float> ms(workers);
+	u64 start = SDL_GetPerformanceCounter();
+
+	for(std::uint64_t f = 0; f < (std::uint64_t)frames; f++) {
+		float a = 2 * M_PI * f / frames;
+
+		camera.eye = vec3(std::sin(a) * 5, 2, std::cos(a) * 5);
+		camera.angle = normalize(vec3(0, 1, 0) - camera.eye);
+		camera.up = vec3(0, 1, 0);
+
+		frame.reset_constants();
+		frame.put(camera);
+		frame.put(light);
+		frame.put(translate(mat4x4(1), vec3(0, 10, 0)));
+		frame.put(use_shadows);
+
+		for(auto& p : processes)
+			p->channel.send(f);
+
+		for(int i = 0; i < workers; i++) {
+			if(!processes[i]->channel.receive(ms[i]))
+				throw std::runtime_error("split worker " + std::to_string(i) + " exited");
+		}
+
+		frame.rebalance(ms);
+	}
+
+	float frame_ms = elapsed_ms(start) / frames;
+
+	image.resize(width, height);
+	std::memcpy(image.color.data(), frame.pixels(), image.color.size() * sizeof(std::uint32_t));
+
+	return frame_ms;
+}
+
+// started by a --split coordinator, renders the bands it is sent until the
+// coordinator closes the pipe
+void split_worker(GSplitFrame& frame, const std::string& dragon_file, const std::string& suzanne_file,
+	int index, int in, int out) {
+	GWindow window("worker", frame.header().width, frame.header().height, 0, true);
+	SplitWorker worker(window, dragon_file, suzanne_file);
+	GPipeChannel channel(in, out);
+
+	std::uint64_t frame_number;
+	while(channel.receive(frame_number)) {
+		u64 start = SDL_GetPerformanceCounter();
+		worker.render(frame, index);
+		channel.send(elapsed_ms(start));
+	}
+}
+
+// 20 frames with shadows. a worker that failed to start ends the run, the
+// shared memory and mesh files go away as the scene and frame are destroyed
+float split_frames(int workers, int width, int height, GRenderTarget& image) {
+	SplitScene scene;
+	return split_render(scene, workers, width, height, 20, true, image);
+}
+
+// frame time as workers are added, with and without shadow maps (which every
+// worker renders in full). the image must not change with the worker count
+void benchmark_split(int max_workers, int width, int height) {
+	const int frames = 20;
+	SplitScene scene;
+
+	std::cout << "workers\tshadows\tms\tspeedup\tdiffering pixels\n";
+
+	for(bool use_shadows : { false, true }) {
+		GRenderTarget reference, image;
+		float base = split_render(scene, 1, width, height, frames, use_shadows, reference);
+
+		std::cout << 1 << "\t" << use_shadows << "\t" << base << "\t1\t0\n";
+
+		for(int workers = 2; workers <= max_workers; workers *= 2) {
+			float ms = split_render(scene, workers, width, height, frames, use_shadows, image);
+
+			std::size_t differing = frame_difference(image.color, reference.color).pixels;
+			std::cout << workers << "\t" << use_shadows << "\t" << ms << "\t" << base / ms << "\t" << differing << "\n";
+		}
+	}
+}